@@ -0,0 +1,152 @@
+/*
+ * Catcrypt, simple RSA/PKE for C
+ * Copyright (C) 2023, Oğuzhan Eroğlu <meowingcate@gmail.com> (https://meowingcat.io)
+ * Licensed under GPLv3 License
+ * See LICENSE for more info
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "../../include/rsa.h"
+#include "../../include/rng.h"
+#include "../../include/seal.h"
+
+#define BENCH_ROUNDS 5
+#define BENCH_OPERATIONS 2000
+#define BENCH_BLOB_SIZE (16 * 1024)
+#define BENCH_THREADS 4
+#define BENCH_SEAL_SIZE (1024 * 1024)
+
+static uint64_t bench_get_time_nsec() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void bench_random_below(mpz_t num, mpz_t n, size_t size) {
+    unsigned char* bytes = malloc(size);
+    catcrypt_rng_fill(bytes, size);
+    mpz_import(num, size, 1, 1, 0, 0, bytes);
+    mpz_mod(num, num, n);
+    free(bytes);
+}
+
+/**
+ * Best of BENCH_ROUNDS rounds, in microseconds per operation
+ */
+static double bench_generic(mpz_t rop, mpz_t base, catcrypt_rsa_key_t* key) {
+    double best = 0;
+
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        uint64_t started_at = bench_get_time_nsec();
+        for (int i = 0; i < BENCH_OPERATIONS; i++) {
+            mpz_powm(rop, base, key->e, key->n);
+        }
+        double elapsed = (double) (bench_get_time_nsec() - started_at) / 1000.0 / BENCH_OPERATIONS;
+        best = ((round == 0) || (elapsed < best)) ? elapsed: best;
+    }
+
+    return best;
+}
+
+static double bench_key(mpz_t rop, mpz_t base, catcrypt_rsa_key_t* key) {
+    double best = 0;
+
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        uint64_t started_at = bench_get_time_nsec();
+        for (int i = 0; i < BENCH_OPERATIONS; i++) {
+            catcrypt_rsa_key_powm(rop, base, key);
+        }
+        double elapsed = (double) (bench_get_time_nsec() - started_at) / 1000.0 / BENCH_OPERATIONS;
+        best = ((round == 0) || (elapsed < best)) ? elapsed: best;
+    }
+
+    return best;
+}
+
+int main() {
+    size_t sizes[] = {2048, 4096};
+
+    for (int i = 0; i < (sizeof(sizes) / sizeof(sizes[0])); i++) {
+        catcrypt_rsa_keypair_t* keypair = catcrypt_rsa_keypair_new_ex__threads(sizes[i], CATCRYPT_RSA_PUB_EXPONENT, 0, 4); CATCRYPT_REF_COUNTED_USE(keypair);
+        catcrypt_rsa_key_t* pubkey = keypair->pubkey;
+
+        mpz_t block;
+        mpz_init(block);
+        mpz_t signature;
+        mpz_init(signature);
+        mpz_t generic_result;
+        mpz_init(generic_result);
+        mpz_t result;
+        mpz_init(result);
+
+        // An encryption block and a full size signature
+        bench_random_below(block, pubkey->n, catcrypt_rsa_key_block_size(pubkey));
+        bench_random_below(signature, pubkey->n, catcrypt_rsa_key_size(pubkey) + 8);
+
+        double generic_encrypt = bench_generic(generic_result, block, pubkey);
+        double encrypt = bench_key(result, block, pubkey);
+        bool is_encrypt_equal = mpz_cmp(generic_result, result) == 0;
+
+        double generic_verify = bench_generic(generic_result, signature, pubkey);
+        double verify = bench_key(result, signature, pubkey);
+        bool is_verify_equal = mpz_cmp(generic_result, result) == 0;
+
+        printf("%zu bits, e = %lu\n", sizes[i], CATCRYPT_RSA_PUB_EXPONENT);
+        printf("  Encrypt Block: mpz_powm %.2f us, e = 65537 path %.2f us, %.2fx, equal: %d\n", generic_encrypt, encrypt, generic_encrypt / encrypt, is_encrypt_equal);
+        printf("  Verify: mpz_powm %.2f us, e = 65537 path %.2f us, %.2fx, equal: %d\n", generic_verify, verify, generic_verify / verify, is_verify_equal);
+
+        // A 16 KB blob on the calling thread and on BENCH_THREADS threads
+        catcrypt_string_t* blob = catcrypt_string_new__n(BENCH_BLOB_SIZE); CATCRYPT_REF_COUNTED_USE(blob);
+        catcrypt_rng_fill(blob->value, BENCH_BLOB_SIZE);
+        blob->length = BENCH_BLOB_SIZE;
+
+        uint64_t started_at = bench_get_time_nsec();
+        catcrypt_rsa_encrypted_t* encrypted_blob = catcrypt_rsa_encrypt(blob, pubkey); CATCRYPT_REF_COUNTED_USE(encrypted_blob);
+        double encrypt_blob = (double) (bench_get_time_nsec() - started_at) / 1000000.0;
+
+        started_at = bench_get_time_nsec();
+        catcrypt_string_t* decrypted_blob = catcrypt_rsa_decrypt(encrypted_blob, keypair->privkey); CATCRYPT_REF_COUNTED_USE(decrypted_blob);
+        double decrypt = (double) (bench_get_time_nsec() - started_at) / 1000000.0;
+        CATCRYPT_REF_COUNTED_LEAVE(decrypted_blob);
+
+        started_at = bench_get_time_nsec();
+        decrypted_blob = catcrypt_rsa_decrypt__threads(encrypted_blob, keypair->privkey, BENCH_THREADS); CATCRYPT_REF_COUNTED_USE(decrypted_blob);
+        double threaded_decrypt = (double) (bench_get_time_nsec() - started_at) / 1000000.0;
+        printf("  Decrypt %d KB: 1 thread %.2f ms, %d threads %.2f ms, %.2fx, equal: %d\n", BENCH_BLOB_SIZE / 1024, decrypt, BENCH_THREADS, threaded_decrypt, decrypt / threaded_decrypt, catcrypt_string_compare(decrypted_blob, blob));
+        CATCRYPT_REF_COUNTED_LEAVE(decrypted_blob);
+        CATCRYPT_REF_COUNTED_LEAVE(encrypted_blob);
+        CATCRYPT_REF_COUNTED_LEAVE(blob);
+
+        // 1 MB sealed: one exponentiation and ChaCha20-Poly1305, against raw RSA blocks
+        catcrypt_string_t* payload = catcrypt_string_new__n(BENCH_SEAL_SIZE); CATCRYPT_REF_COUNTED_USE(payload);
+        catcrypt_rng_fill(payload->value, BENCH_SEAL_SIZE);
+        payload->length = BENCH_SEAL_SIZE;
+
+        started_at = bench_get_time_nsec();
+        catcrypt_string_t* sealed = catcrypt_seal(payload, pubkey); CATCRYPT_REF_COUNTED_USE(sealed);
+        double seal = (double) (bench_get_time_nsec() - started_at) / 1000000.0;
+
+        started_at = bench_get_time_nsec();
+        catcrypt_string_t* opened = catcrypt_open(sealed, keypair->privkey); CATCRYPT_REF_COUNTED_USE(opened);
+        double open = (double) (bench_get_time_nsec() - started_at) / 1000000.0;
+
+        double megabytes = (double) BENCH_SEAL_SIZE / (1024 * 1024);
+        printf("  Seal %d MB: seal %.2f ms (%.1f MB/s), open %.2f ms (%.1f MB/s), raw RSA encrypt %.3f MB/s, equal: %d\n",
+               BENCH_SEAL_SIZE / (1024 * 1024), seal, megabytes / (seal / 1000.0), open, megabytes / (open / 1000.0),
+               ((double) BENCH_BLOB_SIZE / (1024 * 1024)) / (encrypt_blob / 1000.0), catcrypt_string_compare(opened, payload));
+        CATCRYPT_REF_COUNTED_LEAVE(opened);
+        CATCRYPT_REF_COUNTED_LEAVE(sealed);
+        CATCRYPT_REF_COUNTED_LEAVE(payload);
+
+        mpz_clear(block);
+        mpz_clear(signature);
+        mpz_clear(generic_result);
+        mpz_clear(result);
+        CATCRYPT_REF_COUNTED_LEAVE(keypair);
+    }
+
+    return 0;
+}
\ No newline at end of file
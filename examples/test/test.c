@@ -6,8 +6,106 @@
  */
 
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <poll.h>
 
 #include "../../include/rsa.h"
+#include "../../include/keypool.h"
+#include "../../include/rng.h"
+#include "../../include/sigcache.h"
+#include "../../include/seal.h"
+#include "../../include/async.h"
+
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+
+// Heap allocations of the calling thread while is_counting_allocations is set
+static _Thread_local bool is_counting_allocations = false;
+static _Thread_local size_t allocations = 0;
+
+void* malloc(size_t size) {
+    allocations += is_counting_allocations;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+    allocations += is_counting_allocations;
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    allocations += is_counting_allocations;
+    return __libc_realloc(ptr, size);
+}
+
+// Encrypts data into the v1 format: every block as a native size_t length and its bytes
+static catcrypt_string_t* v1_encrypt(catcrypt_string_t* data, catcrypt_rsa_key_t* key) {
+    catcrypt_string_t* encrypted = catcrypt_string_new();
+    char* block = malloc(catcrypt_rsa_key_size(key));
+    mpz_t num;
+    mpz_init(num);
+
+    for (size_t offset = 0; offset < data->length; offset += CATCRYPT_RSA_BLOCK_SIZE) {
+        size_t block_size = ((data->length - offset) < CATCRYPT_RSA_BLOCK_SIZE) ? (data->length - offset): CATCRYPT_RSA_BLOCK_SIZE;
+        mpz_import(num, block_size, CATCRYPT_MPZ_ORDER, 1, CATCRYPT_MPZ_ENDIAN, 0, data->value + offset);
+        mpz_powm(num, num, key->e, key->n);
+
+        size_t bignum_size = 0;
+        mpz_export(block, &bignum_size, CATCRYPT_MPZ_ORDER, 1, CATCRYPT_MPZ_ENDIAN, 0, num);
+        catcrypt_string_append__cstr__n(encrypted, (char *) &bignum_size, sizeof(bignum_size));
+        catcrypt_string_append__cstr__n(encrypted, block, bignum_size);
+    }
+
+    mpz_clear(num);
+    free(block);
+
+    return encrypted;
+}
+
+// Encrypts data into v2 with CATCRYPT_RSA_BLOCK_SIZE byte blocks, the layout from before full blocks
+static catcrypt_string_t* fixed_blocks_encrypt(catcrypt_string_t* data, catcrypt_rsa_key_t* key) {
+    size_t key_size = catcrypt_rsa_key_size(key);
+    size_t blocks = (data->length + CATCRYPT_RSA_BLOCK_SIZE - 1) / CATCRYPT_RSA_BLOCK_SIZE;
+
+    catcrypt_rsa_encrypted_t* full_encrypted = catcrypt_rsa_encrypt(data, key); CATCRYPT_REF_COUNTED_USE(full_encrypted);
+    catcrypt_string_t* encrypted = catcrypt_string_new__n(CATCRYPT_RSA_HEADER_SIZE + (blocks * key_size));
+    encrypted->length = CATCRYPT_RSA_HEADER_SIZE + (blocks * key_size);
+    memcpy(encrypted->value, full_encrypted->data->value, CATCRYPT_RSA_HEADER_SIZE);
+    CATCRYPT_REF_COUNTED_LEAVE(full_encrypted);
+
+    encrypted->value[5] = 0;
+    encrypted->value[6] = CATCRYPT_RSA_BLOCK_SIZE >> 8;
+    encrypted->value[7] = CATCRYPT_RSA_BLOCK_SIZE & 0xFF;
+    for (int i = 0; i < 8; i++) {
+        encrypted->value[20 + i] = (char) (blocks >> (8 * (7 - i)));
+    }
+
+    mpz_t num;
+    mpz_init(num);
+
+    for (size_t i = 0; i < blocks; i++) {
+        size_t offset = i * CATCRYPT_RSA_BLOCK_SIZE;
+        size_t block_size = ((data->length - offset) < CATCRYPT_RSA_BLOCK_SIZE) ? (data->length - offset): CATCRYPT_RSA_BLOCK_SIZE;
+        mpz_import(num, block_size, CATCRYPT_MPZ_ORDER, 1, CATCRYPT_MPZ_ENDIAN, 0, data->value + offset);
+        mpz_powm(num, num, key->e, key->n);
+
+        char* slot = encrypted->value + CATCRYPT_RSA_HEADER_SIZE + (i * key_size);
+        size_t num_size = mpz_sizeinbase(num, 256);
+        memset(slot, 0, key_size - num_size);
+        mpz_export(slot + (key_size - num_size), NULL, CATCRYPT_MPZ_ORDER, 1, CATCRYPT_MPZ_ENDIAN, 0, num);
+    }
+
+    mpz_clear(num);
+
+    return encrypted;
+}
+
+static void async_keygen_callback(catcrypt_async_job_t* job, void* context) {
+    *((atomic_bool *) context) = (job->state == CATCRYPT_ASYNC_STATE_DONE) && (job->keypair != NULL);
+}
 
 int main() {
     char* data_to_encrypt = "Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor incididunt ut labore et dolore magna aliqua. Ut enim ad minim veniam, quis nostrud exercitation ullamco laboris nisi ut aliquip ex ea commodo consequat. Duis aute irure dolor in reprehenderit in voluptate velit esse cillum dolore eu fugiat nulla pariatur. Excepteur sint occaecat cupidatat non proident, sunt in culpa qui officia deserunt mollit anim id est laborum. Sed no sumo stet, est ei quodsi feugait liberavisse, in pro quot facete definitiones. Vivendum intellegat et qui, ei denique consequuntur vix. Offendit eleifend moderatius ex vix, quem odio mazim et qui, purto expetendis cotidieque quo cu, veri persius vituperata ei nec. Partiendo adversarium no mea. Offendit eleifend moderatius ex vix, quem odio mazim et qui, purto expetendis cotidieque quo cu, veri persius vituperata ei nec. Qui gloriatur scribentur et, id velit verear mel, cum no porro debet. Sit fugit nostrum et. Offendit eleifend moderatius ex vix, quem odio mazim et qui, purto expetendis cotidieque quo cu, veri persius vituperata ei nec. Pro ea animal dolores. Scripta periculis ei eam, te pro movet reformidans. Soluta facilisi instructior eam in, ferri oratio ancillae te ius. Vivendum intellegat et qui, ei denique consequuntur vix.";
@@ -29,6 +127,7 @@ int main() {
     catcrypt_rsa_encrypted_t* encrypted = catcrypt_rsa_encrypt(data_to_encrypt_str, pubkey_from_hex); CATCRYPT_REF_COUNTED_USE(encrypted);
     catcrypt_string_t* decrypted = catcrypt_rsa_decrypt(encrypted, privkey_from_hex); CATCRYPT_REF_COUNTED_USE(decrypted);
     printf("Decrypted: %s\n", decrypted->value);
+    printf("Decrypted Matches: %d\n", catcrypt_string_compare(decrypted, data_to_encrypt_str));
     catcrypt_string_t* signature = catcrypt_rsa_sign(data_to_encrypt_str, keypair->privkey); CATCRYPT_REF_COUNTED_USE(signature);
     catcrypt_string_t* signature_hex = catcrypt_rsa_signature_to_hex(signature); CATCRYPT_REF_COUNTED_USE(signature_hex);
     printf("Signature: %s\n", signature_hex->value);
@@ -40,9 +139,406 @@ int main() {
     printf("Private Key: %s\n", privkey_hex->value);
     printf("Public Key From Hex: %s\n", pubkey_from_hex_to_hex->value);
     printf("Private Key From Hex: %s\n", privkey_from_hex_to_hex->value);
+    printf("Private Key Round-Trip: %d\n", catcrypt_string_compare(privkey_hex, privkey_from_hex_to_hex) && privkey_from_hex->is_crt);
+
+    catcrypt_string_t* privkey_bin = catcrypt_rsa_key_to_bin(keypair->privkey); CATCRYPT_REF_COUNTED_USE(privkey_bin);
+    catcrypt_rsa_key_t* truncated_key = catcrypt_rsa_key_from_bin__n(privkey_bin->value, privkey_bin->length - 1);
+    catcrypt_rsa_key_t* short_key = catcrypt_rsa_key_from_bin__n(privkey_bin->value, sizeof(size_t));
+    catcrypt_string_append__cstr__n(privkey_bin, "\x00", 1);
+    catcrypt_rsa_key_t* padded_key = catcrypt_rsa_key_from_bin(privkey_bin);
+    printf("Malformed Key Bin: Rejected: %d\n", !truncated_key && !short_key && !padded_key);
+    CATCRYPT_REF_COUNTED_LEAVE(privkey_bin);
+
+    // A zero q has to be rejected when it is loaded, a wrong dp in memory (a fault) must not change the results
+    catcrypt_rsa_key_t* faulty_key = catcrypt_rsa_key_from_hex(privkey_hex); CATCRYPT_REF_COUNTED_USE(faulty_key);
+    mpz_set_ui(faulty_key->q, 0);
+    catcrypt_string_t* zero_q_bin = catcrypt_rsa_key_to_bin(faulty_key); CATCRYPT_REF_COUNTED_USE(zero_q_bin);
+    catcrypt_rsa_key_t* zero_q_key = catcrypt_rsa_key_from_bin(zero_q_bin);
+    mpz_set(faulty_key->q, keypair->privkey->q);
+    mpz_add_ui(faulty_key->dp, faulty_key->dp, 2);
+    catcrypt_string_t* faulty_decrypted = catcrypt_rsa_decrypt(encrypted, faulty_key); CATCRYPT_REF_COUNTED_USE(faulty_decrypted);
+    catcrypt_string_t* faulty_signature = catcrypt_rsa_sign(data_to_encrypt_str, faulty_key); CATCRYPT_REF_COUNTED_USE(faulty_signature);
+    printf("Bad CRT Key: Rejected: %d, Faulty Decrypted Matches: %d, Faulty Signature Verified: %d\n", !zero_q_key,
+           catcrypt_string_compare(faulty_decrypted, data_to_encrypt_str), catcrypt_rsa_verify(data_to_encrypt_str, faulty_signature, keypair->pubkey));
+    CATCRYPT_REF_COUNTED_LEAVE(faulty_signature);
+    CATCRYPT_REF_COUNTED_LEAVE(faulty_decrypted);
+    CATCRYPT_REF_COUNTED_LEAVE(zero_q_bin);
+    CATCRYPT_REF_COUNTED_LEAVE(faulty_key);
     
     printf("Verified: %d\n", verified);
 
+    bool is_zero_allocation_verified = catcrypt_rsa_verify(data_to_encrypt_str, signature, keypair->pubkey);
+    is_counting_allocations = true;
+    for (int i = 0; i < 100; i++) {
+        is_zero_allocation_verified = is_zero_allocation_verified && catcrypt_rsa_verify(data_to_encrypt_str, signature, keypair->pubkey);
+    }
+    is_counting_allocations = false;
+    printf("Zero-Allocation Verify: Verified: %d, allocations %zu\n", is_zero_allocation_verified, allocations);
+
+    mpz_t powm_base;
+    mpz_init_set_ui(powm_base, 12345);
+    mpz_t powm_rop;
+    mpz_init2(powm_rop, keypair->pubkey->bits);
+    catcrypt_rsa_key_powm(powm_rop, powm_base, keypair->pubkey);
+    allocations = 0;
+    is_counting_allocations = true;
+    for (int i = 0; i < 100; i++) {
+        catcrypt_rsa_key_powm(powm_rop, powm_base, keypair->pubkey);
+    }
+    is_counting_allocations = false;
+    printf("Zero-Allocation Public Powm: allocations %zu\n", allocations);
+    mpz_clear(powm_base);
+    mpz_clear(powm_rop);
+
+    catcrypt_string_t* batch_data[8];
+    catcrypt_string_t* batch_signatures[8];
+    catcrypt_rsa_key_t* batch_pubkeys[8];
+    uint8_t batch_results[CATCRYPT_RSA_BITMAP_SIZE(8)];
+    // Prefixes from 32 bytes on, those whose h32 hash is 0 are skipped (catcrypt_rsa_verify() rejects a hash of 0)
+    for (int i = 0, length = 32; i < 8; length++) {
+        if (catcrypt_rsa_hash_h32__n(data_to_encrypt, length) == 0) {
+            continue;
+        }
+
+        batch_data[i] = catcrypt_string_new_from_cstr__copy(data_to_encrypt, length); CATCRYPT_REF_COUNTED_USE(batch_data[i]);
+        batch_signatures[i] = catcrypt_rsa_sign(batch_data[i], keypair->privkey); CATCRYPT_REF_COUNTED_USE(batch_signatures[i]);
+        batch_pubkeys[i] = keypair->pubkey;
+        i++;
+    }
+    batch_signatures[5]->value[batch_signatures[5]->length - 1] ^= 1;
+    bool is_batch_verified = catcrypt_rsa_verify__batch(batch_results, batch_data, batch_signatures, batch_pubkeys, 8);
+    bool is_bad_found = !is_batch_verified;
+    for (int i = 0; i < 8; i++) {
+        is_bad_found = is_bad_found && (CATCRYPT_RSA_BITMAP_GET(batch_results, i) == (i != 5));
+        CATCRYPT_REF_COUNTED_LEAVE(batch_data[i]);
+        CATCRYPT_REF_COUNTED_LEAVE(batch_signatures[i]);
+    }
+    printf("Batch Verify: items 8, Bad Item Found: %d\n", is_bad_found);
+
+    catcrypt_sigcache_t* sigcache = catcrypt_sigcache_new(1024, 0); CATCRYPT_REF_COUNTED_USE(sigcache);
+    bool is_cache_verified = catcrypt_sigcache_verify(sigcache, data_to_encrypt_str, signature, keypair->pubkey)
+                          && catcrypt_sigcache_verify(sigcache, data_to_encrypt_str, signature, keypair->pubkey);
+    catcrypt_sigcache_stats_t sigcache_stats;
+    catcrypt_sigcache_get_stats(sigcache, &sigcache_stats);
+    printf("Signature Cache: Verified: %d, hits %lu, misses %lu\n", is_cache_verified, sigcache_stats.hits, sigcache_stats.misses);
+    CATCRYPT_REF_COUNTED_LEAVE(sigcache);
+    catcrypt_sigcache_t* small_sigcache = catcrypt_sigcache_new(100, 16); CATCRYPT_REF_COUNTED_USE(small_sigcache);
+    catcrypt_sigcache_get_stats(small_sigcache, &sigcache_stats);
+    printf("Small Signature Cache: capacity %lu, Within: %d\n", sigcache_stats.capacity, sigcache_stats.capacity <= 100);
+    CATCRYPT_REF_COUNTED_LEAVE(small_sigcache);
+
+    privkey_from_hex->flags |= CATCRYPT_RSA_FLAG_CONSTANT_TIME;
+    catcrypt_string_t* constant_time_decrypted = catcrypt_rsa_decrypt(encrypted, privkey_from_hex); CATCRYPT_REF_COUNTED_USE(constant_time_decrypted);
+    printf("Constant-Time Decrypted Matches: %d\n", catcrypt_string_compare(constant_time_decrypted, data_to_encrypt_str));
+    CATCRYPT_REF_COUNTED_LEAVE(constant_time_decrypted);
+
+    privkey_from_hex->flags = CATCRYPT_RSA_FLAG_BLINDING;
+    catcrypt_string_t* blinded_decrypted = catcrypt_rsa_decrypt(encrypted, privkey_from_hex); CATCRYPT_REF_COUNTED_USE(blinded_decrypted);
+    printf("Blinded Decrypted Matches: %d\n", catcrypt_string_compare(blinded_decrypted, data_to_encrypt_str));
+    CATCRYPT_REF_COUNTED_LEAVE(blinded_decrypted);
+
+    catcrypt_prime_stats_t prime_stats;
+    catcrypt_prime_stats_init(&prime_stats);
+    mpz_t prime;
+    mpz_init(prime);
+    catcrypt_rsa_random_prime__stats(prime, &prime_stats);
+    printf("Prime Search: tested %lu, sieved %lu\n", prime_stats.tested, prime_stats.sieved);
+    mpz_clear(prime);
+
+    uint64_t keygen_started_at = catcrypt_util_get_time_msec();
+    catcrypt_rsa_keypair_t* threaded_keypair = catcrypt_rsa_keypair_new__threads(4); CATCRYPT_REF_COUNTED_USE(threaded_keypair);
+    printf("Threaded Key Pair: %lu ms, is CRT: %d, bits: %zu\n", catcrypt_util_get_time_msec() - keygen_started_at, threaded_keypair->privkey->is_crt, catcrypt_rsa_key_bits(threaded_keypair->pubkey));
+    CATCRYPT_REF_COUNTED_LEAVE(threaded_keypair);
+
+    catcrypt_rsa_keypair_t* small_keypair = catcrypt_rsa_keypair_new_ex__threads(2048, 3, 0, 2); CATCRYPT_REF_COUNTED_USE(small_keypair);
+    catcrypt_rsa_encrypted_t* small_encrypted = catcrypt_rsa_encrypt(data_to_encrypt_str, small_keypair->pubkey); CATCRYPT_REF_COUNTED_USE(small_encrypted);
+    catcrypt_string_t* small_decrypted = catcrypt_rsa_decrypt(small_encrypted, small_keypair->privkey); CATCRYPT_REF_COUNTED_USE(small_decrypted);
+    printf("Runtime Key Size: %zu bits, block %zu, Decrypted Matches: %d\n", catcrypt_rsa_key_bits(small_keypair->pubkey), catcrypt_rsa_key_block_size(small_keypair->pubkey), catcrypt_string_compare(small_decrypted, data_to_encrypt_str));
+    bool is_prepared = catcrypt_rsa_key_prepare(small_keypair->pubkey);
+    catcrypt_rsa_encrypted_t* prepared_encrypted = catcrypt_rsa_encrypt(data_to_encrypt_str, small_keypair->pubkey); CATCRYPT_REF_COUNTED_USE(prepared_encrypted);
+    printf("Prepared Key: %d, Ciphertext Matches: %d\n", is_prepared, catcrypt_string_compare(prepared_encrypted->data, small_encrypted->data));
+    CATCRYPT_REF_COUNTED_LEAVE(prepared_encrypted);
+    CATCRYPT_REF_COUNTED_LEAVE(small_decrypted);
+    CATCRYPT_REF_COUNTED_LEAVE(small_encrypted);
+    CATCRYPT_REF_COUNTED_LEAVE(small_keypair);
+
+    catcrypt_rsa_keypair_t* multi_prime_keypair = catcrypt_rsa_keypair_new__primes(4); CATCRYPT_REF_COUNTED_USE(multi_prime_keypair);
+    catcrypt_string_t* multi_prime_privkey_hex = catcrypt_rsa_key_to_hex(multi_prime_keypair->privkey); CATCRYPT_REF_COUNTED_USE(multi_prime_privkey_hex);
+    catcrypt_rsa_key_t* multi_prime_privkey = catcrypt_rsa_key_from_hex(multi_prime_privkey_hex); CATCRYPT_REF_COUNTED_USE(multi_prime_privkey);
+    catcrypt_string_t* multi_prime_signature = catcrypt_rsa_sign(data_to_encrypt_str, multi_prime_privkey); CATCRYPT_REF_COUNTED_USE(multi_prime_signature);
+    printf("Multi-Prime Key: primes %d, bits %zu, Verified: %d\n", multi_prime_privkey->primes, catcrypt_rsa_key_bits(multi_prime_privkey), catcrypt_rsa_verify(data_to_encrypt_str, multi_prime_signature, multi_prime_keypair->pubkey));
+    CATCRYPT_REF_COUNTED_LEAVE(multi_prime_signature);
+    CATCRYPT_REF_COUNTED_LEAVE(multi_prime_privkey);
+    CATCRYPT_REF_COUNTED_LEAVE(multi_prime_privkey_hex);
+    CATCRYPT_REF_COUNTED_LEAVE(multi_prime_keypair);
+
+    catcrypt_rsa_keypair_t* family_keypairs[4];
+    catcrypt_rsa_encrypted_t* family_encrypted[4];
+    catcrypt_rsa_key_t* family_privkeys[4];
+    catcrypt_string_t* family_decrypted[4];
+    catcrypt_rsa_keypair_new_family__threads(family_keypairs, 4, 2048, CATCRYPT_RSA_FLAG_BLINDING, 2);
+    for (int i = 0; i < 4; i++) {
+        family_encrypted[i] = catcrypt_rsa_encrypt(data_to_encrypt_str, family_keypairs[i]->pubkey);
+        family_privkeys[i] = family_keypairs[i]->privkey;
+    }
+    catcrypt_rsa_decrypt__batch(family_decrypted, family_encrypted, family_privkeys, 4);
+    bool is_batch_matched = true;
+    bool is_pubkey_unflagged = true;
+    for (int i = 0; i < 4; i++) {
+        CATCRYPT_REF_COUNTED_USE(family_decrypted[i]);
+        is_batch_matched = is_batch_matched && catcrypt_string_compare(family_decrypted[i], data_to_encrypt_str);
+        is_pubkey_unflagged = is_pubkey_unflagged && !(family_keypairs[i]->pubkey->flags & CATCRYPT_RSA_FLAG_BLINDING);
+        CATCRYPT_REF_COUNTED_LEAVE(family_decrypted[i]);
+        CATCRYPT_REF_COUNTED_LEAVE(family_keypairs[i]);
+    }
+    printf("Batch Decrypt: keys 4, Decrypted Matches: %d, Public Keys Unblinded: %d\n", is_batch_matched, is_pubkey_unflagged);
+
+    catcrypt_string_t* blob = catcrypt_string_new__n(16 * 1024); CATCRYPT_REF_COUNTED_USE(blob);
+    catcrypt_rng_fill(blob->value, 16 * 1024);
+    blob->length = 16 * 1024;
+    catcrypt_rsa_encrypted_t* blob_encrypted = catcrypt_rsa_encrypt(blob, keypair->pubkey); CATCRYPT_REF_COUNTED_USE(blob_encrypted);
+    catcrypt_rsa_encrypted_t* threaded_blob_encrypted = catcrypt_rsa_encrypt__threads(blob, keypair->pubkey, 4); CATCRYPT_REF_COUNTED_USE(threaded_blob_encrypted);
+    catcrypt_string_t* threaded_blob_decrypted = catcrypt_rsa_decrypt__threads(threaded_blob_encrypted, keypair->privkey, 4); CATCRYPT_REF_COUNTED_USE(threaded_blob_decrypted);
+    printf("Threaded Blocks: Ciphertext Matches: %d, Decrypted Matches: %d\n", catcrypt_string_compare(threaded_blob_encrypted->data, blob_encrypted->data), catcrypt_string_compare(threaded_blob_decrypted, blob));
+    CATCRYPT_REF_COUNTED_LEAVE(threaded_blob_decrypted);
+    CATCRYPT_REF_COUNTED_LEAVE(threaded_blob_encrypted);
+
+    catcrypt_rsa_header_t blob_header;
+    bool is_header_read = catcrypt_rsa_header_read(blob_encrypted->data, &blob_header);
+    catcrypt_string_t* blob_block = catcrypt_rsa_decrypt_block(blob_encrypted, keypair->privkey, 7); CATCRYPT_REF_COUNTED_USE(blob_block);
+    printf("Format v2: header %d, blocks %lu, Size Matches: %d, Block 7 Matches: %d\n",
+           is_header_read && (blob_header.version == CATCRYPT_RSA_FORMAT_V2) && (blob_header.fingerprint == catcrypt_rsa_key_fingerprint(keypair->privkey)), blob_header.blocks,
+           blob_encrypted->data->length == catcrypt_rsa_encrypted_size(keypair->pubkey, blob->length),
+           memcmp(blob_block->value, blob->value + (7 * blob_header.block_size), blob_header.block_size) == 0);
+    CATCRYPT_REF_COUNTED_LEAVE(blob_block);
+    blob_encrypted->data->value[12] ^= 1;
+    catcrypt_string_t* foreign_decrypted = catcrypt_rsa_decrypt(blob_encrypted, keypair->privkey);
+    printf("Foreign Fingerprint Rejected: %d\n", foreign_decrypted == NULL);
+    blob_encrypted->data->value[12] ^= 1;
+
+    catcrypt_rsa_encrypted_t* v1_encrypted = catcrypt_rsa_encrypted_new(); CATCRYPT_REF_COUNTED_USE(v1_encrypted);
+    catcrypt_rsa_encrypted_set_data(v1_encrypted, v1_encrypt(data_to_encrypt_str, keypair->pubkey));
+    catcrypt_string_t* v1_decrypted = catcrypt_rsa_decrypt(v1_encrypted, keypair->privkey); CATCRYPT_REF_COUNTED_USE(v1_decrypted);
+    uint32_t v1_hash = catcrypt_rsa_hash_h32__n(data_to_encrypt_str->value, data_to_encrypt_str->length);
+    catcrypt_string_t* v1_hash_str = catcrypt_string_new_from_binary__copy((char *) &v1_hash, sizeof(v1_hash)); CATCRYPT_REF_COUNTED_USE(v1_hash_str);
+    catcrypt_string_t* v1_signature = v1_encrypt(v1_hash_str, keypair->privkey); CATCRYPT_REF_COUNTED_USE(v1_signature);
+    printf("Format v1: Decrypted Matches: %d, Verified: %d\n", catcrypt_string_compare(v1_decrypted, data_to_encrypt_str), catcrypt_rsa_verify(data_to_encrypt_str, v1_signature, keypair->pubkey));
+    CATCRYPT_REF_COUNTED_LEAVE(v1_signature);
+    CATCRYPT_REF_COUNTED_LEAVE(v1_hash_str);
+    CATCRYPT_REF_COUNTED_LEAVE(v1_decrypted);
+    CATCRYPT_REF_COUNTED_LEAVE(v1_encrypted);
+
+    // A block that isn't below n and a size prefix that runs past the data
+    size_t v1_key_size = catcrypt_rsa_key_size(keypair->pubkey);
+    catcrypt_string_t* v1_large = catcrypt_string_new();
+    catcrypt_string_append__cstr__n(v1_large, (char *) &v1_key_size, sizeof(v1_key_size));
+    for (size_t i = 0; i < v1_key_size; i++) {
+        catcrypt_string_append__cstr__n(v1_large, "\xff", 1);
+    }
+    catcrypt_rsa_encrypted_t* v1_large_encrypted = catcrypt_rsa_encrypted_new(); CATCRYPT_REF_COUNTED_USE(v1_large_encrypted);
+    catcrypt_rsa_encrypted_set_data(v1_large_encrypted, v1_large);
+    catcrypt_string_t* v1_truncated = catcrypt_string_new();
+    catcrypt_string_append__cstr__n(v1_truncated, (char *) &v1_key_size, sizeof(v1_key_size));
+    catcrypt_string_append__cstr__n(v1_truncated, "\x01", 1);
+    catcrypt_rsa_encrypted_t* v1_truncated_encrypted = catcrypt_rsa_encrypted_new(); CATCRYPT_REF_COUNTED_USE(v1_truncated_encrypted);
+    catcrypt_rsa_encrypted_set_data(v1_truncated_encrypted, v1_truncated);
+    catcrypt_string_t* v1_malformed_decrypted[2];
+    catcrypt_rsa_encrypted_t* v1_malformed_encrypted[2] = {v1_large_encrypted, v1_truncated_encrypted};
+    catcrypt_rsa_key_t* v1_malformed_keys[2] = {keypair->privkey, keypair->privkey};
+    catcrypt_rsa_decrypt__batch(v1_malformed_decrypted, v1_malformed_encrypted, v1_malformed_keys, 2);
+    printf("Format v1 Malformed: Rejected: %d, Batch Rejected: %d\n",
+           (catcrypt_rsa_decrypt(v1_large_encrypted, keypair->privkey) == NULL) && (catcrypt_rsa_decrypt(v1_truncated_encrypted, keypair->privkey) == NULL),
+           (v1_malformed_decrypted[0] == NULL) && (v1_malformed_decrypted[1] == NULL));
+    CATCRYPT_REF_COUNTED_LEAVE(v1_truncated_encrypted);
+    CATCRYPT_REF_COUNTED_LEAVE(v1_large_encrypted);
+
+    // A header of more than CATCRYPT_STRING_MAX_LENGTH bytes, the data claims to hold its blocks but only the header is read
+    catcrypt_rsa_encrypted_t* oversized_encrypted = catcrypt_rsa_encrypt(data_to_encrypt_str, keypair->pubkey); CATCRYPT_REF_COUNTED_USE(oversized_encrypted);
+    catcrypt_rsa_header_t oversized_header;
+    catcrypt_rsa_header_read(oversized_encrypted->data, &oversized_header);
+    uint64_t oversized_blocks = ((uint64_t) CATCRYPT_STRING_MAX_LENGTH / oversized_header.block_size) + 1;
+    uint64_t oversized_length = oversized_blocks * oversized_header.block_size;
+    for (int i = 0; i < 8; i++) {
+        oversized_encrypted->data->value[20 + i] = (char) (oversized_blocks >> (8 * (7 - i)));
+        oversized_encrypted->data->value[28 + i] = (char) (oversized_length >> (8 * (7 - i)));
+    }
+    unsigned int oversized_data_length = oversized_encrypted->data->length;
+    oversized_encrypted->data->length = CATCRYPT_RSA_HEADER_SIZE + (oversized_blocks * oversized_header.key_size);
+    catcrypt_string_t* oversized_decrypted;
+    catcrypt_rsa_decrypt__batch(&oversized_decrypted, &oversized_encrypted, &keypair->privkey, 1);
+    printf("Oversized v2: Rejected: %d, Batch Rejected: %d\n", catcrypt_rsa_decrypt(oversized_encrypted, keypair->privkey) == NULL, oversized_decrypted == NULL);
+    oversized_encrypted->data->length = oversized_data_length;
+    CATCRYPT_REF_COUNTED_LEAVE(oversized_encrypted);
+
+    catcrypt_rsa_encrypted_t* fixed_encrypted = catcrypt_rsa_encrypted_new(); CATCRYPT_REF_COUNTED_USE(fixed_encrypted);
+    catcrypt_rsa_encrypted_set_data(fixed_encrypted, fixed_blocks_encrypt(blob, keypair->pubkey));
+    catcrypt_string_t* fixed_decrypted = catcrypt_rsa_decrypt(fixed_encrypted, keypair->privkey); CATCRYPT_REF_COUNTED_USE(fixed_decrypted);
+    printf("Full Blocks: block %u, %lu blocks (fixed %d), Fixed Blocks Decrypted Matches: %d\n",
+           blob_header.block_size, blob_header.blocks, (int) ((blob->length + CATCRYPT_RSA_BLOCK_SIZE - 1) / CATCRYPT_RSA_BLOCK_SIZE), fixed_decrypted && catcrypt_string_compare(fixed_decrypted, blob));
+    CATCRYPT_REF_COUNTED_LEAVE(fixed_decrypted);
+    CATCRYPT_REF_COUNTED_LEAVE(fixed_encrypted);
+
+    catcrypt_string_t* sealed = catcrypt_seal(blob, keypair->pubkey); CATCRYPT_REF_COUNTED_USE(sealed);
+    catcrypt_string_t* opened = catcrypt_open(sealed, keypair->privkey); CATCRYPT_REF_COUNTED_USE(opened);
+    sealed->value[sealed->length - 1] ^= 1;
+    catcrypt_string_t* tampered_opened = catcrypt_open(sealed, keypair->privkey);
+    printf("Seal: Size Matches: %d, Opened Matches: %d, Tampered Rejected: %d\n", sealed->length == catcrypt_seal_size(keypair->pubkey, blob->length), catcrypt_string_compare(opened, blob), tampered_opened == NULL);
+    CATCRYPT_REF_COUNTED_LEAVE(opened);
+    CATCRYPT_REF_COUNTED_LEAVE(sealed);
+
+    catcrypt_string_t* streamed_encrypted = catcrypt_string_new(); CATCRYPT_REF_COUNTED_USE(streamed_encrypted);
+    catcrypt_rsa_stream_t* encrypt_stream = catcrypt_rsa_encrypt_init(keypair->pubkey, blob->length, catcrypt_rsa_sink_string, streamed_encrypted); CATCRYPT_REF_COUNTED_USE(encrypt_stream);
+    for (size_t offset = 0; offset < blob->length; offset += 1000) {
+        catcrypt_rsa_stream_update(encrypt_stream, blob->value + offset, ((blob->length - offset) < 1000) ? (blob->length - offset): 1000);
+    }
+    bool is_encrypt_final = catcrypt_rsa_stream_final(encrypt_stream);
+    catcrypt_string_t* streamed_decrypted = catcrypt_string_new(); CATCRYPT_REF_COUNTED_USE(streamed_decrypted);
+    catcrypt_rsa_stream_t* decrypt_stream = catcrypt_rsa_decrypt_init(keypair->privkey, catcrypt_rsa_sink_string, streamed_decrypted); CATCRYPT_REF_COUNTED_USE(decrypt_stream);
+    for (size_t offset = 0; offset < streamed_encrypted->length; offset += 777) {
+        catcrypt_rsa_stream_update(decrypt_stream, streamed_encrypted->value + offset, ((streamed_encrypted->length - offset) < 777) ? (streamed_encrypted->length - offset): 777);
+    }
+    bool is_decrypt_final = catcrypt_rsa_stream_final(decrypt_stream);
+    printf("Streaming: Ciphertext Matches: %d, Decrypted Matches: %d, Trailing Data Rejected: %d\n",
+           is_encrypt_final && catcrypt_string_compare(streamed_encrypted, blob_encrypted->data), is_decrypt_final && catcrypt_string_compare(streamed_decrypted, blob),
+           !catcrypt_rsa_stream_update(decrypt_stream, blob->value, 1));
+    CATCRYPT_REF_COUNTED_LEAVE(decrypt_stream);
+    CATCRYPT_REF_COUNTED_LEAVE(streamed_decrypted);
+    CATCRYPT_REF_COUNTED_LEAVE(encrypt_stream);
+    CATCRYPT_REF_COUNTED_LEAVE(streamed_encrypted);
+
+    size_t into_size = catcrypt_rsa_encrypt_itch(keypair->pubkey, data_to_encrypt_str->length);
+    char* into_buffer = malloc(into_size);
+    bool is_into_encrypted = catcrypt_rsa_encrypt__into(into_buffer, into_size, data_to_encrypt_str->value, data_to_encrypt_str->length, keypair->pubkey);
+    bool is_into_encrypt_matched = is_into_encrypted && (into_size == encrypted->data->length) && (memcmp(into_buffer, encrypted->data->value, into_size) == 0);
+    size_t into_decrypted_size = catcrypt_rsa_decrypt_itch(into_buffer, into_size);
+    bool is_into_decrypted = catcrypt_rsa_decrypt__into(into_buffer, into_decrypted_size, into_buffer, into_size, keypair->privkey);
+    bool is_in_place_matched = is_into_decrypted && (into_decrypted_size == data_to_encrypt_str->length) && (memcmp(into_buffer, data_to_encrypt_str->value, into_decrypted_size) == 0);
+    free(into_buffer);
+    size_t into_signature_size = catcrypt_rsa_sign_itch(keypair->privkey);
+    char* into_signature = malloc(into_signature_size * 2);
+    catcrypt_rsa_sign__into(into_signature + into_signature_size, into_signature_size, data_to_encrypt_str->value, data_to_encrypt_str->length, keypair->privkey);
+    catcrypt_rsa_signature_to_hex__into(into_signature, into_signature_size * 2, into_signature + into_signature_size, into_signature_size);
+    bool is_into_signature_matched = memcmp(into_signature, signature_hex->value, into_signature_size * 2) == 0;
+    catcrypt_rsa_signature_from_hex__into(into_signature, into_signature_size, into_signature, into_signature_size * 2);
+    is_into_signature_matched = is_into_signature_matched && (memcmp(into_signature, signature->value, into_signature_size) == 0);
+    free(into_signature);
+    size_t into_key_size = catcrypt_rsa_key_to_hex_itch(keypair->privkey);
+    char* into_key = malloc(into_key_size);
+    bool is_into_key_matched = catcrypt_rsa_key_to_hex__into(into_key, into_key_size, keypair->privkey) && (into_key_size == privkey_hex->length) && (memcmp(into_key, privkey_hex->value, into_key_size) == 0);
+    free(into_key);
+    printf("Caller Buffers: Encrypt Matches: %d, In-Place Decrypt Matches: %d, Signature Hex Matches: %d, Key Hex Matches: %d\n", is_into_encrypt_matched, is_in_place_matched, is_into_signature_matched, is_into_key_matched);
+
+    struct iovec gather[3] = {{blob->value, 1000}, {blob->value + 1000, 1}, {blob->value + 1001, blob->length - 1001}};
+    size_t scatter_size = catcrypt_rsa_encrypt_itch(keypair->pubkey, blob->length) + 100;
+    char* scatter_buffer = malloc(scatter_size);
+    struct iovec scatter[4] = {{scatter_buffer, 7}, {scatter_buffer + 7, 300}, {scatter_buffer + 307, 1541}, {scatter_buffer + 1848, scatter_size - 1848}};
+    int scattered = catcrypt_rsa_encrypt__iov(scatter, 4, gather, 3, keypair->pubkey);
+    size_t scattered_length = (scattered > 0) ? ((char *) scatter[scattered - 1].iov_base - scatter_buffer) + scatter[scattered - 1].iov_len: 0;
+    bool is_scatter_matched = (scattered_length == blob_encrypted->data->length) && (memcmp(scatter_buffer, blob_encrypted->data->value, scattered_length) == 0);
+    struct iovec signature_gather[2] = {{data_to_encrypt_str->value, 5}, {data_to_encrypt_str->value + 5, data_to_encrypt_str->length - 5}};
+    struct iovec signature_scatter[2] = {{scatter_buffer, 11}, {scatter_buffer + 11, scatter_size - 11}};
+    scattered = catcrypt_rsa_sign__iov(signature_scatter, 2, signature_gather, 2, keypair->privkey);
+    bool is_scatter_signature_matched = (scattered == 2) && ((11 + signature_scatter[1].iov_len) == signature->length) && (memcmp(scatter_buffer, signature->value, signature->length) == 0);
+    free(scatter_buffer);
+    printf("Scatter-Gather: Ciphertext Matches: %d, Signature Matches: %d\n", is_scatter_matched, is_scatter_signature_matched);
+    CATCRYPT_REF_COUNTED_LEAVE(blob_encrypted);
+    CATCRYPT_REF_COUNTED_LEAVE(blob);
+
+    unsigned char parent_random[32];
+    unsigned char child_random[32];
+    int rng_pipe[2];
+    CATCRYPT_UTIL_ASSERT(pipe(rng_pipe) == 0);
+    catcrypt_rng_fill(parent_random, sizeof(parent_random));
+    pid_t rng_child = fork();
+    if (rng_child == 0) {
+        catcrypt_rng_fill(child_random, sizeof(child_random));
+        _exit(write(rng_pipe[1], child_random, sizeof(child_random)) != sizeof(child_random));
+    }
+    catcrypt_rng_fill(parent_random, sizeof(parent_random));
+    CATCRYPT_UTIL_ASSERT(read(rng_pipe[0], child_random, sizeof(child_random)) == sizeof(child_random));
+    waitpid(rng_child, NULL, 0);
+    close(rng_pipe[0]);
+    close(rng_pipe[1]);
+    printf("RNG Fork Safe: %d\n", memcmp(parent_random, child_random, sizeof(child_random)) != 0);
+
+    catcrypt_keypool_t* keypool = catcrypt_keypool_new(1, 1, NULL); CATCRYPT_REF_COUNTED_USE(keypool);
+    catcrypt_keypool_stats_t keypool_stats;
+    do {
+        catcrypt_util_msleep(10);
+        catcrypt_keypool_get_stats(keypool, &keypool_stats);
+    } while (keypool_stats.available == 0);
+    catcrypt_rsa_keypair_t* pooled_keypair = catcrypt_keypool_acquire(keypool);
+    catcrypt_rsa_keypair_t* missed_keypair = catcrypt_keypool_acquire(keypool);
+    catcrypt_keypool_get_stats(keypool, &keypool_stats);
+    printf("Key Pool: acquired %d, missed %d, hits %lu, misses %lu, generated %lu\n", pooled_keypair != NULL, missed_keypair == NULL, keypool_stats.hits, keypool_stats.misses, keypool_stats.generated);
+    CATCRYPT_REF_COUNTED_LEAVE(pooled_keypair);
+    CATCRYPT_REF_COUNTED_LEAVE(keypool);
+
+    // A saved key pair and then a record cut short, with a length far past the end of the file
+    char* keypool_path = "/tmp/catcrypt_test_keypool.bin";
+    FILE* keypool_file = fopen(keypool_path, "wb");
+    catcrypt_rsa_key_t* keypool_keys[2] = {keypair->privkey, keypair->pubkey};
+    for (int i = 0; i < 2; i++) {
+        catcrypt_string_t* keypool_bin = catcrypt_rsa_key_to_bin(keypool_keys[i]); CATCRYPT_REF_COUNTED_USE(keypool_bin);
+        size_t keypool_bin_length = keypool_bin->length;
+        fwrite(&keypool_bin_length, sizeof(keypool_bin_length), 1, keypool_file);
+        fwrite(keypool_bin->value, keypool_bin_length, 1, keypool_file);
+        CATCRYPT_REF_COUNTED_LEAVE(keypool_bin);
+    }
+    size_t keypool_bad_length = ~(size_t) 0;
+    fwrite(&keypool_bad_length, sizeof(keypool_bad_length), 1, keypool_file);
+    fwrite("cut", 3, 1, keypool_file);
+    fclose(keypool_file);
+    catcrypt_keypool_t* loaded_keypool = catcrypt_keypool_new(2, 1, keypool_path); CATCRYPT_REF_COUNTED_USE(loaded_keypool);
+    catcrypt_keypool_get_stats(loaded_keypool, &keypool_stats);
+    printf("Key Pool Corrupt File: loaded %lu\n", keypool_stats.loaded);
+    CATCRYPT_REF_COUNTED_LEAVE(loaded_keypool);
+    unlink(keypool_path);
+
+    // One worker busy with the key pair, the jobs after it are still pending when one of them is cancelled
+    catcrypt_async_t* async = catcrypt_async_new(1); CATCRYPT_REF_COUNTED_USE(async);
+    atomic_bool is_async_generated = false;
+    catcrypt_async_job_t* async_jobs[6] = {
+        catcrypt_async_keygen(async, 2048, CATCRYPT_RSA_PUB_EXPONENT, 0, async_keygen_callback, &is_async_generated),
+        catcrypt_async_encrypt(async, data_to_encrypt_str, keypair->pubkey, NULL, NULL),
+        catcrypt_async_decrypt(async, encrypted, privkey_from_hex, NULL, NULL),
+        catcrypt_async_sign(async, data_to_encrypt_str, keypair->privkey, NULL, NULL),
+        catcrypt_async_sign(async, data_to_encrypt_str, keypair->privkey, NULL, NULL),
+        catcrypt_async_verify(async, data_to_encrypt_str, signature, keypair->pubkey, NULL, NULL)
+    };
+    catcrypt_async_job_t* cancelled_job = async_jobs[3];
+    bool is_async_cancelled = catcrypt_async_cancel(async, cancelled_job) && !catcrypt_async_cancel(async, cancelled_job);
+    bool is_async_matched[5] = {false, false, false, false, false};
+    int async_completed = 0;
+    struct pollfd async_pollfd = {async->fd, POLLIN, 0};
+    while ((async_completed < 5) && (poll(&async_pollfd, 1, -1) == 1)) {
+        catcrypt_async_job_t* job;
+        while ((job = catcrypt_async_poll(async))) {
+            async_completed++;
+            if (job->state == CATCRYPT_ASYNC_STATE_CANCELLED) {
+                is_async_matched[0] = job == cancelled_job;
+            } else if (job->op == CATCRYPT_ASYNC_OP_ENCRYPT) {
+                is_async_matched[1] = catcrypt_string_compare(job->encrypted_output->data, encrypted->data);
+            } else if (job->op == CATCRYPT_ASYNC_OP_DECRYPT) {
+                is_async_matched[2] = catcrypt_string_compare(job->output, data_to_encrypt_str);
+            } else if (job->op == CATCRYPT_ASYNC_OP_SIGN) {
+                is_async_matched[3] = catcrypt_string_compare(job->output, signature);
+            } else if (job->op == CATCRYPT_ASYNC_OP_VERIFY) {
+                is_async_matched[4] = job->is_verified;
+            }
+            CATCRYPT_REF_COUNTED_LEAVE(job);
+        }
+    }
+    catcrypt_async_stats_t async_stats;
+    catcrypt_async_get_stats(async, &async_stats);
+    printf("Async: Encrypted Matches: %d, Decrypted Matches: %d, Signature Matches: %d, Verified: %d, Generated: %d, Cancelled: %d, submitted %lu, done %lu, cancelled %lu\n",
+           is_async_matched[1], is_async_matched[2], is_async_matched[3], is_async_matched[4], (bool) is_async_generated,
+           is_async_cancelled && is_async_matched[0], async_stats.submitted, async_stats.done, async_stats.cancelled);
+    for (int i = 0; i < 6; i++) {
+        CATCRYPT_REF_COUNTED_LEAVE(async_jobs[i]);
+    }
+    CATCRYPT_REF_COUNTED_LEAVE(async);
+
     CATCRYPT_REF_COUNTED_LEAVE(data_to_encrypt_str);
     CATCRYPT_REF_COUNTED_LEAVE(keypair);
     CATCRYPT_REF_COUNTED_LEAVE(pubkey_hex);
@@ -0,0 +1,30 @@
+/*
+ * Catcrypt, simple RSA/PKE for C
+ * Copyright (C) 2023, Oğuzhan Eroğlu <meowingcate@gmail.com> (https://meowingcat.io)
+ * Licensed under GPLv3 License
+ * See LICENSE for more info
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "chacha20.h"
+
+#define CATCRYPT_AEAD_KEY_SIZE CATCRYPT_CHACHA20_KEY_SIZE
+#define CATCRYPT_AEAD_NONCE_SIZE CATCRYPT_CHACHA20_NONCE_SIZE
+#define CATCRYPT_AEAD_TAG_SIZE 16
+
+/**
+ * ChaCha20-Poly1305 (RFC 8439). A key must never be used with the same nonce twice.
+ * out can be in, length bytes of it are written.
+ */
+void catcrypt_aead_encrypt(unsigned char* out, unsigned char* tag, const unsigned char* in, size_t length,
+                           const unsigned char* aad, size_t aad_length, const unsigned char* key, const unsigned char* nonce);
+
+/**
+ * Checks the tag before anything is decrypted, false (and out untouched) if in or aad were changed.
+ */
+bool catcrypt_aead_decrypt(unsigned char* out, const unsigned char* tag, const unsigned char* in, size_t length,
+                           const unsigned char* aad, size_t aad_length, const unsigned char* key, const unsigned char* nonce);
@@ -0,0 +1,154 @@
+/*
+ * Catcrypt, simple RSA/PKE for C
+ * Copyright (C) 2023, Oğuzhan Eroğlu <meowingcate@gmail.com> (https://meowingcat.io)
+ * Licensed under GPLv3 License
+ * See LICENSE for more info
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "ref.h"
+#include "string.h"
+#include "rsa.h"
+
+typedef struct catcrypt_async catcrypt_async_t;
+typedef struct catcrypt_async_job catcrypt_async_job_t;
+typedef struct catcrypt_async_stats catcrypt_async_stats_t;
+
+typedef enum catcrypt_async_op {
+    CATCRYPT_ASYNC_OP_ENCRYPT = 0,
+    CATCRYPT_ASYNC_OP_DECRYPT,
+    CATCRYPT_ASYNC_OP_SIGN,
+    CATCRYPT_ASYNC_OP_VERIFY,
+    CATCRYPT_ASYNC_OP_KEYGEN
+} catcrypt_async_op_t;
+
+/**
+ * PENDING: in the queue, it can still be cancelled
+ * RUNNING: a worker is on it, it can't be stopped anymore
+ * DONE: its results are set (is_failed if the operation returned NULL)
+ * CANCELLED: it was cancelled (or its pool was freed) before it started
+ */
+typedef enum catcrypt_async_state {
+    CATCRYPT_ASYNC_STATE_PENDING = 0,
+    CATCRYPT_ASYNC_STATE_RUNNING,
+    CATCRYPT_ASYNC_STATE_DONE,
+    CATCRYPT_ASYNC_STATE_CANCELLED
+} catcrypt_async_state_t;
+
+/**
+ * Called on the worker thread that completed the job (on the cancelling thread for a cancelled job).
+ * The job is left after it returns, it must be used to be kept.
+ */
+typedef void (*catcrypt_async_callback_f_t)(catcrypt_async_job_t* job, void* context);
+
+/**
+ * One operation and its results. Only the inputs of its op are set, the job holds a reference to each of them.
+ * The results are the job's too, use them to keep them after the job: output is the decrypted data or the signature,
+ * encrypted_output the encrypted data, keypair the generated key pair.
+ * Times are catcrypt_util_get_time_usec().
+ */
+struct catcrypt_async_job {
+    REF_COUNTEDIFY();
+    catcrypt_async_job_t* next;
+    catcrypt_async_op_t op;
+    catcrypt_async_state_t state;
+    catcrypt_async_callback_f_t callback;
+    void* context;
+    catcrypt_rsa_key_t* key;
+    catcrypt_string_t* data;
+    catcrypt_string_t* signature;
+    catcrypt_rsa_encrypted_t* encrypted;
+    size_t bits;
+    unsigned long e;
+    unsigned int flags;
+    catcrypt_string_t* output;
+    catcrypt_rsa_encrypted_t* encrypted_output;
+    catcrypt_rsa_keypair_t* keypair;
+    bool is_verified;
+    bool is_failed;
+    uint64_t submitted_at;
+    uint64_t started_at;
+    uint64_t completed_at;
+};
+
+/**
+ * Worker threads for RSA operations that would block an event loop.
+ * Jobs are taken in submission order. A job with a callback is given to its callback, the others go into
+ * the completed queue and fd (an eventfd) becomes readable, catcrypt_async_poll() takes them back.
+ * fd stays readable until the completed queue is empty, it works with level-triggered epoll.
+ */
+struct catcrypt_async {
+    REF_COUNTEDIFY();
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    pthread_t* threads;
+    int threads_count;
+    bool is_running;
+    int fd;
+    catcrypt_async_job_t* head;
+    catcrypt_async_job_t* tail;
+    catcrypt_async_job_t* completed_head;
+    catcrypt_async_job_t* completed_tail;
+    int pending;
+    int running;
+    int completed;
+    int max_pending;
+    uint64_t submitted;
+    uint64_t done;
+    uint64_t cancelled;
+    uint64_t failed;
+    uint64_t queue_usec;
+    uint64_t queue_usec_max;
+    uint64_t run_usec;
+    uint64_t run_usec_max;
+};
+
+/**
+ * pending: jobs in the queue (queue depth), max_pending: the deepest it was
+ * completed: jobs in the completed queue that weren't polled yet
+ * queue_usec: time from submission to a worker, run_usec: time on the worker, of jobs that ran
+ */
+struct catcrypt_async_stats {
+    int pending;
+    int running;
+    int completed;
+    int max_pending;
+    uint64_t submitted;
+    uint64_t done;
+    uint64_t cancelled;
+    uint64_t failed;
+    double queue_usec_avg;
+    uint64_t queue_usec_max;
+    double run_usec_avg;
+    uint64_t run_usec_max;
+};
+
+/**
+ * threads is the count of worker threads, 0 is one per online core.
+ */
+catcrypt_async_t* catcrypt_async_new(int threads);
+void catcrypt_async_free(catcrypt_async_t* async);
+void catcrypt_async_job_free(catcrypt_async_job_t* job);
+/**
+ * Submit a job, callback can be NULL for the completed queue.
+ * The returned job comes with a reference of the caller (to cancel it or to match it to its completion), leave it.
+ */
+catcrypt_async_job_t* catcrypt_async_encrypt(catcrypt_async_t* async, catcrypt_string_t* data, catcrypt_rsa_key_t* pubkey, catcrypt_async_callback_f_t callback, void* context);
+catcrypt_async_job_t* catcrypt_async_decrypt(catcrypt_async_t* async, catcrypt_rsa_encrypted_t* encrypted, catcrypt_rsa_key_t* privkey, catcrypt_async_callback_f_t callback, void* context);
+catcrypt_async_job_t* catcrypt_async_sign(catcrypt_async_t* async, catcrypt_string_t* data, catcrypt_rsa_key_t* privkey, catcrypt_async_callback_f_t callback, void* context);
+catcrypt_async_job_t* catcrypt_async_verify(catcrypt_async_t* async, catcrypt_string_t* data, catcrypt_string_t* signature, catcrypt_rsa_key_t* pubkey, catcrypt_async_callback_f_t callback, void* context);
+catcrypt_async_job_t* catcrypt_async_keygen(catcrypt_async_t* async, size_t bits, unsigned long e, unsigned int flags, catcrypt_async_callback_f_t callback, void* context);
+/**
+ * Cancels a job that didn't start yet, it is completed as CATCRYPT_ASYNC_STATE_CANCELLED. False if it started.
+ */
+bool catcrypt_async_cancel(catcrypt_async_t* async, catcrypt_async_job_t* job);
+/**
+ * Takes the next completed job without waiting (NULL if there is none), with the pool's reference: the caller leaves it too.
+ */
+catcrypt_async_job_t* catcrypt_async_poll(catcrypt_async_t* async);
+void catcrypt_async_get_stats(catcrypt_async_t* async, catcrypt_async_stats_t* stats);
@@ -0,0 +1,26 @@
+/*
+ * Catcrypt, simple RSA/PKE for C
+ * Copyright (C) 2023, Oğuzhan Eroğlu <meowingcate@gmail.com> (https://meowingcat.io)
+ * Licensed under GPLv3 License
+ * See LICENSE for more info
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CATCRYPT_CHACHA20_BLOCK_SIZE 64
+#define CATCRYPT_CHACHA20_KEY_SIZE 32
+#define CATCRYPT_CHACHA20_NONCE_SIZE 12
+
+/**
+ * One 64 byte ChaCha20 block. words are the last 4 words of the state: the random number generator puts a 64 bit counter
+ * and zeros there, RFC 8439 puts a 32 bit counter and the 96 bit nonce.
+ */
+void catcrypt_chacha20_block(const uint32_t key[8], const uint32_t words[4], unsigned char* out);
+
+/**
+ * out = in ^ keystream of (key, nonce) from block counter on, RFC 8439. out can be in.
+ */
+void catcrypt_chacha20_xor(unsigned char* out, const unsigned char* in, size_t length, const unsigned char* key, const unsigned char* nonce, uint32_t counter);
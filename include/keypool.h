@@ -0,0 +1,63 @@
+/*
+ * Catcrypt, simple RSA/PKE for C
+ * Copyright (C) 2023, Oğuzhan Eroğlu <meowingcate@gmail.com> (https://meowingcat.io)
+ * Licensed under GPLv3 License
+ * See LICENSE for more info
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "ref.h"
+#include "rsa.h"
+
+typedef struct catcrypt_keypool catcrypt_keypool_t;
+typedef struct catcrypt_keypool_stats catcrypt_keypool_stats_t;
+
+/**
+ * Pre-generated keypairs for callers that can't wait for a prime search.
+ * A background thread keeps the pool filled up to watermark keypairs,
+ * catcrypt_keypool_acquire() only pops one and never waits for a keypair to be generated.
+ * If persist_path is given, remaining keypairs are written there on free and loaded back
+ * (then the file is removed so a keypair is never handed out twice) by the next catcrypt_keypool_new().
+ */
+struct catcrypt_keypool {
+    REF_COUNTEDIFY();
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    pthread_t thread;
+    bool is_running;
+    int threads;
+    int watermark;
+    int head;
+    int length;
+    catcrypt_rsa_keypair_t** keypairs;
+    char* persist_path;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t generated;
+    uint64_t loaded;
+    uint64_t generating_msec;
+    uint64_t started_at;
+};
+
+/**
+ * refill_rate: generated keypairs per second since the pool was created
+ */
+struct catcrypt_keypool_stats {
+    int available;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t generated;
+    uint64_t loaded;
+    uint64_t generating_msec;
+    double refill_rate;
+};
+
+catcrypt_keypool_t* catcrypt_keypool_new(int watermark, int threads, char* persist_path);
+void catcrypt_keypool_free(catcrypt_keypool_t* pool);
+catcrypt_rsa_keypair_t* catcrypt_keypool_acquire(catcrypt_keypool_t* pool);
+void catcrypt_keypool_get_stats(catcrypt_keypool_t* pool, catcrypt_keypool_stats_t* stats);
\ No newline at end of file
@@ -0,0 +1,92 @@
+/*
+ * Catcrypt, simple RSA/PKE for C
+ * Copyright (C) 2023, Oğuzhan Eroğlu <meowingcate@gmail.com> (https://meowingcat.io)
+ * Licensed under GPLv3 License
+ * See LICENSE for more info
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <gmp.h>
+
+/**
+ * Montgomery arithmetic modulo an odd n, on limbs.
+ * The context only has values that depend on n (n' = -n^-1 mod B, R mod n, R^2 mod n),
+ * it is not changed after catcrypt_mont_init() so many exponentiations (and threads) can share it.
+ * Scratch space always comes from the caller.
+ *
+ * Every number is `size` limbs and < n. "Montgomery form" of x is x * R mod n, R = B^size.
+ */
+typedef struct catcrypt_mont {
+    mp_size_t size;
+    mp_limb_t* n;
+    mp_limb_t ninv;
+    mp_limb_t* one;
+    mp_limb_t* rr;
+} catcrypt_mont_t;
+
+/**
+ * An exponent recoded once into sliding windows, for exponents that are used many times.
+ * Every step is `squarings` squarings then a multiplication by the odd power `digit` (none if 0).
+ */
+typedef struct catcrypt_mont_exponent_step {
+    uint32_t squarings;
+    uint32_t digit;
+} catcrypt_mont_exponent_step_t;
+
+typedef struct catcrypt_mont_exponent {
+    int window_bits;
+    size_t length;
+    catcrypt_mont_exponent_step_t* steps;
+} catcrypt_mont_exponent_t;
+
+void catcrypt_mont_init(catcrypt_mont_t* mont, mpz_t n);
+void catcrypt_mont_clear(catcrypt_mont_t* mont);
+
+void catcrypt_mont_limbs_from_mpz(mp_limb_t* rp, mp_size_t size, mpz_t num);
+void catcrypt_mont_limbs_to_mpz(mpz_t rop, mp_limb_t* ap, mp_size_t size);
+
+/**
+ * tp: 2 * size limbs
+ */
+void catcrypt_mont_mul(catcrypt_mont_t* mont, mp_limb_t* rp, mp_limb_t* ap, mp_limb_t* bp, mp_limb_t* tp);
+void catcrypt_mont_sqr(catcrypt_mont_t* mont, mp_limb_t* rp, mp_limb_t* ap, mp_limb_t* tp);
+void catcrypt_mont_to(catcrypt_mont_t* mont, mp_limb_t* rp, mp_limb_t* ap, mp_limb_t* tp);
+void catcrypt_mont_from(catcrypt_mont_t* mont, mp_limb_t* rp, mp_limb_t* ap, mp_limb_t* tp);
+
+/**
+ * Scratch limbs that catcrypt_mont_powm() needs for an exponent of exponent_bits bits.
+ */
+mp_size_t catcrypt_mont_powm_itch(catcrypt_mont_t* mont, mp_bitcnt_t exponent_bits);
+
+/**
+ * rp = bp ^ {ep, en} in Montgomery form, bp is in normal form.
+ */
+void catcrypt_mont_powm(catcrypt_mont_t* mont, mp_limb_t* rp, mp_limb_t* bp, const mp_limb_t* ep, mp_size_t en, mp_limb_t* tp);
+
+void catcrypt_mont_exponent_init(catcrypt_mont_exponent_t* exponent, mpz_t e);
+void catcrypt_mont_exponent_clear(catcrypt_mont_exponent_t* exponent);
+
+/**
+ * Scratch limbs that catcrypt_mont_powm_exponent() needs.
+ */
+mp_size_t catcrypt_mont_powm_exponent_itch(catcrypt_mont_t* mont, catcrypt_mont_exponent_t* exponent);
+
+/**
+ * rp = bp ^ exponent in Montgomery form, bp is in normal form.
+ */
+void catcrypt_mont_powm_exponent(catcrypt_mont_t* mont, mp_limb_t* rp, mp_limb_t* bp, catcrypt_mont_exponent_t* exponent, mp_limb_t* tp);
+
+/**
+ * rp = bp ^ e in normal form, bp is in normal form. For small public exponents (65537 is 16 squarings and a multiplication),
+ * there is no window table and the last multiplication by the normal form base leaves the Montgomery form. tp: 3 * size limbs
+ */
+void catcrypt_mont_powm_ui(catcrypt_mont_t* mont, mp_limb_t* rp, mp_limb_t* bp, unsigned long e, mp_limb_t* tp);
+
+/**
+ * rp = 2 ^ {ep, en} in Montgomery form.
+ * Multiplying by 2 is a shift, so this is only squarings. tp: 2 * size limbs
+ */
+void catcrypt_mont_powm_2(catcrypt_mont_t* mont, mp_limb_t* rp, const mp_limb_t* ep, mp_size_t en, mp_limb_t* tp);
\ No newline at end of file
@@ -0,0 +1,51 @@
+/*
+ * Catcrypt, simple RSA/PKE for C
+ * Copyright (C) 2023, Oğuzhan Eroğlu <meowingcate@gmail.com> (https://meowingcat.io)
+ * Licensed under GPLv3 License
+ * See LICENSE for more info
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <gmp.h>
+
+#define CATCRYPT_PRIME_SIEVE_PRIMES 2048
+#define CATCRYPT_PRIME_SIEVE_WINDOW 2048
+#define CATCRYPT_PRIME_PARANOID_REPS 50
+
+/**
+ * BPSW: trial division, a base-2 strong probable prime test and a strong Lucas test,
+ *       then only as many random-base Miller-Rabin rounds as the FIPS 186 tables ask for the size.
+ *       All Miller-Rabin rounds of a candidate share one Montgomery context.
+ * PARANOID: mpz_probab_prime_p() with CATCRYPT_PRIME_PARANOID_REPS rounds, the old behavior.
+ */
+typedef enum catcrypt_prime_mode {
+    CATCRYPT_PRIME_MODE_BPSW = 0,
+    CATCRYPT_PRIME_MODE_PARANOID
+} catcrypt_prime_mode_t;
+
+/**
+ * tested: candidates that survived the sieve and went through the probable prime test
+ * sieved: candidates that were thrown away by the sieve without any big number work
+ */
+typedef struct catcrypt_prime_stats {
+    uint64_t tested;
+    uint64_t sieved;
+} catcrypt_prime_stats_t;
+
+void catcrypt_prime_stats_init(catcrypt_prime_stats_t* stats);
+
+int catcrypt_prime_mr_rounds(size_t bits);
+bool catcrypt_prime_test(mpz_t num, catcrypt_prime_mode_t mode);
+
+/**
+ * Sets num to the first probable prime >= num.
+ * Candidates are sieved in windows of CATCRYPT_PRIME_SIEVE_WINDOW odd numbers against
+ * the first CATCRYPT_PRIME_SIEVE_PRIMES odd primes; residues are carried from window to window,
+ * so only the survivors cost a big number operation. stats can be NULL.
+ * The search gives up and returns false once *cancel (can be NULL) becomes true.
+ */
+bool catcrypt_prime_search(mpz_t num, catcrypt_prime_mode_t mode, catcrypt_prime_stats_t* stats, atomic_bool* cancel);
\ No newline at end of file
@@ -8,6 +8,7 @@
 #pragma once
 
 #include <stdio.h>
+#include <stdatomic.h>
 
 #include "util.h"
 
@@ -54,8 +55,11 @@ typedef void (*catcrypt_ref_free_f_t)(void*);
 typedef struct catcrypt_ref_counted catcrypt_ref_counted_t;
 typedef struct catcrypt_ref catcrypt_ref_t;
 
+/**
+ * count is atomic, an object can be used and left on other threads than the one that made it.
+ */
 struct catcrypt_ref_counted {
-    int count;
+    atomic_int count;
     catcrypt_ref_free_f_t free_f;
 };
 
@@ -0,0 +1,32 @@
+/*
+ * Catcrypt, simple RSA/PKE for C
+ * Copyright (C) 2023, Oğuzhan Eroğlu <meowingcate@gmail.com> (https://meowingcat.io)
+ * Licensed under GPLv3 License
+ * See LICENSE for more info
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#define CATCRYPT_RNG_BUFFER_BLOCKS 8
+#define CATCRYPT_RNG_RESEED_BYTES (1 << 20)
+
+/**
+ * ChaCha20 DRBG, one state per thread.
+ * A thread's state is seeded from getrandom() on its first use and again after every
+ * CATCRYPT_RNG_RESEED_BYTES bytes of output or a fork(), so a child never repeats its parent's output.
+ * The key is replaced with keystream after every refill (fast key erasure),
+ * output that was already handed out can't be recomputed from the state.
+ */
+
+/**
+ * Fills buffer with size random bytes, false if the kernel couldn't give us a seed.
+ */
+bool catcrypt_rng_fill(void* buffer, size_t size);
+
+/**
+ * Reseeds the calling thread's state from getrandom() before the next output.
+ */
+void catcrypt_rng_reseed();
\ No newline at end of file
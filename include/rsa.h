@@ -8,31 +8,134 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sys/uio.h>
 #include <gmp.h>
 
 #include "ref.h"
 #include "sugar.h"
 #include "string.h"
+#include "prime.h"
+#include "mont.h"
 
 #define CATCRYPT_RSA_PUB_EXPONENT 65537
 #define CATCRYPT_RSA_PRIME_BITS 2048
-#define CATCRYPT_RSA_PRIME_REPS 50
+#define CATCRYPT_RSA_KEY_BITS (CATCRYPT_RSA_PRIME_BITS * 2)
+#define CATCRYPT_RSA_MIN_KEY_BITS 1024
+#define CATCRYPT_RSA_PRIME_REPS CATCRYPT_PRIME_PARANOID_REPS
+#define CATCRYPT_RSA_PRIME_MODE CATCRYPT_PRIME_MODE_BPSW
 #define CATCRYPT_RSA_BLOCK_SIZE 128
+#define CATCRYPT_RSA_PREPARED_EXPONENT_BITS 64
+
+#define CATCRYPT_RSA_MAX_PRIMES 4
+
+#define CATCRYPT_RSA_FLAG_PARANOID (1 << 0)
+#define CATCRYPT_RSA_FLAG_3_PRIMES (1 << 1)
+#define CATCRYPT_RSA_FLAG_4_PRIMES (1 << 2)
+#define CATCRYPT_RSA_FLAG_CONSTANT_TIME (1 << 3)
+#define CATCRYPT_RSA_FLAG_BLINDING (1 << 4)
+
+#define CATCRYPT_RSA_BLINDING_PAIRS 16
+
+#define CATCRYPT_RSA_BATCH_MAX 16
+
+#define CATCRYPT_RSA_PARALLEL_MIN_BLOCKS 32
+
+#define CATCRYPT_RSA_SCREEN_BITS 64
+#define CATCRYPT_RSA_SCREEN_MIN 4
+
+#define CATCRYPT_RSA_BITMAP_SIZE(count) (((count) + 7) / 8)
+#define CATCRYPT_RSA_BITMAP_GET(bitmap, i) (((bitmap)[(i) / 8] >> ((i) % 8)) & 1)
+#define CATCRYPT_RSA_BITMAP_SET(bitmap, i) ((bitmap)[(i) / 8] |= (uint8_t) (1 << ((i) % 8)))
+
+#define CATCRYPT_RSA_FORMAT_V1 1
+#define CATCRYPT_RSA_FORMAT_V2 2
+#define CATCRYPT_RSA_FORMAT_MAGIC "CATC"
+#define CATCRYPT_RSA_HEADER_SIZE 36
+#define CATCRYPT_RSA_HEADER_FLAG_FULL_BLOCKS (1 << 0)
+
+#define CATCRYPT_RSA_STREAM_BLOCKS 16
 
 #define CATCRYPT_MPZ_ENDIAN 1
 #define CATCRYPT_MPZ_ORDER 1
 
-typedef uint8_t catcrypt_rsa_random_seed_adds_t;
-#define CATCRYPT_RSA_RANDOM_SEED_ADDS_MASK 20 // 1 to 2 ^ ((sizeof(catcrypt_rsa_random_seed_adds_t) * 8) - 1)
-
 typedef struct catcrypt_rsa_keypair catcrypt_rsa_keypair_t;
 typedef struct catcrypt_rsa_key catcrypt_rsa_key_t;
 typedef struct catcrypt_rsa_encrypted catcrypt_rsa_encrypted_t;
+typedef struct catcrypt_rsa_crt_prime catcrypt_rsa_crt_prime_t;
+typedef struct catcrypt_rsa_prepared catcrypt_rsa_prepared_t;
+typedef struct catcrypt_rsa_blinding catcrypt_rsa_blinding_t;
+typedef struct catcrypt_rsa_header catcrypt_rsa_header_t;
+typedef struct catcrypt_rsa_stream catcrypt_rsa_stream_t;
+typedef struct catcrypt_rsa_hash catcrypt_rsa_hash_t;
+
+/**
+ * Takes length bytes of output of a stream, false stops the stream.
+ */
+typedef bool (*catcrypt_rsa_sink_f_t)(void* context, char* data, size_t length);
+
+/**
+ * A prime after p and q in a multi-prime key:
+ * d = private exponent mod (r - 1), t = (p * q * ... previous primes)^-1 mod r
+ */
+struct catcrypt_rsa_crt_prime {
+    mpz_t r;
+    mpz_t d;
+    mpz_t t;
+};
+
+/**
+ * What catcrypt_rsa_key_prepare() computes once for a key: the Montgomery context of n
+ * (limbs of n, n', R mod n, R^2 mod n) and the exponent recoded into sliding windows.
+ * small_e is the exponent if it fits in an unsigned long (0 if not), those go through catcrypt_mont_powm_ui().
+ * It is never changed after it is attached to the key, threads use it at the same time.
+ */
+struct catcrypt_rsa_prepared {
+    catcrypt_mont_t mont;
+    catcrypt_mont_exponent_t exponent;
+    unsigned long small_e;
+};
+
+/**
+ * Blinding pairs (r^e, r^-1 mod n) of a private key. A private operation takes one pair and gives it back
+ * squared ((r^2)^e, r^-2), so a pair costs two squarings instead of a random r, an exponentiation and an inversion.
+ * When it is empty, CATCRYPT_RSA_BLINDING_PAIRS new pairs are made with one inversion (Montgomery's batch inversion).
+ * e is the public exponent, recovered from the private exponent and the primes.
+ */
+struct catcrypt_rsa_blinding {
+    pthread_mutex_t mutex;
+    mpz_t e;
+    int length;
+    mpz_t forward[CATCRYPT_RSA_BLINDING_PAIRS];
+    mpz_t inverse[CATCRYPT_RSA_BLINDING_PAIRS];
+};
 
+/**
+ * Private keys made by catcrypt_rsa_keypair_new() also keep their CRT components
+ * (p, q, dp = d mod (p - 1), dq = d mod (q - 1), qinv = q^-1 mod p) and have is_crt set,
+ * so private operations do two half-size exponentiations instead of a full-size one.
+ * Multi-prime keys (primes is 3 or 4) have the rest of their primes in extra_primes.
+ * public_e is the public exponent of a private key, found from d and the primes when a batch needs it
+ * (0 if it isn't known yet, 1 if it doesn't fit in an unsigned long).
+ */
 struct catcrypt_rsa_key {
     REF_COUNTEDIFY();
     mpz_t e;
     mpz_t n;
+    size_t bits;
+    unsigned int flags;
+    bool is_crt;
+    mpz_t p;
+    mpz_t q;
+    mpz_t dp;
+    mpz_t dq;
+    mpz_t qinv;
+    int primes;
+    catcrypt_rsa_crt_prime_t extra_primes[CATCRYPT_RSA_MAX_PRIMES - 2];
+    _Atomic(catcrypt_rsa_prepared_t*) prepared;
+    _Atomic(catcrypt_rsa_blinding_t*) blinding;
+    _Atomic(unsigned long) public_e;
 };
 
 struct catcrypt_rsa_keypair {
@@ -47,31 +150,245 @@ struct catcrypt_rsa_encrypted {
     catcrypt_rsa_key_t* key;
 };
 
+/**
+ * Header of v2 encrypted data, CATCRYPT_RSA_HEADER_SIZE bytes, every field big-endian:
+ * magic (CATCRYPT_RSA_FORMAT_MAGIC), version, flags, block_size (u16), key_size (u32), fingerprint (u64), blocks (u64), length (u64).
+ * blocks key_size byte blocks follow it, block i is at CATCRYPT_RSA_HEADER_SIZE + i * key_size
+ * and decrypts to block_size bytes (the last one to what is left of length).
+ * With CATCRYPT_RSA_HEADER_FLAG_FULL_BLOCKS in flags block_size is key_size - 1, the most bytes that always stay below n,
+ * without it block_size is at most CATCRYPT_RSA_BLOCK_SIZE (data from before full blocks).
+ * v1 data (a native size_t length before every block) has no header.
+ */
+struct catcrypt_rsa_header {
+    uint8_t version;
+    uint8_t flags;
+    uint16_t block_size;
+    uint32_t key_size;
+    uint64_t fingerprint;
+    uint64_t blocks;
+    uint64_t length;
+};
+
+/**
+ * State of catcrypt_rsa_hash_h32_update(), head is the first bytes that data of less than 4 bytes is filled from.
+ * The hash ends at the first zero byte (is_ended), as it always did.
+ */
+struct catcrypt_rsa_hash {
+    uint32_t hash;
+    int length;
+    int prev;
+    char head[3];
+    bool is_ended;
+};
+
+/**
+ * Encryption or decryption of v2 data in chunks of any size. Every block that is complete goes to sink,
+ * a block that isn't is kept in buffer until the next chunk. Only one block of input and CATCRYPT_RSA_STREAM_BLOCKS blocks
+ * of output are kept, memory doesn't grow with the data. taken is the count of input bytes after the header.
+ */
+struct catcrypt_rsa_stream {
+    REF_COUNTEDIFY();
+    catcrypt_rsa_key_t* key;
+    catcrypt_rsa_sink_f_t sink;
+    void* context;
+    catcrypt_rsa_header_t header;
+    bool is_header_read;
+    bool is_failed;
+    size_t input_stride;
+    uint64_t input_length;
+    size_t output_stride;
+    uint64_t output_length;
+    uint64_t blocks;
+    uint64_t taken;
+    char* buffer;
+    size_t buffer_length;
+    char* output;
+};
+
 uint32_t catcrypt_rsa_hash_h32(char* str);
 uint32_t catcrypt_rsa_hash_h32__n(char* data, ssize_t length);
+/**
+ * The same hash over data that comes in pieces, pieces can split the data anywhere.
+ */
+void catcrypt_rsa_hash_h32_init(catcrypt_rsa_hash_t* state);
+void catcrypt_rsa_hash_h32_update(catcrypt_rsa_hash_t* state, char* data, size_t length);
+uint32_t catcrypt_rsa_hash_h32_final(catcrypt_rsa_hash_t* state);
+uint32_t catcrypt_rsa_hash_h32__iov(struct iovec* iov, int count);
 
 bool catcrypt_rsa_random_seed(unsigned char* seed, size_t size);
 void catcrypt_rsa_random_prime(mpz_t num);
+void catcrypt_rsa_random_prime__stats(mpz_t num, catcrypt_prime_stats_t* stats);
+void catcrypt_rsa_random_prime__mode(mpz_t num, catcrypt_prime_mode_t mode, catcrypt_prime_stats_t* stats);
 
 catcrypt_rsa_key_t* catcrypt_rsa_key_new();
 void catcrypt_rsa_key_free(catcrypt_rsa_key_t* key);
+size_t catcrypt_rsa_key_bits(catcrypt_rsa_key_t* key);
+size_t catcrypt_rsa_key_size(catcrypt_rsa_key_t* key);
+/**
+ * Plaintext bytes of a block, key_size - 1 so a block fills the modulus.
+ */
+size_t catcrypt_rsa_key_block_size(catcrypt_rsa_key_t* key);
+/**
+ * First 64 bits of SipHash-2-4-128 (zero key) of n's key_size big-endian bytes, a public key and its private key have the same fingerprint.
+ */
+uint64_t catcrypt_rsa_key_fingerprint(catcrypt_rsa_key_t* key);
+bool catcrypt_rsa_key_prepare(catcrypt_rsa_key_t* key);
+void catcrypt_rsa_key_powm(mpz_t rop, mpz_t base, catcrypt_rsa_key_t* key);
+
+/**
+ * Private operations of many bases at once (Fiat's batch RSA). Bases whose keys share n and have
+ * pairwise coprime public exponents (see catcrypt_rsa_keypair_new_family()) go up to CATCRYPT_RSA_BATCH_MAX at a time
+ * through a product tree with one full-size exponentiation, the others are done one by one.
+ */
+void catcrypt_rsa_key_powm__batch(mpz_t* rops, mpz_t* bases, catcrypt_rsa_key_t** keys, int count);
 catcrypt_rsa_keypair_t* catcrypt_rsa_keypair_new();
+catcrypt_rsa_keypair_t* catcrypt_rsa_keypair_new__threads(int threads);
+catcrypt_rsa_keypair_t* catcrypt_rsa_keypair_new__primes(int primes);
+catcrypt_rsa_keypair_t* catcrypt_rsa_keypair_new_ex(size_t bits, unsigned long e, unsigned int flags);
+catcrypt_rsa_keypair_t* catcrypt_rsa_keypair_new_ex__threads(size_t bits, unsigned long e, unsigned int flags, int threads);
+/**
+ * count keypairs with the same n and distinct prime public exponents (65537 and the primes after it),
+ * the keys that catcrypt_rsa_key_powm__batch() and catcrypt_rsa_decrypt__batch() can batch.
+ */
+bool catcrypt_rsa_keypair_new_family(catcrypt_rsa_keypair_t** keypairs, int count, size_t bits, unsigned int flags);
+bool catcrypt_rsa_keypair_new_family__threads(catcrypt_rsa_keypair_t** keypairs, int count, size_t bits, unsigned int flags, int threads);
+catcrypt_rsa_keypair_t* catcrypt_rsa_keypair_new_from_keys(catcrypt_rsa_key_t* pubkey, catcrypt_rsa_key_t* privkey);
 void catcrypt_rsa_keypair_free(catcrypt_rsa_keypair_t* keypair);
 
 catcrypt_rsa_encrypted_t* catcrypt_rsa_encrypted_new();
 void catcrypt_rsa_encrypted_set_key(catcrypt_rsa_encrypted_t* encrypted, catcrypt_rsa_key_t* key);
 void catcrypt_rsa_encrypted_set_data(catcrypt_rsa_encrypted_t* encrypted, catcrypt_string_t* data);
 void catcrypt_rsa_encrypted_free(catcrypt_rsa_encrypted_t* encrypted);
+/**
+ * Size of the v2 encrypted data of length bytes, known before anything is encrypted.
+ */
+size_t catcrypt_rsa_encrypted_size(catcrypt_rsa_key_t* key, size_t length);
+/**
+ * Reads the header of v2 data, false if data isn't v2 or the header doesn't match the size of data.
+ */
+bool catcrypt_rsa_header_read(catcrypt_string_t* data, catcrypt_rsa_header_t* header);
+/**
+ * Returns NULL if the encrypted data would be longer than CATCRYPT_STRING_MAX_LENGTH.
+ */
 catcrypt_rsa_encrypted_t* catcrypt_rsa_encrypt(catcrypt_string_t* data, catcrypt_rsa_key_t* pubkey);
+/**
+ * Reads v2 and v1 data. Returns NULL if v2 data was encrypted for another key or is malformed,
+ * or if the decrypted data would be longer than CATCRYPT_STRING_MAX_LENGTH.
+ */
 catcrypt_string_t* catcrypt_rsa_decrypt(catcrypt_rsa_encrypted_t* encrypted, catcrypt_rsa_key_t* privkey);
+/**
+ * Decrypts only block index of v2 data, NULL for v1 data or an index after the last block.
+ */
+catcrypt_string_t* catcrypt_rsa_decrypt_block(catcrypt_rsa_encrypted_t* encrypted, catcrypt_rsa_key_t* privkey, size_t index);
+
+/**
+ * Encryption into output of the caller (size bytes, at least catcrypt_rsa_encrypt_itch()), nothing is allocated.
+ * Same output as catcrypt_rsa_encrypt(), false if size is too small.
+ */
+size_t catcrypt_rsa_encrypt_itch(catcrypt_rsa_key_t* pubkey, size_t length);
+bool catcrypt_rsa_encrypt__into(char* output, size_t size, char* data, size_t length, catcrypt_rsa_key_t* pubkey);
+/**
+ * Decryption of v2 data into output of the caller, catcrypt_rsa_decrypt_itch() is the length in its header (0 if it isn't v2).
+ * output can be encrypted itself (in place). False where catcrypt_rsa_decrypt() returns NULL, for v1 data or if size is too small.
+ */
+size_t catcrypt_rsa_decrypt_itch(char* encrypted, size_t length);
+bool catcrypt_rsa_decrypt__into(char* output, size_t size, char* encrypted, size_t length, catcrypt_rsa_key_t* privkey);
+/**
+ * Encrypts the fragments of input (as if they were one buffer) into the fragments of output, at least catcrypt_rsa_encrypt_itch()
+ * bytes of them. Blocks are split across fragment boundaries on both sides, nothing is coalesced.
+ * Returns how many output fragments hold the encrypted data, their iov_len is cut to what was written (ready for writev()),
+ * -1 if output is too small.
+ */
+int catcrypt_rsa_encrypt__iov(struct iovec* output, int output_count, struct iovec* input, int input_count, catcrypt_rsa_key_t* pubkey);
+/**
+ * Blocks are spread over threads threads (the calling thread is one of them), every block writes into its own
+ * output slot. Payloads of less than CATCRYPT_RSA_PARALLEL_MIN_BLOCKS blocks stay on the calling thread.
+ */
+catcrypt_rsa_encrypted_t* catcrypt_rsa_encrypt__threads(catcrypt_string_t* data, catcrypt_rsa_key_t* pubkey, int threads);
+catcrypt_string_t* catcrypt_rsa_decrypt__threads(catcrypt_rsa_encrypted_t* encrypted, catcrypt_rsa_key_t* privkey, int threads);
+void catcrypt_rsa_decrypt__batch(catcrypt_string_t** decrypted, catcrypt_rsa_encrypted_t** encrypted, catcrypt_rsa_key_t** privkeys, int count);
+
+/**
+ * length is the count of bytes that will be given to catcrypt_rsa_stream_update(), the header carries it and is given to sink here.
+ * The output is the same as catcrypt_rsa_encrypt() of the whole data.
+ */
+catcrypt_rsa_stream_t* catcrypt_rsa_encrypt_init(catcrypt_rsa_key_t* pubkey, size_t length, catcrypt_rsa_sink_f_t sink, void* context);
+/**
+ * Reads v2 data only, the header has to come first.
+ */
+catcrypt_rsa_stream_t* catcrypt_rsa_decrypt_init(catcrypt_rsa_key_t* privkey, catcrypt_rsa_sink_f_t sink, void* context);
+/**
+ * False if the stream has failed: a block couldn't be done, the sink stopped it, the header isn't for the key or data goes past the end.
+ */
+bool catcrypt_rsa_stream_update(catcrypt_rsa_stream_t* stream, char* data, size_t length);
+/**
+ * True if every block was done and given to the sink.
+ */
+bool catcrypt_rsa_stream_final(catcrypt_rsa_stream_t* stream);
+void catcrypt_rsa_stream_free(catcrypt_rsa_stream_t* stream);
+/**
+ * A sink that appends to the catcrypt_string_t* in context.
+ */
+bool catcrypt_rsa_sink_string(void* context, char* data, size_t length);
 
+/**
+ * The bin (and hex) has the numbers of the key but not its flags: a loaded key has none,
+ * set CATCRYPT_RSA_FLAG_CONSTANT_TIME and CATCRYPT_RSA_FLAG_BLINDING on key->flags again after loading it.
+ */
 catcrypt_string_t* catcrypt_rsa_key_to_bin(catcrypt_rsa_key_t* key);
 catcrypt_rsa_key_t* catcrypt_rsa_key_from_bin(catcrypt_string_t* hex);
+size_t catcrypt_rsa_key_to_bin_itch(catcrypt_rsa_key_t* key);
+bool catcrypt_rsa_key_to_bin__into(char* output, size_t size, catcrypt_rsa_key_t* key);
+catcrypt_rsa_key_t* catcrypt_rsa_key_from_bin__n(char* data, size_t length);
 
 catcrypt_string_t* catcrypt_rsa_key_to_hex(catcrypt_rsa_key_t* key);
+/**
+ * NULL if hex has a character that isn't a hex digit.
+ */
 catcrypt_rsa_key_t* catcrypt_rsa_key_from_hex(catcrypt_string_t* hex);
+/**
+ * Hex digits without a terminating '\0'.
+ */
+size_t catcrypt_rsa_key_to_hex_itch(catcrypt_rsa_key_t* key);
+bool catcrypt_rsa_key_to_hex__into(char* output, size_t size, catcrypt_rsa_key_t* key);
 
 catcrypt_string_t* catcrypt_rsa_sign(catcrypt_string_t* data, catcrypt_rsa_key_t* privkey);
+/**
+ * Signs length bytes of data into output of the caller (catcrypt_rsa_sign_itch() bytes), the same signature as catcrypt_rsa_sign().
+ */
+size_t catcrypt_rsa_sign_itch(catcrypt_rsa_key_t* privkey);
+bool catcrypt_rsa_sign__into(char* output, size_t size, char* data, size_t length, catcrypt_rsa_key_t* privkey);
+/**
+ * Signs the fragments of input into the fragments of output like catcrypt_rsa_encrypt__iov(), the same signature as catcrypt_rsa_sign().
+ */
+int catcrypt_rsa_sign__iov(struct iovec* output, int output_count, struct iovec* input, int input_count, catcrypt_rsa_key_t* privkey);
 bool catcrypt_rsa_verify(catcrypt_string_t* data, catcrypt_string_t* signature, catcrypt_rsa_key_t* pubkey);
+
+/**
+ * catcrypt_rsa_verify() on scratch of the caller (catcrypt_rsa_verify_itch() limbs, NULL for the calling thread's scratch),
+ * it doesn't allocate on a prepared key. Signatures longer than n or >= n are rejected before the exponentiation.
+ */
+bool catcrypt_rsa_verify__scratch(catcrypt_string_t* data, catcrypt_string_t* signature, catcrypt_rsa_key_t* pubkey, mp_limb_t* scratch);
+mp_size_t catcrypt_rsa_verify_itch(catcrypt_rsa_key_t* pubkey);
+
+/**
+ * Verifies data[i] and signatures[i] with pubkeys[i], bit i of results (CATCRYPT_RSA_BITMAP_SIZE(count) bytes) is set if it is verified.
+ * Items under the same key are screened together (Bellare-Garay-Rabin), a batch that fails is bisected to find the bad items.
+ * Returns true if every item is verified.
+ * Unlike catcrypt_rsa_verify(), the n - s twin of a good signature s passes a screening half of the time,
+ * verify signatures that have to be unique (replay or cache keys) one by one.
+ */
+bool catcrypt_rsa_verify__batch(uint8_t* results, catcrypt_string_t** data, catcrypt_string_t** signatures, catcrypt_rsa_key_t** pubkeys, int count);
 catcrypt_string_t* catcrypt_rsa_signature_to_hex(catcrypt_string_t* signature_bin);
-catcrypt_string_t* catcrypt_rsa_signature_from_hex(catcrypt_string_t* signature_hex);
\ No newline at end of file
+/**
+ * NULL if signature_hex has a character that isn't a hex digit.
+ */
+catcrypt_string_t* catcrypt_rsa_signature_from_hex(catcrypt_string_t* signature_hex);
+/**
+ * length * 2 hex digits into output, signature can be in the second half of output.
+ */
+bool catcrypt_rsa_signature_to_hex__into(char* output, size_t size, char* signature, size_t length);
+/**
+ * length / 2 bytes into output, output can be hex itself. False if size is too small or a character isn't a hex digit.
+ */
+bool catcrypt_rsa_signature_from_hex__into(char* output, size_t size, char* hex, size_t length);
\ No newline at end of file
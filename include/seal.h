@@ -0,0 +1,46 @@
+/*
+ * Catcrypt, simple RSA/PKE for C
+ * Copyright (C) 2023, Oğuzhan Eroğlu <meowingcate@gmail.com> (https://meowingcat.io)
+ * Licensed under GPLv3 License
+ * See LICENSE for more info
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ref.h"
+#include "string.h"
+#include "rsa.h"
+#include "aead.h"
+
+#define CATCRYPT_SEAL_MAGIC "CATS"
+#define CATCRYPT_SEAL_VERSION 1
+#define CATCRYPT_SEAL_HEADER_SIZE 28
+#define CATCRYPT_SEAL_INFO "catcrypt seal v1"
+
+/**
+ * Sealed data (hybrid encryption): RSA-KEM for one random number, ChaCha20-Poly1305 for the data.
+ * A random r < n is encrypted once as c = r ^ e mod n, HKDF-SHA-256 of r's key_size big-endian bytes
+ * (info CATCRYPT_SEAL_INFO) gives the AEAD key and nonce, so a payload costs one exponentiation however long it is.
+ *
+ * The layout, every field big-endian:
+ * magic (CATCRYPT_SEAL_MAGIC), version, flags, 2 reserved bytes, key_size (u32), fingerprint (u64), length (u64),
+ * c (key_size bytes), the encrypted data (length bytes), the tag (CATCRYPT_AEAD_TAG_SIZE bytes).
+ * The header and c are the additional data of the AEAD, none of them can be changed without the tag failing.
+ */
+
+/**
+ * Size of the sealed data of length bytes.
+ */
+size_t catcrypt_seal_size(catcrypt_rsa_key_t* pubkey, size_t length);
+/**
+ * Returns NULL if the sealed data would be longer than CATCRYPT_STRING_MAX_LENGTH.
+ */
+catcrypt_string_t* catcrypt_seal(catcrypt_string_t* data, catcrypt_rsa_key_t* pubkey);
+
+/**
+ * Returns NULL if sealed is malformed, was sealed for another key or was changed.
+ */
+catcrypt_string_t* catcrypt_open(catcrypt_string_t* sealed, catcrypt_rsa_key_t* privkey);
@@ -0,0 +1,34 @@
+/*
+ * Catcrypt, simple RSA/PKE for C
+ * Copyright (C) 2023, Oğuzhan Eroğlu <meowingcate@gmail.com> (https://meowingcat.io)
+ * Licensed under GPLv3 License
+ * See LICENSE for more info
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CATCRYPT_SHA256_SIZE 32
+#define CATCRYPT_SHA256_BLOCK_SIZE 64
+
+/**
+ * SHA-256 fed incrementally, HMAC and HKDF (RFC 5869) on top of it derive the keys of sealed data.
+ */
+typedef struct catcrypt_sha256 {
+    uint32_t h[8];
+    unsigned char block[CATCRYPT_SHA256_BLOCK_SIZE];
+    size_t block_length;
+    uint64_t length;
+} catcrypt_sha256_t;
+
+void catcrypt_sha256_init(catcrypt_sha256_t* state);
+void catcrypt_sha256_update(catcrypt_sha256_t* state, const void* data, size_t length);
+void catcrypt_sha256_final(catcrypt_sha256_t* state, unsigned char* out);
+void catcrypt_sha256_hmac(unsigned char* out, const void* key, size_t key_length, const void* data, size_t length);
+
+/**
+ * HKDF-SHA-256 extract and expand into length (at most 255 * CATCRYPT_SHA256_SIZE) bytes, an empty salt is HashLen zeros.
+ */
+void catcrypt_sha256_hkdf(unsigned char* out, size_t length, const void* salt, size_t salt_length, const void* ikm, size_t ikm_length, const void* info, size_t info_length);
@@ -0,0 +1,79 @@
+/*
+ * Catcrypt, simple RSA/PKE for C
+ * Copyright (C) 2023, Oğuzhan Eroğlu <meowingcate@gmail.com> (https://meowingcat.io)
+ * Licensed under GPLv3 License
+ * See LICENSE for more info
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "ref.h"
+#include "string.h"
+#include "rsa.h"
+
+#define CATCRYPT_SIGCACHE_WAYS 8
+
+typedef struct catcrypt_sigcache catcrypt_sigcache_t;
+typedef struct catcrypt_sigcache_shard catcrypt_sigcache_shard_t;
+typedef struct catcrypt_sigcache_entry catcrypt_sigcache_entry_t;
+typedef struct catcrypt_sigcache_stats catcrypt_sigcache_stats_t;
+
+/**
+ * tag is a 128 bit SipHash of (n, e, message hash, signature) under the cache's random key,
+ * a forged signature can't be made to hit another signature's entry without knowing the key.
+ */
+struct catcrypt_sigcache_entry {
+    uint64_t tag[2];
+    bool is_used;
+    bool is_referenced;
+    bool is_verified;
+};
+
+/**
+ * sets * CATCRYPT_SIGCACHE_WAYS entries, a tag can only be in one set.
+ * Every set has its own CLOCK hand: an entry that is hit gets is_referenced and survives the next sweep.
+ */
+struct catcrypt_sigcache_shard {
+    _Alignas(64) pthread_mutex_t mutex;
+    int sets;
+    catcrypt_sigcache_entry_t* entries;
+    uint8_t* hands;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t length;
+};
+
+/**
+ * Results of catcrypt_rsa_verify() by their (key, message hash, signature), so a signature that comes again
+ * costs a SipHash and a lookup instead of an exponentiation. Rejected signatures are cached too.
+ * It never grows past capacity entries (or one set of CATCRYPT_SIGCACHE_WAYS entries for a smaller capacity). Shards (one per core by default) have their own lock,
+ * threads verifying at the same time rarely wait for each other.
+ */
+struct catcrypt_sigcache {
+    REF_COUNTEDIFY();
+    uint64_t key[2];
+    int shards_count;
+    catcrypt_sigcache_shard_t* shards;
+};
+
+struct catcrypt_sigcache_stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t length;
+    uint64_t capacity;
+};
+
+/**
+ * shards is rounded up to a power of two, 0 is one shard per online core.
+ * It is lowered (by halves) for a capacity that can't give every shard a full set.
+ */
+catcrypt_sigcache_t* catcrypt_sigcache_new(size_t capacity, int shards);
+void catcrypt_sigcache_free(catcrypt_sigcache_t* cache);
+bool catcrypt_sigcache_verify(catcrypt_sigcache_t* cache, catcrypt_string_t* data, catcrypt_string_t* signature, catcrypt_rsa_key_t* pubkey);
+void catcrypt_sigcache_get_stats(catcrypt_sigcache_t* cache, catcrypt_sigcache_stats_t* stats);
\ No newline at end of file
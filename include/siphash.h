@@ -0,0 +1,25 @@
+/*
+ * Catcrypt, simple RSA/PKE for C
+ * Copyright (C) 2023, Oğuzhan Eroğlu <meowingcate@gmail.com> (https://meowingcat.io)
+ * Licensed under GPLv3 License
+ * See LICENSE for more info
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * SipHash-2-4 with 128 bit output, fed incrementally.
+ * With a secret key it is a PRF (the signature cache's tags), with a fixed key it is only a fingerprint.
+ */
+typedef struct catcrypt_siphash {
+    uint64_t v[4];
+    uint64_t tail;
+    size_t length;
+} catcrypt_siphash_t;
+
+void catcrypt_siphash_init(catcrypt_siphash_t* state, uint64_t k0, uint64_t k1);
+void catcrypt_siphash_update(catcrypt_siphash_t* state, const void* data, size_t length);
+void catcrypt_siphash_final(catcrypt_siphash_t* state, uint64_t out[2]);
\ No newline at end of file
@@ -10,9 +10,15 @@
 #include <string.h>
 #include <unistd.h>
 #include <stdbool.h>
+#include <limits.h>
 
 #include "ref.h"
 
+/**
+ * The longest string catcrypt_string_new__n() can allocate (its length is an int, with room for the '\0').
+ */
+#define CATCRYPT_STRING_MAX_LENGTH (INT_MAX - 1)
+
 /**
  * ! Free by ref counting
  */
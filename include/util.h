@@ -42,6 +42,10 @@ void catcrypt_util_verbose(const char* format, ...);
 void catcrypt_util_verbose_set(int p_is_verbose);
 int catcrypt_util_msleep(long millis);
 uint64_t catcrypt_util_get_time_msec();
+/**
+ * Monotonic, for measuring durations only.
+ */
+uint64_t catcrypt_util_get_time_usec();
 int catcrypt_util_int2str(int number, char* target);
 
 char* catcrypt_util_base64_encode(char* str);
@@ -0,0 +1,227 @@
+/*
+ * Catcrypt, simple RSA/PKE for C
+ * Copyright (C) 2023, Oğuzhan Eroğlu <meowingcate@gmail.com> (https://meowingcat.io)
+ * Licensed under GPLv3 License
+ * See LICENSE for more info
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "../include/aead.h"
+
+#include "../include/chacha20.h"
+
+#define CATCRYPT_POLY1305_MASK44 0xfffffffffffULL
+#define CATCRYPT_POLY1305_MASK42 0x3ffffffffffULL
+
+/**
+ * Poly1305 with h and r in three 44, 44 and 42 bit limbs, products of two limbs fit in 128 bits.
+ */
+typedef struct catcrypt_poly1305 {
+    uint64_t r[3];
+    uint64_t h[3];
+    uint64_t pad[2];
+    unsigned char buffer[16];
+    size_t buffer_length;
+} catcrypt_poly1305_t;
+
+typedef unsigned __int128 catcrypt_poly1305_u128_t;
+
+static uint64_t catcrypt_poly1305_load64(const unsigned char* bytes) {
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--) {
+        value = (value << 8) | bytes[i];
+    }
+
+    return value;
+}
+
+static void catcrypt_poly1305_store64(unsigned char* bytes, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        bytes[i] = value >> (8 * i);
+    }
+}
+
+static void catcrypt_poly1305_init(catcrypt_poly1305_t* state, const unsigned char* key) {
+    uint64_t t0 = catcrypt_poly1305_load64(key);
+    uint64_t t1 = catcrypt_poly1305_load64(key + 8);
+
+    // r is clamped as it is split into limbs
+    state->r[0] = t0 & 0xffc0fffffffULL;
+    state->r[1] = ((t0 >> 44) | (t1 << 20)) & 0xfffffc0ffffULL;
+    state->r[2] = (t1 >> 24) & 0x00ffffffc0fULL;
+
+    state->h[0] = state->h[1] = state->h[2] = 0;
+    state->pad[0] = catcrypt_poly1305_load64(key + 16);
+    state->pad[1] = catcrypt_poly1305_load64(key + 24);
+    state->buffer_length = 0;
+}
+
+/**
+ * h = (h + block + hibit * 2^128) * r mod 2^130 - 5 for every 16 bytes, hibit is 0 only for the padded last block.
+ */
+static void catcrypt_poly1305_blocks(catcrypt_poly1305_t* state, const unsigned char* bytes, size_t length, uint64_t hibit) {
+    uint64_t r0 = state->r[0], r1 = state->r[1], r2 = state->r[2];
+    uint64_t s1 = r1 * (5 << 2), s2 = r2 * (5 << 2);
+    uint64_t h0 = state->h[0], h1 = state->h[1], h2 = state->h[2];
+
+    for (; length >= 16; bytes += 16, length -= 16) {
+        uint64_t t0 = catcrypt_poly1305_load64(bytes);
+        uint64_t t1 = catcrypt_poly1305_load64(bytes + 8);
+
+        h0 += t0 & CATCRYPT_POLY1305_MASK44;
+        h1 += ((t0 >> 44) | (t1 << 20)) & CATCRYPT_POLY1305_MASK44;
+        h2 += ((t1 >> 24) & CATCRYPT_POLY1305_MASK42) | (hibit << 40);
+
+        catcrypt_poly1305_u128_t d0 = (catcrypt_poly1305_u128_t) h0 * r0 + (catcrypt_poly1305_u128_t) h1 * s2 + (catcrypt_poly1305_u128_t) h2 * s1;
+        catcrypt_poly1305_u128_t d1 = (catcrypt_poly1305_u128_t) h0 * r1 + (catcrypt_poly1305_u128_t) h1 * r0 + (catcrypt_poly1305_u128_t) h2 * s2;
+        catcrypt_poly1305_u128_t d2 = (catcrypt_poly1305_u128_t) h0 * r2 + (catcrypt_poly1305_u128_t) h1 * r1 + (catcrypt_poly1305_u128_t) h2 * r0;
+
+        uint64_t carry = (uint64_t) (d0 >> 44);
+        h0 = (uint64_t) d0 & CATCRYPT_POLY1305_MASK44;
+        d1 += carry;
+        carry = (uint64_t) (d1 >> 44);
+        h1 = (uint64_t) d1 & CATCRYPT_POLY1305_MASK44;
+        d2 += carry;
+        carry = (uint64_t) (d2 >> 42);
+        h2 = (uint64_t) d2 & CATCRYPT_POLY1305_MASK42;
+        h0 += carry * 5;
+        carry = h0 >> 44;
+        h0 &= CATCRYPT_POLY1305_MASK44;
+        h1 += carry;
+    }
+
+    state->h[0] = h0;
+    state->h[1] = h1;
+    state->h[2] = h2;
+}
+
+static void catcrypt_poly1305_update(catcrypt_poly1305_t* state, const unsigned char* bytes, size_t length) {
+    if (state->buffer_length > 0) {
+        size_t to_copy = sizeof(state->buffer) - state->buffer_length;
+        to_copy = (length < to_copy) ? length: to_copy;
+
+        memcpy(state->buffer + state->buffer_length, bytes, to_copy);
+        state->buffer_length += to_copy;
+        bytes += to_copy;
+        length -= to_copy;
+
+        if (state->buffer_length < sizeof(state->buffer)) {
+            return;
+        }
+
+        catcrypt_poly1305_blocks(state, state->buffer, sizeof(state->buffer), 1);
+        state->buffer_length = 0;
+    }
+
+    size_t whole = length & ~(size_t) 15;
+    catcrypt_poly1305_blocks(state, bytes, whole, 1);
+
+    memcpy(state->buffer, bytes + whole, length - whole);
+    state->buffer_length = length - whole;
+}
+
+/**
+ * Zeros up to the next 16 bytes, RFC 8439 pads the additional data and the ciphertext separately.
+ */
+static void catcrypt_poly1305_pad16(catcrypt_poly1305_t* state, size_t length) {
+    static const unsigned char zeros[16] = {0};
+    if (length % 16) {
+        catcrypt_poly1305_update(state, zeros, 16 - (length % 16));
+    }
+}
+
+static void catcrypt_poly1305_final(catcrypt_poly1305_t* state, unsigned char* tag) {
+    if (state->buffer_length > 0) {
+        state->buffer[state->buffer_length] = 1;
+        memset(state->buffer + state->buffer_length + 1, 0, sizeof(state->buffer) - state->buffer_length - 1);
+        catcrypt_poly1305_blocks(state, state->buffer, sizeof(state->buffer), 0);
+    }
+
+    uint64_t h0 = state->h[0], h1 = state->h[1], h2 = state->h[2];
+    uint64_t carry;
+
+    carry = h1 >> 44; h1 &= CATCRYPT_POLY1305_MASK44;
+    h2 += carry; carry = h2 >> 42; h2 &= CATCRYPT_POLY1305_MASK42;
+    h0 += carry * 5; carry = h0 >> 44; h0 &= CATCRYPT_POLY1305_MASK44;
+    h1 += carry; carry = h1 >> 44; h1 &= CATCRYPT_POLY1305_MASK44;
+    h2 += carry; carry = h2 >> 42; h2 &= CATCRYPT_POLY1305_MASK42;
+    h0 += carry * 5; carry = h0 >> 44; h0 &= CATCRYPT_POLY1305_MASK44;
+    h1 += carry;
+
+    // g = h + 5 - 2^130, h is replaced with g if that didn't go below zero, without a branch
+    uint64_t g0 = h0 + 5;
+    carry = g0 >> 44; g0 &= CATCRYPT_POLY1305_MASK44;
+    uint64_t g1 = h1 + carry;
+    carry = g1 >> 44; g1 &= CATCRYPT_POLY1305_MASK44;
+    uint64_t g2 = h2 + carry - (1ULL << 42);
+
+    uint64_t mask = (g2 >> 63) - 1;
+    h0 = (h0 & ~mask) | (g0 & mask);
+    h1 = (h1 & ~mask) | (g1 & mask);
+    h2 = (h2 & ~mask) | (g2 & mask);
+
+    uint64_t t0 = state->pad[0], t1 = state->pad[1];
+    h0 += t0 & CATCRYPT_POLY1305_MASK44;
+    carry = h0 >> 44; h0 &= CATCRYPT_POLY1305_MASK44;
+    h1 += (((t0 >> 44) | (t1 << 20)) & CATCRYPT_POLY1305_MASK44) + carry;
+    carry = h1 >> 44; h1 &= CATCRYPT_POLY1305_MASK44;
+    h2 += ((t1 >> 24) & CATCRYPT_POLY1305_MASK42) + carry;
+    h2 &= CATCRYPT_POLY1305_MASK42;
+
+    catcrypt_poly1305_store64(tag, h0 | (h1 << 44));
+    catcrypt_poly1305_store64(tag + 8, (h1 >> 20) | (h2 << 24));
+
+    memset(state, 0, sizeof(catcrypt_poly1305_t));
+}
+
+/**
+ * The one-time Poly1305 key is the first 32 bytes of keystream block 0, the data is encrypted from block 1.
+ */
+static void catcrypt_aead_tag(unsigned char* tag, const unsigned char* ciphertext, size_t length,
+                              const unsigned char* aad, size_t aad_length, const unsigned char* key, const unsigned char* nonce) {
+    unsigned char poly_key[CATCRYPT_CHACHA20_BLOCK_SIZE] = {0};
+    catcrypt_chacha20_xor(poly_key, poly_key, sizeof(poly_key), key, nonce, 0);
+
+    catcrypt_poly1305_t state;
+    catcrypt_poly1305_init(&state, poly_key);
+
+    catcrypt_poly1305_update(&state, aad, aad_length);
+    catcrypt_poly1305_pad16(&state, aad_length);
+    catcrypt_poly1305_update(&state, ciphertext, length);
+    catcrypt_poly1305_pad16(&state, length);
+
+    unsigned char lengths[16];
+    catcrypt_poly1305_store64(lengths, aad_length);
+    catcrypt_poly1305_store64(lengths + 8, length);
+    catcrypt_poly1305_update(&state, lengths, sizeof(lengths));
+
+    catcrypt_poly1305_final(&state, tag);
+    memset(poly_key, 0, sizeof(poly_key));
+}
+
+void catcrypt_aead_encrypt(unsigned char* out, unsigned char* tag, const unsigned char* in, size_t length,
+                           const unsigned char* aad, size_t aad_length, const unsigned char* key, const unsigned char* nonce) {
+    catcrypt_chacha20_xor(out, in, length, key, nonce, 1);
+    catcrypt_aead_tag(tag, out, length, aad, aad_length, key, nonce);
+}
+
+bool catcrypt_aead_decrypt(unsigned char* out, const unsigned char* tag, const unsigned char* in, size_t length,
+                           const unsigned char* aad, size_t aad_length, const unsigned char* key, const unsigned char* nonce) {
+    unsigned char expected[CATCRYPT_AEAD_TAG_SIZE];
+    catcrypt_aead_tag(expected, in, length, aad, aad_length, key, nonce);
+
+    // Every byte is compared, how long it takes doesn't tell where the tags differ
+    unsigned char difference = 0;
+    for (int i = 0; i < CATCRYPT_AEAD_TAG_SIZE; i++) {
+        difference |= expected[i] ^ tag[i];
+    }
+
+    if (difference) {
+        return false;
+    }
+
+    catcrypt_chacha20_xor(out, in, length, key, nonce, 1);
+    return true;
+}
@@ -0,0 +1,436 @@
+/*
+ * Catcrypt, simple RSA/PKE for C
+ * Copyright (C) 2023, Oğuzhan Eroğlu <meowingcate@gmail.com> (https://meowingcat.io)
+ * Licensed under GPLv3 License
+ * See LICENSE for more info
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#include "../include/async.h"
+
+#include "../include/util.h"
+#include "../include/ref.h"
+#include "../include/string.h"
+#include "../include/rsa.h"
+
+static catcrypt_async_job_t* catcrypt_async_job_new(catcrypt_async_op_t op, catcrypt_async_callback_f_t callback, void* context) {
+    catcrypt_async_job_t* job = malloc(sizeof(catcrypt_async_job_t));
+    CATCRYPT_REF_COUNTED_INIT(job, catcrypt_async_job_free);
+    // The pool's reference, until the job is completed
+    CATCRYPT_REF_COUNTED_USE(job);
+
+    job->next = NULL;
+    job->op = op;
+    job->state = CATCRYPT_ASYNC_STATE_PENDING;
+    job->callback = callback;
+    job->context = context;
+    job->key = NULL;
+    job->data = NULL;
+    job->signature = NULL;
+    job->encrypted = NULL;
+    job->bits = 0;
+    job->e = 0;
+    job->flags = 0;
+    job->output = NULL;
+    job->encrypted_output = NULL;
+    job->keypair = NULL;
+    job->is_verified = false;
+    job->is_failed = false;
+    job->submitted_at = 0;
+    job->started_at = 0;
+    job->completed_at = 0;
+
+    return job;
+}
+
+static catcrypt_async_job_t* catcrypt_async_submit(catcrypt_async_t* async, catcrypt_async_job_t* job) {
+    // The caller's reference, a worker can complete (and leave) the job before submit returns
+    CATCRYPT_REF_COUNTED_USE(job);
+
+    pthread_mutex_lock(&async->mutex);
+
+    job->submitted_at = catcrypt_util_get_time_usec();
+
+    if (async->tail) {
+        async->tail->next = job;
+    } else {
+        async->head = job;
+    }
+    async->tail = job;
+
+    async->pending++;
+    async->submitted++;
+    if (async->pending > async->max_pending) {
+        async->max_pending = async->pending;
+    }
+
+    pthread_cond_signal(&async->cond);
+    pthread_mutex_unlock(&async->mutex);
+
+    return job;
+}
+
+static void catcrypt_async_run(catcrypt_async_job_t* job) {
+    switch (job->op) {
+        case CATCRYPT_ASYNC_OP_ENCRYPT:
+            job->encrypted_output = catcrypt_rsa_encrypt(job->data, job->key);
+            job->is_failed = job->encrypted_output == NULL;
+            if (job->encrypted_output) {
+                CATCRYPT_REF_COUNTED_USE(job->encrypted_output);
+            }
+            break;
+        case CATCRYPT_ASYNC_OP_DECRYPT:
+            job->output = catcrypt_rsa_decrypt(job->encrypted, job->key);
+            job->is_failed = job->output == NULL;
+            if (job->output) {
+                CATCRYPT_REF_COUNTED_USE(job->output);
+            }
+            break;
+        case CATCRYPT_ASYNC_OP_SIGN:
+            job->output = catcrypt_rsa_sign(job->data, job->key);
+            job->is_failed = job->output == NULL;
+            if (job->output) {
+                CATCRYPT_REF_COUNTED_USE(job->output);
+            }
+            break;
+        case CATCRYPT_ASYNC_OP_VERIFY:
+            job->is_verified = catcrypt_rsa_verify(job->data, job->signature, job->key);
+            break;
+        case CATCRYPT_ASYNC_OP_KEYGEN:
+            // A new key pair already comes with a reference, it is the job's
+            job->keypair = catcrypt_rsa_keypair_new_ex(job->bits, job->e, job->flags);
+            job->is_failed = job->keypair == NULL;
+            break;
+    }
+}
+
+/**
+ * Called with the mutex locked. Returns true if the job has a callback, it is called after the mutex is unlocked.
+ */
+static bool catcrypt_async_complete(catcrypt_async_t* async, catcrypt_async_job_t* job, catcrypt_async_state_t state) {
+    job->state = state;
+    job->completed_at = catcrypt_util_get_time_usec();
+
+    if (state == CATCRYPT_ASYNC_STATE_CANCELLED) {
+        async->cancelled++;
+    } else {
+        async->done++;
+        async->failed += job->is_failed;
+    }
+
+    if (job->callback) {
+        return true;
+    }
+
+    if (async->completed_tail) {
+        async->completed_tail->next = job;
+    } else {
+        async->completed_head = job;
+    }
+    async->completed_tail = job;
+    async->completed++;
+
+    uint64_t count = 1;
+    CATCRYPT_UTIL_ASSERT(write(async->fd, &count, sizeof(count)) == sizeof(count));
+
+    return false;
+}
+
+static void catcrypt_async_callback(catcrypt_async_job_t* job) {
+    job->callback(job, job->context);
+    CATCRYPT_REF_COUNTED_LEAVE(job);
+}
+
+static void* catcrypt_async_worker(void* arg) {
+    catcrypt_async_t* async = arg;
+
+    pthread_mutex_lock(&async->mutex);
+
+    for (;;) {
+        while (async->is_running && !async->head) {
+            pthread_cond_wait(&async->cond, &async->mutex);
+        }
+
+        // Jobs still in the queue are cancelled by catcrypt_async_free()
+        if (!async->is_running) {
+            break;
+        }
+
+        catcrypt_async_job_t* job = async->head;
+        async->head = job->next;
+        if (!async->head) {
+            async->tail = NULL;
+        }
+        job->next = NULL;
+        job->state = CATCRYPT_ASYNC_STATE_RUNNING;
+        job->started_at = catcrypt_util_get_time_usec();
+
+        async->pending--;
+        async->running++;
+
+        uint64_t queue_usec = job->started_at - job->submitted_at;
+        async->queue_usec += queue_usec;
+        if (queue_usec > async->queue_usec_max) {
+            async->queue_usec_max = queue_usec;
+        }
+
+        pthread_mutex_unlock(&async->mutex);
+
+        catcrypt_async_run(job);
+
+        pthread_mutex_lock(&async->mutex);
+
+        async->running--;
+        bool is_callback = catcrypt_async_complete(async, job, CATCRYPT_ASYNC_STATE_DONE);
+
+        uint64_t run_usec = job->completed_at - job->started_at;
+        async->run_usec += run_usec;
+        if (run_usec > async->run_usec_max) {
+            async->run_usec_max = run_usec;
+        }
+
+        if (is_callback) {
+            pthread_mutex_unlock(&async->mutex);
+            catcrypt_async_callback(job);
+            pthread_mutex_lock(&async->mutex);
+        }
+    }
+
+    pthread_mutex_unlock(&async->mutex);
+
+    return NULL;
+}
+
+catcrypt_async_t* catcrypt_async_new(int threads) {
+    if (threads <= 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = (cores > 0) ? cores: 1;
+    }
+
+    catcrypt_async_t* async = malloc(sizeof(catcrypt_async_t));
+    CATCRYPT_REF_COUNTED_INIT(async, catcrypt_async_free);
+
+    pthread_mutex_init(&async->mutex, NULL);
+    pthread_cond_init(&async->cond, NULL);
+
+    async->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (async->fd < 0) {
+        fprintf(stderr, "catcrypt_async_new(): Failed to create the eventfd.\n");
+        exit(1);
+    }
+
+    async->is_running = true;
+    async->threads_count = threads;
+    async->threads = malloc(sizeof(pthread_t) * threads);
+    async->head = NULL;
+    async->tail = NULL;
+    async->completed_head = NULL;
+    async->completed_tail = NULL;
+    async->pending = 0;
+    async->running = 0;
+    async->completed = 0;
+    async->max_pending = 0;
+    async->submitted = 0;
+    async->done = 0;
+    async->cancelled = 0;
+    async->failed = 0;
+    async->queue_usec = 0;
+    async->queue_usec_max = 0;
+    async->run_usec = 0;
+    async->run_usec_max = 0;
+
+    for (int i = 0; i < threads; i++) {
+        CATCRYPT_UTIL_ASSERT(pthread_create(&async->threads[i], NULL, catcrypt_async_worker, async) == 0);
+    }
+
+    return async;
+}
+
+void catcrypt_async_free(catcrypt_async_t* async) {
+    pthread_mutex_lock(&async->mutex);
+    async->is_running = false;
+    pthread_cond_broadcast(&async->cond);
+    pthread_mutex_unlock(&async->mutex);
+
+    // Running jobs are finished and completed first
+    for (int i = 0; i < async->threads_count; i++) {
+        pthread_join(async->threads[i], NULL);
+    }
+
+    // Callbacks of jobs that never started are still called, once per job like any other completion
+    while (async->head) {
+        catcrypt_async_job_t* job = async->head;
+        async->head = job->next;
+        job->next = NULL;
+        async->pending--;
+
+        if (catcrypt_async_complete(async, job, CATCRYPT_ASYNC_STATE_CANCELLED)) {
+            catcrypt_async_callback(job);
+        }
+    }
+
+    while (async->completed_head) {
+        catcrypt_async_job_t* job = async->completed_head;
+        async->completed_head = job->next;
+        CATCRYPT_REF_COUNTED_LEAVE(job);
+    }
+
+    close(async->fd);
+    free(async->threads);
+
+    pthread_mutex_destroy(&async->mutex);
+    pthread_cond_destroy(&async->cond);
+
+    free(async);
+}
+
+void catcrypt_async_job_free(catcrypt_async_job_t* job) {
+    CATCRYPT_REF_COUNTED_LEAVE(job->key);
+    CATCRYPT_REF_COUNTED_LEAVE(job->data);
+    CATCRYPT_REF_COUNTED_LEAVE(job->signature);
+    CATCRYPT_REF_COUNTED_LEAVE(job->encrypted);
+    CATCRYPT_REF_COUNTED_LEAVE(job->output);
+    CATCRYPT_REF_COUNTED_LEAVE(job->encrypted_output);
+    CATCRYPT_REF_COUNTED_LEAVE(job->keypair);
+
+    free(job);
+}
+
+catcrypt_async_job_t* catcrypt_async_encrypt(catcrypt_async_t* async, catcrypt_string_t* data, catcrypt_rsa_key_t* pubkey, catcrypt_async_callback_f_t callback, void* context) {
+    catcrypt_async_job_t* job = catcrypt_async_job_new(CATCRYPT_ASYNC_OP_ENCRYPT, callback, context);
+    job->data = data;
+    CATCRYPT_REF_COUNTED_USE(data);
+    job->key = pubkey;
+    CATCRYPT_REF_COUNTED_USE(pubkey);
+
+    return catcrypt_async_submit(async, job);
+}
+
+catcrypt_async_job_t* catcrypt_async_decrypt(catcrypt_async_t* async, catcrypt_rsa_encrypted_t* encrypted, catcrypt_rsa_key_t* privkey, catcrypt_async_callback_f_t callback, void* context) {
+    catcrypt_async_job_t* job = catcrypt_async_job_new(CATCRYPT_ASYNC_OP_DECRYPT, callback, context);
+    job->encrypted = encrypted;
+    CATCRYPT_REF_COUNTED_USE(encrypted);
+    job->key = privkey;
+    CATCRYPT_REF_COUNTED_USE(privkey);
+
+    return catcrypt_async_submit(async, job);
+}
+
+catcrypt_async_job_t* catcrypt_async_sign(catcrypt_async_t* async, catcrypt_string_t* data, catcrypt_rsa_key_t* privkey, catcrypt_async_callback_f_t callback, void* context) {
+    catcrypt_async_job_t* job = catcrypt_async_job_new(CATCRYPT_ASYNC_OP_SIGN, callback, context);
+    job->data = data;
+    CATCRYPT_REF_COUNTED_USE(data);
+    job->key = privkey;
+    CATCRYPT_REF_COUNTED_USE(privkey);
+
+    return catcrypt_async_submit(async, job);
+}
+
+catcrypt_async_job_t* catcrypt_async_verify(catcrypt_async_t* async, catcrypt_string_t* data, catcrypt_string_t* signature, catcrypt_rsa_key_t* pubkey, catcrypt_async_callback_f_t callback, void* context) {
+    catcrypt_async_job_t* job = catcrypt_async_job_new(CATCRYPT_ASYNC_OP_VERIFY, callback, context);
+    job->data = data;
+    CATCRYPT_REF_COUNTED_USE(data);
+    job->signature = signature;
+    CATCRYPT_REF_COUNTED_USE(signature);
+    job->key = pubkey;
+    CATCRYPT_REF_COUNTED_USE(pubkey);
+
+    return catcrypt_async_submit(async, job);
+}
+
+catcrypt_async_job_t* catcrypt_async_keygen(catcrypt_async_t* async, size_t bits, unsigned long e, unsigned int flags, catcrypt_async_callback_f_t callback, void* context) {
+    catcrypt_async_job_t* job = catcrypt_async_job_new(CATCRYPT_ASYNC_OP_KEYGEN, callback, context);
+    job->bits = bits;
+    job->e = e;
+    job->flags = flags;
+
+    return catcrypt_async_submit(async, job);
+}
+
+bool catcrypt_async_cancel(catcrypt_async_t* async, catcrypt_async_job_t* job) {
+    pthread_mutex_lock(&async->mutex);
+
+    bool is_cancelled = job->state == CATCRYPT_ASYNC_STATE_PENDING;
+    bool is_callback = false;
+
+    if (is_cancelled) {
+        catcrypt_async_job_t* prev = NULL;
+        catcrypt_async_job_t* current = async->head;
+        while (current != job) {
+            prev = current;
+            current = current->next;
+        }
+
+        if (prev) {
+            prev->next = job->next;
+        } else {
+            async->head = job->next;
+        }
+        if (async->tail == job) {
+            async->tail = prev;
+        }
+        job->next = NULL;
+        async->pending--;
+
+        is_callback = catcrypt_async_complete(async, job, CATCRYPT_ASYNC_STATE_CANCELLED);
+    }
+
+    pthread_mutex_unlock(&async->mutex);
+
+    if (is_callback) {
+        catcrypt_async_callback(job);
+    }
+
+    return is_cancelled;
+}
+
+catcrypt_async_job_t* catcrypt_async_poll(catcrypt_async_t* async) {
+    pthread_mutex_lock(&async->mutex);
+
+    catcrypt_async_job_t* job = async->completed_head;
+
+    if (job) {
+        async->completed_head = job->next;
+        if (!async->completed_head) {
+            async->completed_tail = NULL;
+        }
+        job->next = NULL;
+        async->completed--;
+    } else {
+        // Nothing is left, fd isn't readable again until the next completion
+        uint64_t count;
+        while ((read(async->fd, &count, sizeof(count)) < 0) && (errno == EINTR));
+    }
+
+    pthread_mutex_unlock(&async->mutex);
+
+    return job;
+}
+
+void catcrypt_async_get_stats(catcrypt_async_t* async, catcrypt_async_stats_t* stats) {
+    pthread_mutex_lock(&async->mutex);
+
+    stats->pending = async->pending;
+    stats->running = async->running;
+    stats->completed = async->completed;
+    stats->max_pending = async->max_pending;
+    stats->submitted = async->submitted;
+    stats->done = async->done;
+    stats->cancelled = async->cancelled;
+    stats->failed = async->failed;
+    stats->queue_usec_avg = async->done ? ((double) async->queue_usec / (double) async->done): 0.0;
+    stats->queue_usec_max = async->queue_usec_max;
+    stats->run_usec_avg = async->done ? ((double) async->run_usec / (double) async->done): 0.0;
+    stats->run_usec_max = async->run_usec_max;
+
+    pthread_mutex_unlock(&async->mutex);
+}
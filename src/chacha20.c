@@ -0,0 +1,149 @@
+/*
+ * Catcrypt, simple RSA/PKE for C
+ * Copyright (C) 2023, Oğuzhan Eroğlu <meowingcate@gmail.com> (https://meowingcat.io)
+ * Licensed under GPLv3 License
+ * See LICENSE for more info
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "../include/chacha20.h"
+
+#define CATCRYPT_CHACHA20_ROTL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+#define CATCRYPT_CHACHA20_QUARTER_ROUND(a, b, c, d) \
+    a += b; d ^= a; d = CATCRYPT_CHACHA20_ROTL(d, 16); \
+    c += d; b ^= c; b = CATCRYPT_CHACHA20_ROTL(b, 12); \
+    a += b; d ^= a; d = CATCRYPT_CHACHA20_ROTL(d, 8); \
+    c += d; b ^= c; b = CATCRYPT_CHACHA20_ROTL(b, 7);
+
+static uint32_t catcrypt_chacha20_load32(const unsigned char* bytes) {
+    return (uint32_t) bytes[0] | ((uint32_t) bytes[1] << 8) | ((uint32_t) bytes[2] << 16) | ((uint32_t) bytes[3] << 24);
+}
+
+void catcrypt_chacha20_block(const uint32_t key[8], const uint32_t words[4], unsigned char* out) {
+    uint32_t input[16] = {
+        0x61707865, 0x3320646e, 0x79622d32, 0x6b206574,
+        key[0], key[1], key[2], key[3], key[4], key[5], key[6], key[7],
+        words[0], words[1], words[2], words[3]
+    };
+    uint32_t x[16];
+    memcpy(x, input, sizeof(x));
+
+    for (int i = 0; i < 10; i++) {
+        CATCRYPT_CHACHA20_QUARTER_ROUND(x[0], x[4], x[8], x[12]);
+        CATCRYPT_CHACHA20_QUARTER_ROUND(x[1], x[5], x[9], x[13]);
+        CATCRYPT_CHACHA20_QUARTER_ROUND(x[2], x[6], x[10], x[14]);
+        CATCRYPT_CHACHA20_QUARTER_ROUND(x[3], x[7], x[11], x[15]);
+        CATCRYPT_CHACHA20_QUARTER_ROUND(x[0], x[5], x[10], x[15]);
+        CATCRYPT_CHACHA20_QUARTER_ROUND(x[1], x[6], x[11], x[12]);
+        CATCRYPT_CHACHA20_QUARTER_ROUND(x[2], x[7], x[8], x[13]);
+        CATCRYPT_CHACHA20_QUARTER_ROUND(x[3], x[4], x[9], x[14]);
+    }
+
+    for (int i = 0; i < 16; i++) {
+        uint32_t word = x[i] + input[i];
+        out[i * 4] = word;
+        out[i * 4 + 1] = word >> 8;
+        out[i * 4 + 2] = word >> 16;
+        out[i * 4 + 3] = word >> 24;
+    }
+}
+
+typedef uint32_t catcrypt_chacha20_vector_t __attribute__((vector_size(16)));
+
+#define CATCRYPT_CHACHA20_WAYS 4
+#define CATCRYPT_CHACHA20_VECTOR_ROTL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+#define CATCRYPT_CHACHA20_VECTOR_QUARTER_ROUND(a, b, c, d) \
+    a += b; d ^= a; d = CATCRYPT_CHACHA20_VECTOR_ROTL(d, 16); \
+    c += d; b ^= c; b = CATCRYPT_CHACHA20_VECTOR_ROTL(b, 12); \
+    a += b; d ^= a; d = CATCRYPT_CHACHA20_VECTOR_ROTL(d, 8); \
+    c += d; b ^= c; b = CATCRYPT_CHACHA20_VECTOR_ROTL(b, 7);
+
+/**
+ * CATCRYPT_CHACHA20_WAYS blocks (counters words[0] and on) at once: lane j of every vector is a word of block j,
+ * the same rounds run on all of them with SIMD instructions where the target has them.
+ */
+static void catcrypt_chacha20_blocks(const uint32_t key[8], const uint32_t words[4], unsigned char* out) {
+    catcrypt_chacha20_vector_t input[16];
+    const uint32_t constants[4] = {0x61707865, 0x3320646e, 0x79622d32, 0x6b206574};
+
+    for (int i = 0; i < 4; i++) {
+        input[i] = (catcrypt_chacha20_vector_t) {constants[i], constants[i], constants[i], constants[i]};
+    }
+    for (int i = 0; i < 8; i++) {
+        input[4 + i] = (catcrypt_chacha20_vector_t) {key[i], key[i], key[i], key[i]};
+    }
+    input[12] = (catcrypt_chacha20_vector_t) {words[0], words[0] + 1, words[0] + 2, words[0] + 3};
+    for (int i = 1; i < 4; i++) {
+        input[12 + i] = (catcrypt_chacha20_vector_t) {words[i], words[i], words[i], words[i]};
+    }
+
+    catcrypt_chacha20_vector_t x[16];
+    memcpy(x, input, sizeof(x));
+
+    for (int i = 0; i < 10; i++) {
+        CATCRYPT_CHACHA20_VECTOR_QUARTER_ROUND(x[0], x[4], x[8], x[12]);
+        CATCRYPT_CHACHA20_VECTOR_QUARTER_ROUND(x[1], x[5], x[9], x[13]);
+        CATCRYPT_CHACHA20_VECTOR_QUARTER_ROUND(x[2], x[6], x[10], x[14]);
+        CATCRYPT_CHACHA20_VECTOR_QUARTER_ROUND(x[3], x[7], x[11], x[15]);
+        CATCRYPT_CHACHA20_VECTOR_QUARTER_ROUND(x[0], x[5], x[10], x[15]);
+        CATCRYPT_CHACHA20_VECTOR_QUARTER_ROUND(x[1], x[6], x[11], x[12]);
+        CATCRYPT_CHACHA20_VECTOR_QUARTER_ROUND(x[2], x[7], x[8], x[13]);
+        CATCRYPT_CHACHA20_VECTOR_QUARTER_ROUND(x[3], x[4], x[9], x[14]);
+    }
+
+    for (int i = 0; i < 16; i++) {
+        catcrypt_chacha20_vector_t word = x[i] + input[i];
+
+        for (int j = 0; j < CATCRYPT_CHACHA20_WAYS; j++) {
+            unsigned char* bytes = out + (j * CATCRYPT_CHACHA20_BLOCK_SIZE) + (i * 4);
+            bytes[0] = word[j];
+            bytes[1] = word[j] >> 8;
+            bytes[2] = word[j] >> 16;
+            bytes[3] = word[j] >> 24;
+        }
+    }
+}
+
+void catcrypt_chacha20_xor(unsigned char* out, const unsigned char* in, size_t length, const unsigned char* key, const unsigned char* nonce, uint32_t counter) {
+    uint32_t key_words[8];
+    for (int i = 0; i < 8; i++) {
+        key_words[i] = catcrypt_chacha20_load32(key + (i * 4));
+    }
+
+    uint32_t words[4] = {counter, catcrypt_chacha20_load32(nonce), catcrypt_chacha20_load32(nonce + 4), catcrypt_chacha20_load32(nonce + 8)};
+    unsigned char block[CATCRYPT_CHACHA20_BLOCK_SIZE * CATCRYPT_CHACHA20_WAYS];
+
+    while (length > 0) {
+        if (length > CATCRYPT_CHACHA20_BLOCK_SIZE) {
+            catcrypt_chacha20_blocks(key_words, words, block);
+            words[0] += CATCRYPT_CHACHA20_WAYS;
+        } else {
+            catcrypt_chacha20_block(key_words, words, block);
+            words[0]++;
+        }
+
+        size_t block_length = (length < sizeof(block)) ? length: sizeof(block);
+
+        // Whole words at a time, memcpy keeps unaligned buffers safe
+        size_t i = 0;
+        for (; (i + sizeof(uint64_t)) <= block_length; i += sizeof(uint64_t)) {
+            uint64_t a, b;
+            memcpy(&a, in + i, sizeof(a));
+            memcpy(&b, block + i, sizeof(b));
+            a ^= b;
+            memcpy(out + i, &a, sizeof(a));
+        }
+        for (; i < block_length; i++) {
+            out[i] = in[i] ^ block[i];
+        }
+
+        in += block_length;
+        out += block_length;
+        length -= block_length;
+    }
+
+    memset(block, 0, sizeof(block));
+    memset(key_words, 0, sizeof(key_words));
+}
@@ -0,0 +1,264 @@
+/*
+ * Catcrypt, simple RSA/PKE for C
+ * Copyright (C) 2023, Oğuzhan Eroğlu <meowingcate@gmail.com> (https://meowingcat.io)
+ * Licensed under GPLv3 License
+ * See LICENSE for more info
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "../include/keypool.h"
+
+#include "../include/util.h"
+#include "../include/ref.h"
+#include "../include/string.h"
+#include "../include/rsa.h"
+
+static void catcrypt_keypool_push(catcrypt_keypool_t* pool, catcrypt_rsa_keypair_t* keypair) {
+    pool->keypairs[(pool->head + pool->length) % pool->watermark] = keypair;
+    pool->length++;
+}
+
+static bool catcrypt_keypool_write_key(FILE* file, catcrypt_rsa_key_t* key) {
+    catcrypt_string_t* bin = catcrypt_rsa_key_to_bin(key);
+    CATCRYPT_REF_COUNTED_USE(bin);
+
+    size_t length = bin->length;
+    bool is_written = (fwrite(&length, sizeof(length), 1, file) == 1)
+                   && (fwrite(bin->value, length, 1, file) == 1);
+
+    CATCRYPT_REF_COUNTED_LEAVE(bin);
+
+    return is_written;
+}
+
+/**
+ * remaining is what is left of the file, a length past it (a record cut short by a crash mid-save, or a corrupt length)
+ * or a key that doesn't load gives NULL.
+ */
+static catcrypt_rsa_key_t* catcrypt_keypool_read_key(FILE* file, size_t* remaining) {
+    size_t length = 0;
+    if ((*remaining < sizeof(length)) || (fread(&length, sizeof(length), 1, file) != 1)) {
+        return NULL;
+    }
+    *remaining -= sizeof(length);
+
+    if ((length == 0) || (length > *remaining) || (length > CATCRYPT_STRING_MAX_LENGTH)) {
+        return NULL;
+    }
+
+    char* bin = malloc(length);
+    if (!bin || (fread(bin, length, 1, file) != 1)) {
+        free(bin);
+        return NULL;
+    }
+    *remaining -= length;
+
+    catcrypt_rsa_key_t* key = catcrypt_rsa_key_from_bin(catcrypt_string_new_from_binary__copy(bin, length));
+    free(bin);
+
+    return key;
+}
+
+static bool catcrypt_keypool_save(catcrypt_keypool_t* pool) {
+    // Private keys are in there, only the owner can read it
+    int fd = open(pool->persist_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        return false;
+    }
+
+    FILE* file = fdopen(fd, "wb");
+    if (!file) {
+        close(fd);
+        return false;
+    }
+
+    bool is_saved = true;
+
+    for (int i = 0; is_saved && (i < pool->length); i++) {
+        catcrypt_rsa_keypair_t* keypair = pool->keypairs[(pool->head + i) % pool->watermark];
+        is_saved = catcrypt_keypool_write_key(file, keypair->privkey)
+                && catcrypt_keypool_write_key(file, keypair->pubkey);
+    }
+
+    fclose(file);
+
+    return is_saved;
+}
+
+static void catcrypt_keypool_load(catcrypt_keypool_t* pool) {
+    FILE* file = fopen(pool->persist_path, "rb");
+    if (!file) {
+        return;
+    }
+
+    // Lengths in the file are checked against its size, loading stops at the first bad record
+    long size = -1;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        size = ftell(file);
+        rewind(file);
+    }
+    size_t remaining = (size > 0) ? (size_t) size: 0;
+
+    while (pool->length < pool->watermark) {
+        catcrypt_rsa_key_t* privkey = catcrypt_keypool_read_key(file, &remaining);
+        if (!privkey) {
+            break;
+        }
+        catcrypt_rsa_key_t* pubkey = catcrypt_keypool_read_key(file, &remaining);
+        if (!pubkey) {
+            CATCRYPT_REF_COUNTED_LEAVE(privkey);
+            break;
+        }
+
+        catcrypt_keypool_push(pool, catcrypt_rsa_keypair_new_from_keys(pubkey, privkey));
+        pool->loaded++;
+
+        CATCRYPT_REF_COUNTED_LEAVE(pubkey);
+        CATCRYPT_REF_COUNTED_LEAVE(privkey);
+    }
+
+    fclose(file);
+
+    // Loaded keypairs must not come back after another restart
+    unlink(pool->persist_path);
+}
+
+static void* catcrypt_keypool_refill(void* arg) {
+    catcrypt_keypool_t* pool = arg;
+
+    pthread_mutex_lock(&pool->mutex);
+
+    for (;;) {
+        while (pool->is_running && (pool->length >= pool->watermark)) {
+            pthread_cond_wait(&pool->cond, &pool->mutex);
+        }
+
+        if (!pool->is_running) {
+            break;
+        }
+
+        pthread_mutex_unlock(&pool->mutex);
+
+        uint64_t started_at = catcrypt_util_get_time_msec();
+        catcrypt_rsa_keypair_t* keypair = catcrypt_rsa_keypair_new__threads(pool->threads);
+        uint64_t generating_msec = catcrypt_util_get_time_msec() - started_at;
+
+        pthread_mutex_lock(&pool->mutex);
+
+        pool->generated++;
+        pool->generating_msec += generating_msec;
+
+        if (pool->length < pool->watermark) {
+            catcrypt_keypool_push(pool, keypair);
+        } else {
+            CATCRYPT_REF_COUNTED_LEAVE(keypair);
+        }
+    }
+
+    pthread_mutex_unlock(&pool->mutex);
+
+    return NULL;
+}
+
+catcrypt_keypool_t* catcrypt_keypool_new(int watermark, int threads, char* persist_path) {
+    CATCRYPT_UTIL_ASSERT(watermark > 0);
+
+    catcrypt_keypool_t* pool = malloc(sizeof(catcrypt_keypool_t));
+    CATCRYPT_REF_COUNTED_INIT(pool, catcrypt_keypool_free);
+
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+
+    pool->is_running = true;
+    pool->threads = threads;
+    pool->watermark = watermark;
+    pool->head = 0;
+    pool->length = 0;
+    pool->keypairs = malloc(sizeof(catcrypt_rsa_keypair_t *) * watermark);
+    pool->persist_path = persist_path ? strdup(persist_path): NULL;
+    pool->hits = 0;
+    pool->misses = 0;
+    pool->generated = 0;
+    pool->loaded = 0;
+    pool->generating_msec = 0;
+    pool->started_at = catcrypt_util_get_time_msec();
+
+    if (pool->persist_path) {
+        catcrypt_keypool_load(pool);
+    }
+
+    CATCRYPT_UTIL_ASSERT(pthread_create(&pool->thread, NULL, catcrypt_keypool_refill, pool) == 0);
+
+    return pool;
+}
+
+void catcrypt_keypool_free(catcrypt_keypool_t* pool) {
+    pthread_mutex_lock(&pool->mutex);
+    pool->is_running = false;
+    pthread_cond_signal(&pool->cond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    // Waits for the keypair in progress, it goes into the pool (and to the disk) too
+    pthread_join(pool->thread, NULL);
+
+    if (pool->persist_path) {
+        if (!catcrypt_keypool_save(pool)) {
+            fprintf(stderr, "catcrypt_keypool_free(): Failed to save keypairs to %s.\n", pool->persist_path);
+        }
+        free(pool->persist_path);
+    }
+
+    for (int i = 0; i < pool->length; i++) {
+        CATCRYPT_REF_COUNTED_LEAVE(pool->keypairs[(pool->head + i) % pool->watermark]);
+    }
+    free(pool->keypairs);
+
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->cond);
+
+    free(pool);
+}
+
+catcrypt_rsa_keypair_t* catcrypt_keypool_acquire(catcrypt_keypool_t* pool) {
+    catcrypt_rsa_keypair_t* keypair = NULL;
+
+    pthread_mutex_lock(&pool->mutex);
+
+    if (pool->length > 0) {
+        keypair = pool->keypairs[pool->head];
+        pool->head = (pool->head + 1) % pool->watermark;
+        pool->length--;
+        pool->hits++;
+        pthread_cond_signal(&pool->cond);
+    } else {
+        pool->misses++;
+    }
+
+    pthread_mutex_unlock(&pool->mutex);
+
+    return keypair;
+}
+
+void catcrypt_keypool_get_stats(catcrypt_keypool_t* pool, catcrypt_keypool_stats_t* stats) {
+    pthread_mutex_lock(&pool->mutex);
+
+    stats->available = pool->length;
+    stats->hits = pool->hits;
+    stats->misses = pool->misses;
+    stats->generated = pool->generated;
+    stats->loaded = pool->loaded;
+    stats->generating_msec = pool->generating_msec;
+
+    uint64_t elapsed_msec = catcrypt_util_get_time_msec() - pool->started_at;
+    stats->refill_rate = elapsed_msec ? ((double) pool->generated * 1000.0 / (double) elapsed_msec): 0.0;
+
+    pthread_mutex_unlock(&pool->mutex);
+}
\ No newline at end of file
@@ -0,0 +1,359 @@
+/*
+ * Catcrypt, simple RSA/PKE for C
+ * Copyright (C) 2023, Oğuzhan Eroğlu <meowingcate@gmail.com> (https://meowingcat.io)
+ * Licensed under GPLv3 License
+ * See LICENSE for more info
+ */
+
+#include <stdlib.h>
+#include <gmp.h>
+
+#include "../include/mont.h"
+#include "../include/util.h"
+
+static mp_limb_t catcrypt_mont_limb_inverse(mp_limb_t n0) {
+    // n0 * n0 = 1 (mod 8) for odd n0, every Newton step doubles the correct bits
+    mp_limb_t inverse = n0;
+    for (int i = 0; i < 6; i++) {
+        inverse *= 2 - n0 * inverse;
+    }
+
+    return inverse;
+}
+
+void catcrypt_mont_limbs_from_mpz(mp_limb_t* rp, mp_size_t size, mpz_t num) {
+    mp_size_t num_size = mpz_size(num);
+    CATCRYPT_UTIL_ASSERT(num_size <= size);
+
+    if (num_size > 0) {
+        mpn_copyi(rp, mpz_limbs_read(num), num_size);
+    }
+    if (size > num_size) {
+        mpn_zero(rp + num_size, size - num_size);
+    }
+}
+
+void catcrypt_mont_limbs_to_mpz(mpz_t rop, mp_limb_t* ap, mp_size_t size) {
+    mpn_copyi(mpz_limbs_write(rop, size), ap, size);
+    mpz_limbs_finish(rop, size);
+}
+
+void catcrypt_mont_init(catcrypt_mont_t* mont, mpz_t n) {
+    CATCRYPT_UTIL_ASSERT(mpz_odd_p(n));
+
+    mp_size_t size = mpz_size(n);
+
+    mont->size = size;
+    mont->n = malloc(sizeof(mp_limb_t) * size);
+    mont->one = malloc(sizeof(mp_limb_t) * size);
+    mont->rr = malloc(sizeof(mp_limb_t) * size);
+
+    catcrypt_mont_limbs_from_mpz(mont->n, size, n);
+    mont->ninv = -catcrypt_mont_limb_inverse(mont->n[0]);
+
+    mpz_t r;
+    mpz_init(r);
+
+    mpz_setbit(r, size * GMP_NUMB_BITS);
+    mpz_mod(r, r, n);
+    catcrypt_mont_limbs_from_mpz(mont->one, size, r);
+
+    mpz_mul(r, r, r);
+    mpz_mod(r, r, n);
+    catcrypt_mont_limbs_from_mpz(mont->rr, size, r);
+
+    mpz_clear(r);
+}
+
+void catcrypt_mont_clear(catcrypt_mont_t* mont) {
+    free(mont->n);
+    free(mont->one);
+    free(mont->rr);
+}
+
+static void catcrypt_mont_redc(catcrypt_mont_t* mont, mp_limb_t* rp, mp_limb_t* tp) {
+    mp_size_t size = mont->size;
+
+    for (mp_size_t i = 0; i < size; i++) {
+        mp_limb_t q = tp[i] * mont->ninv;
+        // tp[i] becomes zero, it keeps the carry that has to go into the upper half
+        tp[i] = mpn_addmul_1(tp + i, mont->n, size, q);
+    }
+
+    mp_limb_t carry = mpn_add_n(rp, tp + size, tp, size);
+    if (carry || (mpn_cmp(rp, mont->n, size) >= 0)) {
+        mpn_sub_n(rp, rp, mont->n, size);
+    }
+}
+
+void catcrypt_mont_mul(catcrypt_mont_t* mont, mp_limb_t* rp, mp_limb_t* ap, mp_limb_t* bp, mp_limb_t* tp) {
+    if (ap == bp) {
+        mpn_sqr(tp, ap, mont->size);
+    } else {
+        mpn_mul_n(tp, ap, bp, mont->size);
+    }
+
+    catcrypt_mont_redc(mont, rp, tp);
+}
+
+void catcrypt_mont_sqr(catcrypt_mont_t* mont, mp_limb_t* rp, mp_limb_t* ap, mp_limb_t* tp) {
+    mpn_sqr(tp, ap, mont->size);
+    catcrypt_mont_redc(mont, rp, tp);
+}
+
+void catcrypt_mont_to(catcrypt_mont_t* mont, mp_limb_t* rp, mp_limb_t* ap, mp_limb_t* tp) {
+    catcrypt_mont_mul(mont, rp, ap, mont->rr, tp);
+}
+
+void catcrypt_mont_from(catcrypt_mont_t* mont, mp_limb_t* rp, mp_limb_t* ap, mp_limb_t* tp) {
+    mpn_copyi(tp, ap, mont->size);
+    mpn_zero(tp + mont->size, mont->size);
+    catcrypt_mont_redc(mont, rp, tp);
+}
+
+static int catcrypt_mont_window_bits(mp_bitcnt_t exponent_bits) {
+    if (exponent_bits > 768) {
+        return 6;
+    }
+    if (exponent_bits > 256) {
+        return 5;
+    }
+    if (exponent_bits > 80) {
+        return 4;
+    }
+    if (exponent_bits > 24) {
+        return 3;
+    }
+
+    return 1;
+}
+
+static mp_limb_t catcrypt_mont_exponent_bits(const mp_limb_t* ep, mp_bitcnt_t position, int count) {
+    mp_limb_t bits = 0;
+
+    for (int i = count - 1; i >= 0; i--) {
+        mp_bitcnt_t bit = position + i;
+        bits = (bits << 1) | ((ep[bit / GMP_NUMB_BITS] >> (bit % GMP_NUMB_BITS)) & 1);
+    }
+
+    return bits;
+}
+
+mp_size_t catcrypt_mont_powm_itch(catcrypt_mont_t* mont, mp_bitcnt_t exponent_bits) {
+    int window_bits = catcrypt_mont_window_bits(exponent_bits);
+
+    // table + product
+    return (((mp_size_t) 1) << window_bits) * mont->size + 2 * mont->size;
+}
+
+void catcrypt_mont_powm(catcrypt_mont_t* mont, mp_limb_t* rp, mp_limb_t* bp, const mp_limb_t* ep, mp_size_t en, mp_limb_t* tp) {
+    mp_size_t size = mont->size;
+
+    while ((en > 0) && (ep[en - 1] == 0)) {
+        en--;
+    }
+
+    if (en == 0) {
+        mpn_copyi(rp, mont->one, size);
+        return;
+    }
+
+    mp_bitcnt_t exponent_bits = en * GMP_NUMB_BITS;
+    mp_limb_t top = ep[en - 1];
+    while (!(top >> (GMP_NUMB_BITS - 1))) {
+        top <<= 1;
+        exponent_bits--;
+    }
+
+    int window_bits = catcrypt_mont_window_bits(exponent_bits);
+    mp_size_t table_size = ((mp_size_t) 1) << window_bits;
+    mp_limb_t* table = tp;
+    mp_limb_t* product = tp + table_size * size;
+
+    mpn_copyi(table, mont->one, size);
+    catcrypt_mont_to(mont, table + size, bp, product);
+    for (mp_size_t i = 2; i < table_size; i++) {
+        catcrypt_mont_mul(mont, table + i * size, table + (i - 1) * size, table + size, product);
+    }
+
+    // Fixed windows from the top, the first (partial) window is just a table lookup
+    mp_bitcnt_t position = ((exponent_bits - 1) / window_bits) * window_bits;
+    mp_limb_t window = catcrypt_mont_exponent_bits(ep, position, exponent_bits - position);
+    mpn_copyi(rp, table + window * size, size);
+
+    while (position > 0) {
+        position -= window_bits;
+
+        for (int i = 0; i < window_bits; i++) {
+            catcrypt_mont_sqr(mont, rp, rp, product);
+        }
+
+        window = catcrypt_mont_exponent_bits(ep, position, window_bits);
+        if (window) {
+            catcrypt_mont_mul(mont, rp, rp, table + window * size, product);
+        }
+    }
+}
+
+void catcrypt_mont_exponent_init(catcrypt_mont_exponent_t* exponent, mpz_t e) {
+    mp_bitcnt_t bits = mpz_sizeinbase(e, 2);
+    int window_bits = catcrypt_mont_window_bits(bits);
+
+    exponent->window_bits = window_bits;
+    exponent->length = 0;
+    // At most one step for every bit and one for the trailing zeros
+    exponent->steps = malloc(sizeof(catcrypt_mont_exponent_step_t) * (bits + 1));
+
+    if (mpz_sgn(e) == 0) {
+        return;
+    }
+
+    uint32_t squarings = 0;
+
+    for (mp_bitcnt_t i = bits; i > 0;) {
+        mp_bitcnt_t top = i - 1;
+
+        if (!mpz_tstbit(e, top)) {
+            squarings++;
+            i--;
+            continue;
+        }
+
+        // The longest window below top that ends with a 1 bit, its value is odd
+        mp_bitcnt_t low = (top + 1 > window_bits) ? (top + 1 - window_bits): 0;
+        while (!mpz_tstbit(e, low)) {
+            low++;
+        }
+
+        uint32_t digit = 0;
+        for (mp_bitcnt_t bit = top + 1; bit > low; bit--) {
+            digit = (digit << 1) | mpz_tstbit(e, bit - 1);
+        }
+
+        exponent->steps[exponent->length].squarings = squarings + (top - low + 1);
+        exponent->steps[exponent->length].digit = digit;
+        exponent->length++;
+
+        squarings = 0;
+        i = low;
+    }
+
+    if (squarings) {
+        exponent->steps[exponent->length].squarings = squarings;
+        exponent->steps[exponent->length].digit = 0;
+        exponent->length++;
+    }
+}
+
+void catcrypt_mont_exponent_clear(catcrypt_mont_exponent_t* exponent) {
+    free(exponent->steps);
+}
+
+mp_size_t catcrypt_mont_powm_exponent_itch(catcrypt_mont_t* mont, catcrypt_mont_exponent_t* exponent) {
+    // odd powers + square of the base + product
+    return (((mp_size_t) 1) << (exponent->window_bits - 1)) * mont->size + 3 * mont->size;
+}
+
+void catcrypt_mont_powm_exponent(catcrypt_mont_t* mont, mp_limb_t* rp, mp_limb_t* bp, catcrypt_mont_exponent_t* exponent, mp_limb_t* tp) {
+    mp_size_t size = mont->size;
+
+    if (exponent->length == 0) {
+        mpn_copyi(rp, mont->one, size);
+        return;
+    }
+
+    mp_size_t table_size = ((mp_size_t) 1) << (exponent->window_bits - 1);
+    mp_limb_t* table = tp;
+    mp_limb_t* square = tp + table_size * size;
+    mp_limb_t* product = square + size;
+
+    // table[i] = b ^ (2 * i + 1)
+    catcrypt_mont_to(mont, table, bp, product);
+    if (table_size > 1) {
+        catcrypt_mont_sqr(mont, square, table, product);
+        for (mp_size_t i = 1; i < table_size; i++) {
+            catcrypt_mont_mul(mont, table + i * size, table + (i - 1) * size, square, product);
+        }
+    }
+
+    // The first step starts from its digit, the squarings before it would only square one
+    catcrypt_mont_exponent_step_t* step = exponent->steps;
+    mpn_copyi(rp, table + ((step->digit - 1) / 2) * size, size);
+
+    for (size_t i = 1; i < exponent->length; i++) {
+        step = &exponent->steps[i];
+
+        for (uint32_t j = 0; j < step->squarings; j++) {
+            catcrypt_mont_sqr(mont, rp, rp, product);
+        }
+
+        if (step->digit) {
+            catcrypt_mont_mul(mont, rp, rp, table + ((step->digit - 1) / 2) * size, product);
+        }
+    }
+}
+
+void catcrypt_mont_powm_ui(catcrypt_mont_t* mont, mp_limb_t* rp, mp_limb_t* bp, unsigned long e, mp_limb_t* tp) {
+    mp_size_t size = mont->size;
+
+    if (e <= 1) {
+        if (e == 1) {
+            mpn_copyi(rp, bp, size);
+        } else {
+            catcrypt_mont_from(mont, rp, mont->one, tp);
+        }
+        return;
+    }
+
+    mp_limb_t* base = tp;
+    mp_limb_t* product = tp + size;
+
+    int bit = (sizeof(e) * 8) - 1;
+    while (!((e >> bit) & 1)) {
+        bit--;
+    }
+
+    catcrypt_mont_to(mont, base, bp, product);
+    mpn_copyi(rp, base, size);
+
+    for (bit--; bit > 0; bit--) {
+        catcrypt_mont_sqr(mont, rp, rp, product);
+        if ((e >> bit) & 1) {
+            catcrypt_mont_mul(mont, rp, rp, base, product);
+        }
+    }
+
+    catcrypt_mont_sqr(mont, rp, rp, product);
+
+    // (x * R) * b * R^-1 = x * b, multiplying by the normal form base is also the conversion back
+    if (e & 1) {
+        catcrypt_mont_mul(mont, rp, rp, bp, product);
+    } else {
+        catcrypt_mont_from(mont, rp, rp, product);
+    }
+}
+
+void catcrypt_mont_powm_2(catcrypt_mont_t* mont, mp_limb_t* rp, const mp_limb_t* ep, mp_size_t en, mp_limb_t* tp) {
+    mp_size_t size = mont->size;
+    bool is_started = false;
+
+    mpn_copyi(rp, mont->one, size);
+
+    for (mp_size_t i = en - 1; i >= 0; i--) {
+        for (int bit = GMP_NUMB_BITS - 1; bit >= 0; bit--) {
+            // Squaring one is one, leading zeros cost nothing
+            if (is_started) {
+                catcrypt_mont_sqr(mont, rp, rp, tp);
+            }
+
+            if ((ep[i] >> bit) & 1) {
+                is_started = true;
+
+                mp_limb_t carry = mpn_lshift(rp, rp, size, 1);
+                if (carry || (mpn_cmp(rp, mont->n, size) >= 0)) {
+                    mpn_sub_n(rp, rp, mont->n, size);
+                }
+            }
+        }
+    }
+}
\ No newline at end of file
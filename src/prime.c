@@ -0,0 +1,360 @@
+/*
+ * Catcrypt, simple RSA/PKE for C
+ * Copyright (C) 2023, Oğuzhan Eroğlu <meowingcate@gmail.com> (https://meowingcat.io)
+ * Licensed under GPLv3 License
+ * See LICENSE for more info
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <gmp.h>
+
+#include "../include/prime.h"
+#include "../include/mont.h"
+#include "../include/rng.h"
+
+static uint32_t sieve_primes[CATCRYPT_PRIME_SIEVE_PRIMES];
+static pthread_once_t sieve_primes_once = PTHREAD_ONCE_INIT;
+
+static void catcrypt_prime_sieve_primes_init() {
+    int count = 0;
+
+    for (uint32_t candidate = 3; count < CATCRYPT_PRIME_SIEVE_PRIMES; candidate += 2) {
+        bool is_prime = true;
+
+        for (int i = 0; (i < count) && (sieve_primes[i] * sieve_primes[i] <= candidate); i++) {
+            if (candidate % sieve_primes[i] == 0) {
+                is_prime = false;
+                break;
+            }
+        }
+
+        if (is_prime) {
+            sieve_primes[count++] = candidate;
+        }
+    }
+}
+
+void catcrypt_prime_stats_init(catcrypt_prime_stats_t* stats) {
+    stats->tested = 0;
+    stats->sieved = 0;
+}
+
+int catcrypt_prime_mr_rounds(size_t bits) {
+    // Rounds after a Lucas test for 2^-100 error (FIPS 186-4, Table C.3)
+    if (bits >= 1536) {
+        return 3;
+    }
+    if (bits >= 1024) {
+        return 4;
+    }
+    if (bits >= 512) {
+        return 5;
+    }
+
+    return 7;
+}
+
+static void catcrypt_prime_random_base(mpz_t base, mpz_t num) {
+    size_t size = mpz_sizeinbase(num, 256) + 8;
+    unsigned char* bytes = malloc(size);
+
+    if (!catcrypt_rng_fill(bytes, size)) {
+        fprintf(stderr, "catcrypt_prime_random_base(): Failed to generate random base.\n");
+        exit(1);
+    }
+
+    // 2 <= base <= num - 2
+    mpz_t range;
+    mpz_init(range);
+    mpz_sub_ui(range, num, 3);
+    mpz_import(base, size, 1, 1, 0, 0, bytes);
+    mpz_mod(base, base, range);
+    mpz_add_ui(base, base, 2);
+    mpz_clear(range);
+
+    free(bytes);
+}
+
+static bool catcrypt_prime_strong_test(catcrypt_mont_t* mont, mp_limb_t* x, mp_limb_t* minus_one, mp_bitcnt_t s, mp_limb_t* tp) {
+    if ((mpn_cmp(x, mont->one, mont->size) == 0) || (mpn_cmp(x, minus_one, mont->size) == 0)) {
+        return true;
+    }
+
+    for (mp_bitcnt_t r = 1; r < s; r++) {
+        catcrypt_mont_sqr(mont, x, x, tp);
+
+        if (mpn_cmp(x, minus_one, mont->size) == 0) {
+            return true;
+        }
+        if (mpn_cmp(x, mont->one, mont->size) == 0) {
+            return false;
+        }
+    }
+
+    return false;
+}
+
+static void catcrypt_prime_lucas_half(mpz_t x, mpz_t num) {
+    if (mpz_odd_p(x)) {
+        mpz_add(x, x, num);
+    }
+    mpz_fdiv_q_2exp(x, x, 1);
+}
+
+static bool catcrypt_prime_test_lucas(mpz_t num) {
+    // Selfridge's method A: first D in 5, -7, 9, -11, ... with (D/num) = -1, P = 1, Q = (1 - D) / 4
+    long d = 5;
+
+    for (int tries = 0;; tries++) {
+        mpz_t d_mpz;
+        mpz_init_set_si(d_mpz, d);
+        int jacobi = mpz_jacobi(d_mpz, num);
+        mpz_clear(d_mpz);
+
+        if (jacobi == -1) {
+            break;
+        }
+        if ((jacobi == 0) && (mpz_cmp_ui(num, labs(d)) != 0)) {
+            return false;
+        }
+        // Squares never find a D
+        if ((tries == 8) && mpz_perfect_square_p(num)) {
+            return false;
+        }
+
+        d = (d > 0) ? -(d + 2): -(d - 2);
+    }
+
+    long q = (1 - d) / 4;
+
+    mpz_t u;
+    mpz_init_set_ui(u, 1);
+    mpz_t v;
+    mpz_init_set_ui(v, 1);
+    mpz_t q_k;
+    mpz_init_set_si(q_k, q);
+    mpz_mod(q_k, q_k, num);
+    mpz_t t;
+    mpz_init(t);
+
+    // num + 1 = k * 2^s
+    mpz_t k;
+    mpz_init(k);
+    mpz_add_ui(k, num, 1);
+    mp_bitcnt_t s = mpz_scan1(k, 0);
+    mpz_fdiv_q_2exp(k, k, s);
+
+    for (mp_bitcnt_t bit = mpz_sizeinbase(k, 2) - 1; bit-- > 0;) {
+        // U_2k = U_k V_k, V_2k = V_k^2 - 2 Q^k
+        mpz_mul(u, u, v);
+        mpz_mod(u, u, num);
+        mpz_mul(v, v, v);
+        mpz_submul_ui(v, q_k, 2);
+        mpz_mod(v, v, num);
+        mpz_mul(q_k, q_k, q_k);
+        mpz_mod(q_k, q_k, num);
+
+        if (mpz_tstbit(k, bit)) {
+            // U_k+1 = (P U_k + V_k) / 2, V_k+1 = (D U_k + P V_k) / 2
+            mpz_mul_si(t, u, d);
+            mpz_add(u, u, v);
+            mpz_mod(u, u, num);
+            catcrypt_prime_lucas_half(u, num);
+            mpz_add(v, v, t);
+            mpz_mod(v, v, num);
+            catcrypt_prime_lucas_half(v, num);
+            mpz_mul_si(q_k, q_k, q);
+            mpz_mod(q_k, q_k, num);
+        }
+    }
+
+    // U_k = 0 or V_(k * 2^r) = 0 for some 0 <= r < s
+    bool is_probable_prime = mpz_sgn(u) == 0;
+
+    for (mp_bitcnt_t r = 0; !is_probable_prime && (r < s); r++) {
+        if (mpz_sgn(v) == 0) {
+            is_probable_prime = true;
+            break;
+        }
+
+        mpz_mul(v, v, v);
+        mpz_submul_ui(v, q_k, 2);
+        mpz_mod(v, v, num);
+        mpz_mul(q_k, q_k, q_k);
+        mpz_mod(q_k, q_k, num);
+    }
+
+    mpz_clear(u);
+    mpz_clear(v);
+    mpz_clear(q_k);
+    mpz_clear(t);
+    mpz_clear(k);
+
+    return is_probable_prime;
+}
+
+static bool catcrypt_prime_test_bpsw(mpz_t num) {
+    size_t bits = mpz_sizeinbase(num, 2);
+
+    catcrypt_mont_t mont;
+    catcrypt_mont_init(&mont, num);
+    mp_size_t size = mont.size;
+
+    // num - 1 = d * 2^s
+    mpz_t d;
+    mpz_init(d);
+    mpz_sub_ui(d, num, 1);
+    mp_bitcnt_t s = mpz_scan1(d, 0);
+    mpz_fdiv_q_2exp(d, d, s);
+
+    mp_limb_t* x = malloc(sizeof(mp_limb_t) * size);
+    mp_limb_t* base = malloc(sizeof(mp_limb_t) * size);
+    mp_limb_t* minus_one = malloc(sizeof(mp_limb_t) * size);
+    mp_limb_t* tp = malloc(sizeof(mp_limb_t) * catcrypt_mont_powm_itch(&mont, bits));
+
+    mpn_sub_n(minus_one, mont.n, mont.one, size);
+
+    catcrypt_mont_powm_2(&mont, x, mpz_limbs_read(d), mpz_size(d), tp);
+    bool is_probable_prime = catcrypt_prime_strong_test(&mont, x, minus_one, s, tp)
+                          && catcrypt_prime_test_lucas(num);
+
+    if (is_probable_prime) {
+        mpz_t random_base;
+        mpz_init(random_base);
+
+        for (int round = catcrypt_prime_mr_rounds(bits); is_probable_prime && (round > 0); round--) {
+            catcrypt_prime_random_base(random_base, num);
+            catcrypt_mont_limbs_from_mpz(base, size, random_base);
+            catcrypt_mont_powm(&mont, x, base, mpz_limbs_read(d), mpz_size(d), tp);
+            is_probable_prime = catcrypt_prime_strong_test(&mont, x, minus_one, s, tp);
+        }
+
+        mpz_clear(random_base);
+    }
+
+    free(x);
+    free(base);
+    free(minus_one);
+    free(tp);
+    mpz_clear(d);
+    catcrypt_mont_clear(&mont);
+
+    return is_probable_prime;
+}
+
+bool catcrypt_prime_test(mpz_t num, catcrypt_prime_mode_t mode) {
+    if (mode == CATCRYPT_PRIME_MODE_PARANOID) {
+        return mpz_probab_prime_p(num, CATCRYPT_PRIME_PARANOID_REPS) != 0;
+    }
+
+    pthread_once(&sieve_primes_once, catcrypt_prime_sieve_primes_init);
+
+    if (mpz_cmp_ui(num, 2) < 0) {
+        return false;
+    }
+    if (mpz_even_p(num)) {
+        return mpz_cmp_ui(num, 2) == 0;
+    }
+
+    for (int i = 0; i < CATCRYPT_PRIME_SIEVE_PRIMES; i++) {
+        if (mpz_divisible_ui_p(num, sieve_primes[i])) {
+            return mpz_cmp_ui(num, sieve_primes[i]) == 0;
+        }
+    }
+
+    uint64_t largest = sieve_primes[CATCRYPT_PRIME_SIEVE_PRIMES - 1];
+    if (mpz_cmp_ui(num, largest * largest) < 0) {
+        return true;
+    }
+
+    return catcrypt_prime_test_bpsw(num);
+}
+
+static bool catcrypt_prime_test__sieved(mpz_t num, catcrypt_prime_mode_t mode) {
+    if (mode == CATCRYPT_PRIME_MODE_PARANOID) {
+        return mpz_probab_prime_p(num, CATCRYPT_PRIME_PARANOID_REPS) != 0;
+    }
+
+    return catcrypt_prime_test_bpsw(num);
+}
+
+bool catcrypt_prime_search(mpz_t num, catcrypt_prime_mode_t mode, catcrypt_prime_stats_t* stats, atomic_bool* cancel) {
+    catcrypt_prime_stats_t local_stats;
+    if (!stats) {
+        stats = &local_stats;
+    }
+
+    pthread_once(&sieve_primes_once, catcrypt_prime_sieve_primes_init);
+
+    mpz_setbit(num, 0);
+
+    // The sieve would throw the small primes themselves away
+    if (mpz_cmp_ui(num, sieve_primes[CATCRYPT_PRIME_SIEVE_PRIMES - 1]) <= 0) {
+        while (!catcrypt_prime_test(num, mode)) {
+            if (cancel && atomic_load(cancel)) {
+                return false;
+            }
+            stats->tested++;
+            mpz_add_ui(num, num, 2);
+        }
+        stats->tested++;
+
+        return true;
+    }
+
+    uint32_t* residues = malloc(sizeof(uint32_t) * CATCRYPT_PRIME_SIEVE_PRIMES);
+    for (int i = 0; i < CATCRYPT_PRIME_SIEVE_PRIMES; i++) {
+        residues[i] = mpz_fdiv_ui(num, sieve_primes[i]);
+    }
+
+    // composite[j] is for num + 2 * j
+    bool composite[CATCRYPT_PRIME_SIEVE_WINDOW];
+
+    mpz_t candidate;
+    mpz_init(candidate);
+
+    for (;;) {
+        memset(composite, 0, sizeof(composite));
+
+        for (int i = 0; i < CATCRYPT_PRIME_SIEVE_PRIMES; i++) {
+            uint32_t prime = sieve_primes[i];
+            // num + 2 * j = 0 (mod prime) => j = (prime - residue) * 2^-1 (mod prime)
+            uint32_t j = (uint32_t) ((((uint64_t) ((prime - residues[i]) % prime)) * ((prime + 1) / 2)) % prime);
+            for (; j < CATCRYPT_PRIME_SIEVE_WINDOW; j += prime) {
+                composite[j] = true;
+            }
+        }
+
+        for (int j = 0; j < CATCRYPT_PRIME_SIEVE_WINDOW; j++) {
+            if (composite[j]) {
+                stats->sieved++;
+                continue;
+            }
+
+            if (cancel && atomic_load(cancel)) {
+                mpz_clear(candidate);
+                free(residues);
+                return false;
+            }
+
+            stats->tested++;
+            mpz_add_ui(candidate, num, 2 * j);
+
+            if (catcrypt_prime_test__sieved(candidate, mode)) {
+                mpz_set(num, candidate);
+                mpz_clear(candidate);
+                free(residues);
+                return true;
+            }
+        }
+
+        mpz_add_ui(num, num, 2 * CATCRYPT_PRIME_SIEVE_WINDOW);
+        for (int i = 0; i < CATCRYPT_PRIME_SIEVE_PRIMES; i++) {
+            residues[i] = (residues[i] + 2 * CATCRYPT_PRIME_SIEVE_WINDOW) % sieve_primes[i];
+        }
+    }
+}
\ No newline at end of file
@@ -13,22 +13,21 @@
 #include "../include/string.h"
 
 void catcrypt_ref_counted_init(catcrypt_ref_counted_t* ref_counted, catcrypt_ref_free_f_t free_f) {
-    ref_counted->count = 0;
+    atomic_init(&ref_counted->count, 0);
     ref_counted->free_f = free_f;
 }
 
 void catcrypt_ref_counted_use(catcrypt_ref_counted_t* ref_counted) {
-    ref_counted->count++;
+    atomic_fetch_add(&ref_counted->count, 1);
 }
 
 void catcrypt_ref_counted_leave(void** obj_vp, catcrypt_ref_counted_t* ref_counted) {
     void* to_free = *obj_vp;
     
-    CATCRYPT_UTIL_ASSERT(ref_counted->count > 0);
-    
-    ref_counted->count--;
+    CATCRYPT_UTIL_ASSERT(atomic_load(&ref_counted->count) > 0);
 
-    if (ref_counted->count == 0) {
+    // Only the thread that takes the last reference frees it
+    if (atomic_fetch_sub(&ref_counted->count, 1) == 1) {
         *obj_vp = NULL;
         ref_counted->free_f(to_free);
     }
@@ -0,0 +1,147 @@
+/*
+ * Catcrypt, simple RSA/PKE for C
+ * Copyright (C) 2023, Oğuzhan Eroğlu <meowingcate@gmail.com> (https://meowingcat.io)
+ * Licensed under GPLv3 License
+ * See LICENSE for more info
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/random.h>
+
+#include "../include/rng.h"
+#include "../include/chacha20.h"
+
+#define CATCRYPT_RNG_BLOCK_SIZE CATCRYPT_CHACHA20_BLOCK_SIZE
+#define CATCRYPT_RNG_KEY_SIZE 32
+
+typedef struct catcrypt_rng_state {
+    bool is_seeded;
+    uint64_t generation;
+    uint32_t key[8];
+    uint64_t counter;
+    size_t since_reseed;
+    size_t available;
+    unsigned char buffer[CATCRYPT_RNG_BUFFER_BLOCKS * CATCRYPT_RNG_BLOCK_SIZE];
+} catcrypt_rng_state_t;
+
+static _Thread_local catcrypt_rng_state_t catcrypt_rng_state;
+
+// Bumped in the child after every fork(), states from an older generation reseed
+static atomic_uint_fast64_t catcrypt_rng_generation = 1;
+static pthread_once_t catcrypt_rng_once = PTHREAD_ONCE_INIT;
+
+static void catcrypt_rng_forked() {
+    atomic_fetch_add(&catcrypt_rng_generation, 1);
+}
+
+static void catcrypt_rng_init_once() {
+    pthread_atfork(NULL, NULL, catcrypt_rng_forked);
+}
+
+static void catcrypt_rng_chacha20_block(const uint32_t key[8], uint64_t counter, unsigned char* out) {
+    uint32_t words[4] = {(uint32_t) counter, (uint32_t) (counter >> 32), 0, 0};
+    catcrypt_chacha20_block(key, words, out);
+}
+
+static bool catcrypt_rng_getrandom(void* buffer, size_t size) {
+    unsigned char* bytes = buffer;
+
+    while (size > 0) {
+        ssize_t bytes_read = getrandom(bytes, size, 0);
+        if (bytes_read < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+
+        bytes += bytes_read;
+        size -= bytes_read;
+    }
+
+    return true;
+}
+
+static bool catcrypt_rng_seed(catcrypt_rng_state_t* state) {
+    pthread_once(&catcrypt_rng_once, catcrypt_rng_init_once);
+
+    if (!catcrypt_rng_getrandom(state->key, sizeof(state->key))) {
+        return false;
+    }
+
+    state->is_seeded = true;
+    state->generation = atomic_load(&catcrypt_rng_generation);
+    state->counter = 0;
+    state->since_reseed = 0;
+    // Buffered bytes came from the old key
+    memset(state->buffer, 0, sizeof(state->buffer));
+    state->available = 0;
+
+    return true;
+}
+
+static void catcrypt_rng_rekey(catcrypt_rng_state_t* state) {
+    for (int i = 0; i < CATCRYPT_RNG_BUFFER_BLOCKS; i++) {
+        catcrypt_rng_chacha20_block(state->key, state->counter++, state->buffer + i * CATCRYPT_RNG_BLOCK_SIZE);
+    }
+
+    // The first bytes become the next key and are never handed out
+    memcpy(state->key, state->buffer, CATCRYPT_RNG_KEY_SIZE);
+    memset(state->buffer, 0, CATCRYPT_RNG_KEY_SIZE);
+    state->counter = 0;
+    state->available = sizeof(state->buffer) - CATCRYPT_RNG_KEY_SIZE;
+}
+
+bool catcrypt_rng_fill(void* buffer, size_t size) {
+    catcrypt_rng_state_t* state = &catcrypt_rng_state;
+    unsigned char* bytes = buffer;
+
+    if (!state->is_seeded
+     || (state->generation != atomic_load(&catcrypt_rng_generation))
+     || (state->since_reseed >= CATCRYPT_RNG_RESEED_BYTES)) {
+        if (!catcrypt_rng_seed(state)) {
+            return false;
+        }
+    }
+
+    state->since_reseed += size;
+
+    // Bulk requests take whole blocks straight from the keystream, then the key is erased
+    if (size >= sizeof(state->buffer)) {
+        while (size >= CATCRYPT_RNG_BLOCK_SIZE) {
+            catcrypt_rng_chacha20_block(state->key, state->counter++, bytes);
+            bytes += CATCRYPT_RNG_BLOCK_SIZE;
+            size -= CATCRYPT_RNG_BLOCK_SIZE;
+        }
+        catcrypt_rng_rekey(state);
+    }
+
+    while (size > 0) {
+        if (state->available == 0) {
+            catcrypt_rng_rekey(state);
+        }
+
+        size_t to_copy = (size < state->available) ? size: state->available;
+        unsigned char* from = state->buffer + sizeof(state->buffer) - state->available;
+
+        memcpy(bytes, from, to_copy);
+        memset(from, 0, to_copy);
+
+        bytes += to_copy;
+        size -= to_copy;
+        state->available -= to_copy;
+    }
+
+    return true;
+}
+
+void catcrypt_rng_reseed() {
+    catcrypt_rng_state.is_seeded = false;
+}
\ No newline at end of file
@@ -18,11 +18,16 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <stdbool.h>
 #include <math.h>
 #include <gmp.h>
 #include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <limits.h>
+#include <sys/uio.h>
 
 #include "../include/rsa.h"
 
@@ -30,452 +35,3147 @@
 #include "../include/ref.h"
 #include "../include/sugar.h"
 #include "../include/string.h"
+#include "../include/prime.h"
+#include "../include/rng.h"
+#include "../include/siphash.h"
+
+void catcrypt_rsa_hash_h32_init(catcrypt_rsa_hash_t* state) {
+    state->hash = 0;
+    state->length = 0;
+    state->prev = 0;
+    state->is_ended = false;
+}
+
+void catcrypt_rsa_hash_h32_update(catcrypt_rsa_hash_t* state, char* data, size_t length) {
+    // The hash ends at the first zero byte, data after it doesn't change the hash
+    for (size_t index = 0; (index < length) && !state->is_ended; index++) {
+        if (data[index] == '\0') {
+            state->is_ended = true;
+            break;
+        }
+
+        int i = state->length++;
+        if (i < sizeof(state->head)) {
+            state->head[i] = data[index];
+        }
+
+        int prev = state->prev;
+        int c = data[index] & 0b01111111;
+        uint8_t mask = ((c % 255) << (((((prev % 2) != 0) ? prev: 1) * i * c) % 7));
+        *(((unsigned char *)(&state->hash)) + ((i * c + prev) % 3)) = ((prev % 2) == 0)
+                                                                    ? mask | prev
+                                                                    : mask & prev;
+        state->prev = (i * c) % 7;
+    }
+}
+
+uint32_t catcrypt_rsa_hash_h32_final(catcrypt_rsa_hash_t* state) {
+    uint32_t hash = state->hash;
+    int remaining = 4 - state->length;
+
+    // Data of less than 4 bytes fills the rest from its own bytes, a step that would take one modulo 0 is skipped
+    for (int i=remaining; (i > 0) && (remaining < 4); i--) {
+        int modulus = (4 - i) % (4 - remaining);
+        if (modulus) {
+            *(((unsigned char *)(&hash)) + ((4 - i) % 4)) = state->head[i % modulus];
+        }
+    }
+
+    return hash;
+}
 
 uint32_t catcrypt_rsa_hash_h32(char* cstr) {
     return catcrypt_rsa_hash_h32__n(cstr, -1);
 }
 
 uint32_t catcrypt_rsa_hash_h32__n(char* data, ssize_t length) {
-    uint32_t hash = 0;
+    catcrypt_rsa_hash_t state;
+    catcrypt_rsa_hash_h32_init(&state);
+    catcrypt_rsa_hash_h32_update(&state, data, (length == -1) ? strlen(data): length);
+    return catcrypt_rsa_hash_h32_final(&state);
+}
 
-    int remaining = 4;
-    int prev = 0;
+uint32_t catcrypt_rsa_hash_h32__iov(struct iovec* iov, int count) {
+    catcrypt_rsa_hash_t state;
+    catcrypt_rsa_hash_h32_init(&state);
+    for (int i = 0; i < count; i++) {
+        catcrypt_rsa_hash_h32_update(&state, iov[i].iov_base, iov[i].iov_len);
+    }
 
-    for (int i=0; (length == -1) ? (i < length): (data[i] != '\0'); i++) {
-        remaining--;
-        int c = data[i] & 0b01111111;
-        uint8_t mask = ((c % 255) << (((((prev % 2) != 0) ? prev: 1) * i * c) % 7));
-        *(((unsigned char *)(&hash)) + ((i * c + prev) % 3)) = ((prev % 2) == 0)
-                                                             ? mask | prev
-                                                             : mask & prev;
-        prev = (i * c) % 7;
+    return catcrypt_rsa_hash_h32_final(&state);
+}
+
+bool catcrypt_rsa_random_seed(unsigned char* seed, size_t size) {
+    return catcrypt_rng_fill(seed, size);
+}
+
+void catcrypt_rsa_random_prime(mpz_t num) {
+    catcrypt_rsa_random_prime__stats(num, NULL);
+}
+
+/**
+ * One random number of exactly bits bits. The top two bits are set so a product of two
+ * such primes has exactly the sum of their sizes, the low bit makes it odd.
+ */
+static void catcrypt_rsa_random_prime_candidate(mpz_t num, size_t bits) {
+    size_t seed_size = (bits + 7) / 8;
+    unsigned char* seed = malloc(seed_size);
+
+    if (!catcrypt_rng_fill(seed, seed_size)) {
+        fprintf(stderr, "catcrypt_rsa_random_prime(): Failed to generate random seed.\n");
+        exit(1);
+    }
+    mpz_import(num, seed_size, 1, sizeof(seed[0]), 0, 0, seed);
+    free(seed);
+
+    mpz_tdiv_r_2exp(num, num, bits);
+    mpz_setbit(num, bits - 1);
+    mpz_setbit(num, bits - 2);
+    mpz_setbit(num, 0);
+}
+
+void catcrypt_rsa_random_prime__stats(mpz_t num, catcrypt_prime_stats_t* stats) {
+    catcrypt_rsa_random_prime__mode(num, CATCRYPT_RSA_PRIME_MODE, stats);
+}
+
+void catcrypt_rsa_random_prime__mode(mpz_t num, catcrypt_prime_mode_t mode, catcrypt_prime_stats_t* stats) {
+    // The search only goes up, a prime past 2^bits (practically never) is drawn again
+    do {
+        catcrypt_rsa_random_prime_candidate(num, CATCRYPT_RSA_PRIME_BITS);
+        catcrypt_prime_search(num, mode, stats, NULL);
+    } while (mpz_sizeinbase(num, 2) > CATCRYPT_RSA_PRIME_BITS);
+}
+
+static void catcrypt_rsa_blinding_free(catcrypt_rsa_blinding_t* blinding) {
+    pthread_mutex_destroy(&blinding->mutex);
+    mpz_clear(blinding->e);
+    for (int i = 0; i < CATCRYPT_RSA_BLINDING_PAIRS; i++) {
+        mpz_clear(blinding->forward[i]);
+        mpz_clear(blinding->inverse[i]);
+    }
+    free(blinding);
+}
+
+/**
+ * NULL if the key doesn't have its primes, e can't be recovered without them.
+ */
+static catcrypt_rsa_blinding_t* catcrypt_rsa_blinding_new(catcrypt_rsa_key_t* key) {
+    if (!key->is_crt) {
+        return NULL;
+    }
+
+    mpz_t phi;
+    mpz_init(phi);
+    mpz_t pmo;
+    mpz_init(pmo);
+
+    mpz_sub_ui(phi, key->p, 1);
+    mpz_sub_ui(pmo, key->q, 1);
+    mpz_mul(phi, phi, pmo);
+    for (int i = 0; i < (key->primes - 2); i++) {
+        mpz_sub_ui(pmo, key->extra_primes[i].r, 1);
+        mpz_mul(phi, phi, pmo);
+    }
+
+    catcrypt_rsa_blinding_t* blinding = malloc(sizeof(catcrypt_rsa_blinding_t));
+    pthread_mutex_init(&blinding->mutex, NULL);
+    mpz_init(blinding->e);
+    blinding->length = 0;
+    for (int i = 0; i < CATCRYPT_RSA_BLINDING_PAIRS; i++) {
+        mpz_init(blinding->forward[i]);
+        mpz_init(blinding->inverse[i]);
+    }
+
+    bool is_invertible = mpz_invert(blinding->e, key->e, phi);
+
+    mpz_clear(phi);
+    mpz_clear(pmo);
+
+    if (!is_invertible) {
+        catcrypt_rsa_blinding_free(blinding);
+        return NULL;
+    }
+
+    return blinding;
+}
+
+static void catcrypt_rsa_blinding_refill(catcrypt_rsa_blinding_t* blinding, mpz_t n) {
+    size_t size = mpz_sizeinbase(n, 256) + 8;
+    unsigned char* bytes = malloc(size);
+
+    mpz_t prefix[CATCRYPT_RSA_BLINDING_PAIRS];
+    for (int i = 0; i < CATCRYPT_RSA_BLINDING_PAIRS; i++) {
+        mpz_init(prefix[i]);
+    }
+    mpz_t inverse;
+    mpz_init(inverse);
+
+    // r goes into forward for now, prefix[i] = r_0 * ... * r_i
+    do {
+        for (int i = 0; i < CATCRYPT_RSA_BLINDING_PAIRS; i++) {
+            do {
+                if (!catcrypt_rng_fill(bytes, size)) {
+                    fprintf(stderr, "catcrypt_rsa_blinding_refill(): Failed to generate random blinding factor.\n");
+                    exit(1);
+                }
+                mpz_import(blinding->forward[i], size, 1, 1, 0, 0, bytes);
+                mpz_mod(blinding->forward[i], blinding->forward[i], n);
+            } while (mpz_sgn(blinding->forward[i]) == 0);
+
+            if (i == 0) {
+                mpz_set(prefix[i], blinding->forward[i]);
+            } else {
+                mpz_mul(prefix[i], prefix[i - 1], blinding->forward[i]);
+                mpz_mod(prefix[i], prefix[i], n);
+            }
+        }
+    // Only an r that shares a factor with n has no inverse, then n is factored anyway
+    } while (!mpz_invert(inverse, prefix[CATCRYPT_RSA_BLINDING_PAIRS - 1], n));
+
+    // One inversion for all: r_i^-1 = (r_0 * ... * r_i)^-1 * (r_0 * ... * r_(i-1))
+    for (int i = CATCRYPT_RSA_BLINDING_PAIRS - 1; i > 0; i--) {
+        mpz_mul(blinding->inverse[i], inverse, prefix[i - 1]);
+        mpz_mod(blinding->inverse[i], blinding->inverse[i], n);
+        mpz_mul(inverse, inverse, blinding->forward[i]);
+        mpz_mod(inverse, inverse, n);
+    }
+    mpz_set(blinding->inverse[0], inverse);
+
+    for (int i = 0; i < CATCRYPT_RSA_BLINDING_PAIRS; i++) {
+        mpz_powm(blinding->forward[i], blinding->forward[i], blinding->e, n);
+        mpz_clear(prefix[i]);
+    }
+    blinding->length = CATCRYPT_RSA_BLINDING_PAIRS;
+
+    mpz_clear(inverse);
+    free(bytes);
+}
+
+static void catcrypt_rsa_blinding_take(catcrypt_rsa_blinding_t* blinding, mpz_t n, mpz_t forward, mpz_t inverse) {
+    pthread_mutex_lock(&blinding->mutex);
+
+    if (blinding->length == 0) {
+        catcrypt_rsa_blinding_refill(blinding, n);
+    }
+
+    blinding->length--;
+    mpz_swap(forward, blinding->forward[blinding->length]);
+    mpz_swap(inverse, blinding->inverse[blinding->length]);
+
+    pthread_mutex_unlock(&blinding->mutex);
+}
+
+static void catcrypt_rsa_blinding_give_back(catcrypt_rsa_blinding_t* blinding, mpz_t n, mpz_t forward, mpz_t inverse) {
+    // r -> r^2, a used pair is never used again
+    mpz_mul(forward, forward, forward);
+    mpz_mod(forward, forward, n);
+    mpz_mul(inverse, inverse, inverse);
+    mpz_mod(inverse, inverse, n);
+
+    pthread_mutex_lock(&blinding->mutex);
+
+    if (blinding->length < CATCRYPT_RSA_BLINDING_PAIRS) {
+        mpz_swap(forward, blinding->forward[blinding->length]);
+        mpz_swap(inverse, blinding->inverse[blinding->length]);
+        blinding->length++;
+    }
+
+    pthread_mutex_unlock(&blinding->mutex);
+}
+
+static catcrypt_rsa_blinding_t* catcrypt_rsa_key_get_blinding(catcrypt_rsa_key_t* key) {
+    catcrypt_rsa_blinding_t* blinding = atomic_load(&key->blinding);
+    if (blinding) {
+        return blinding;
+    }
+
+    blinding = catcrypt_rsa_blinding_new(key);
+    if (!blinding) {
+        return NULL;
+    }
+
+    catcrypt_rsa_blinding_t* expected = NULL;
+    if (!atomic_compare_exchange_strong(&key->blinding, &expected, blinding)) {
+        catcrypt_rsa_blinding_free(blinding);
+        return expected;
+    }
+
+    return blinding;
+}
+
+catcrypt_rsa_key_t* catcrypt_rsa_key_new() {
+    catcrypt_rsa_key_t* key = malloc(sizeof(catcrypt_rsa_key_t));
+    CATCRYPT_REF_COUNTED_INIT(key, catcrypt_rsa_key_free);
+    CATCRYPT_REF_COUNTED_USE(key);
+    
+    mpz_init(key->e);
+    mpz_init(key->n);
+
+    key->bits = 0;
+    key->flags = 0;
+
+    key->is_crt = false;
+    mpz_init(key->p);
+    mpz_init(key->q);
+    mpz_init(key->dp);
+    mpz_init(key->dq);
+    mpz_init(key->qinv);
+
+    key->primes = 2;
+    atomic_init(&key->prepared, NULL);
+    atomic_init(&key->blinding, NULL);
+    atomic_init(&key->public_e, 0);
+    for (int i = 0; i < (CATCRYPT_RSA_MAX_PRIMES - 2); i++) {
+        mpz_init(key->extra_primes[i].r);
+        mpz_init(key->extra_primes[i].d);
+        mpz_init(key->extra_primes[i].t);
+    }
+
+    return key;
+}
+
+void catcrypt_rsa_key_free(catcrypt_rsa_key_t* key) {
+    mpz_clear(key->e);
+    mpz_clear(key->n);
+    mpz_clear(key->p);
+    mpz_clear(key->q);
+    mpz_clear(key->dp);
+    mpz_clear(key->dq);
+    mpz_clear(key->qinv);
+    for (int i = 0; i < (CATCRYPT_RSA_MAX_PRIMES - 2); i++) {
+        mpz_clear(key->extra_primes[i].r);
+        mpz_clear(key->extra_primes[i].d);
+        mpz_clear(key->extra_primes[i].t);
+    }
+
+    catcrypt_rsa_prepared_t* prepared = atomic_load(&key->prepared);
+    if (prepared) {
+        catcrypt_mont_clear(&prepared->mont);
+        catcrypt_mont_exponent_clear(&prepared->exponent);
+        free(prepared);
+    }
+
+    catcrypt_rsa_blinding_t* blinding = atomic_load(&key->blinding);
+    if (blinding) {
+        catcrypt_rsa_blinding_free(blinding);
+    }
+
+    free(key);
+}
+
+size_t catcrypt_rsa_key_bits(catcrypt_rsa_key_t* key) {
+    return key->bits ? key->bits: mpz_sizeinbase(key->n, 2);
+}
+
+size_t catcrypt_rsa_key_size(catcrypt_rsa_key_t* key) {
+    return (catcrypt_rsa_key_bits(key) + 7) / 8;
+}
+
+/**
+ * A block of key_size - 1 bytes is always below n, the header's u16 caps it for huge keys.
+ */
+static size_t catcrypt_rsa_full_block_size(size_t key_size) {
+    return ((key_size - 1) < UINT16_MAX) ? (key_size - 1): UINT16_MAX;
+}
+
+size_t catcrypt_rsa_key_block_size(catcrypt_rsa_key_t* key) {
+    return catcrypt_rsa_full_block_size(catcrypt_rsa_key_size(key));
+}
+
+uint64_t catcrypt_rsa_key_fingerprint(catcrypt_rsa_key_t* key) {
+    catcrypt_siphash_t state;
+    catcrypt_siphash_init(&state, 0, 0);
+
+    // The bytes are taken from the limbs a chunk at a time, verification doesn't allocate for it
+    size_t key_size = catcrypt_rsa_key_size(key);
+    const mp_limb_t* limbs = mpz_limbs_read(key->n);
+    size_t limbs_count = mpz_size(key->n);
+    unsigned char chunk[64];
+
+    for (size_t i = key_size; i > 0;) {
+        size_t chunk_size = (i < sizeof(chunk)) ? i: sizeof(chunk);
+
+        for (size_t j = 0; j < chunk_size; j++, i--) {
+            size_t limb = (i - 1) / sizeof(mp_limb_t);
+            chunk[j] = (limb < limbs_count) ? (unsigned char) (limbs[limb] >> (8 * ((i - 1) % sizeof(mp_limb_t)))): 0;
+        }
+
+        catcrypt_siphash_update(&state, chunk, chunk_size);
+    }
+
+    uint64_t fingerprint[2];
+    catcrypt_siphash_final(&state, fingerprint);
+
+    return fingerprint[0];
+}
+
+bool catcrypt_rsa_key_prepare(catcrypt_rsa_key_t* key) {
+    if (atomic_load(&key->prepared)) {
+        return true;
+    }
+
+    // mpz_powm() is still faster than the context for long private exponents, only public exponents are prepared
+    if (key->is_crt || (mpz_sizeinbase(key->e, 2) > CATCRYPT_RSA_PREPARED_EXPONENT_BITS) || !mpz_odd_p(key->n)) {
+        return false;
+    }
+
+    catcrypt_rsa_prepared_t* prepared = malloc(sizeof(catcrypt_rsa_prepared_t));
+    catcrypt_mont_init(&prepared->mont, key->n);
+    catcrypt_mont_exponent_init(&prepared->exponent, key->e);
+    prepared->small_e = mpz_fits_ulong_p(key->e) ? mpz_get_ui(key->e): 0;
+
+    // Another thread may have prepared the key in the meantime, the first context wins
+    catcrypt_rsa_prepared_t* expected = NULL;
+    if (!atomic_compare_exchange_strong(&key->prepared, &expected, prepared)) {
+        catcrypt_mont_clear(&prepared->mont);
+        catcrypt_mont_exponent_clear(&prepared->exponent);
+        free(prepared);
+    }
+
+    return true;
+}
+
+static pthread_once_t catcrypt_rsa_sec_once = PTHREAD_ONCE_INIT;
+static pthread_key_t catcrypt_rsa_sec_scratch_key;
+static _Thread_local mp_limb_t* catcrypt_rsa_sec_scratch = NULL;
+static _Thread_local mp_size_t catcrypt_rsa_sec_scratch_size = 0;
+
+static void catcrypt_rsa_sec_init_once() {
+    // Frees a thread's scratch when the thread exits
+    pthread_key_create(&catcrypt_rsa_sec_scratch_key, free);
+}
+
+/**
+ * Scratch of the calling thread, it only grows (once per key size) and is reused by every private operation,
+ * verification and prepared exponentiation (none of them calls another while it holds it).
+ */
+static mp_limb_t* catcrypt_rsa_sec_get_scratch(mp_size_t size) {
+    if (size > catcrypt_rsa_sec_scratch_size) {
+        pthread_once(&catcrypt_rsa_sec_once, catcrypt_rsa_sec_init_once);
+
+        free(catcrypt_rsa_sec_scratch);
+        catcrypt_rsa_sec_scratch = malloc(sizeof(mp_limb_t) * size);
+        catcrypt_rsa_sec_scratch_size = size;
+        pthread_setspecific(catcrypt_rsa_sec_scratch_key, catcrypt_rsa_sec_scratch);
+    }
+
+    return catcrypt_rsa_sec_scratch;
+}
+
+static void catcrypt_rsa_prepared_powm(mpz_t rop, mpz_t base, catcrypt_rsa_prepared_t* prepared) {
+    catcrypt_mont_t* mont = &prepared->mont;
+    mp_size_t size = mont->size;
+
+    mp_limb_t* limbs = catcrypt_rsa_sec_get_scratch(2 * size + catcrypt_mont_powm_exponent_itch(mont, &prepared->exponent));
+    mp_limb_t* bp = limbs;
+    mp_limb_t* rp = limbs + size;
+    mp_limb_t* tp = limbs + 2 * size;
+
+    catcrypt_mont_limbs_from_mpz(bp, size, base);
+    if (prepared->small_e) {
+        catcrypt_mont_powm_ui(mont, rp, bp, prepared->small_e, tp);
+    } else {
+        catcrypt_mont_powm_exponent(mont, rp, bp, &prepared->exponent, tp);
+        catcrypt_mont_from(mont, rp, rp, tp);
+    }
+    catcrypt_mont_limbs_to_mpz(rop, rp, size);
+}
+
+static mp_size_t catcrypt_rsa_sec_prime_size(catcrypt_rsa_key_t* key) {
+    if (!key->is_crt) {
+        return mpz_size(key->n);
+    }
+
+    mp_size_t size = (mpz_size(key->p) > mpz_size(key->q)) ? mpz_size(key->p): mpz_size(key->q);
+    for (int i = 0; i < (key->primes - 2); i++) {
+        if (mpz_size(key->extra_primes[i].r) > size) {
+            size = mpz_size(key->extra_primes[i].r);
+        }
+    }
+
+    return size;
+}
+
+/**
+ * Limbs that catcrypt_rsa_key_sec_powm() needs for the key: six prime-size buffers,
+ * four for the Garner accumulators and products, and what the mpn_sec_* functions ask for.
+ */
+static mp_size_t catcrypt_rsa_sec_itch(catcrypt_rsa_key_t* key) {
+    mp_size_t size = mpz_size(key->n);
+    mp_size_t prime_size = catcrypt_rsa_sec_prime_size(key);
+    mp_size_t wide_size = size + 2 * prime_size + CATCRYPT_RSA_MAX_PRIMES;
+
+    mp_size_t itch = mpn_sec_powm_itch(size, prime_size * GMP_NUMB_BITS, prime_size);
+    mp_size_t div_itch = mpn_sec_div_r_itch(wide_size, prime_size);
+    mp_size_t mul_itch = mpn_sec_mul_itch(wide_size, prime_size);
+    itch = (div_itch > itch) ? div_itch: itch;
+    itch = (mul_itch > itch) ? mul_itch: itch;
+
+    return 6 * prime_size + 4 * wide_size + itch;
+}
+
+static void catcrypt_rsa_sec_mul(mp_limb_t* rp, const mp_limb_t* ap, mp_size_t an, const mp_limb_t* bp, mp_size_t bn, mp_limb_t* tp) {
+    if (an >= bn) {
+        mpn_sec_mul(rp, ap, an, bp, bn, tp);
+    } else {
+        mpn_sec_mul(rp, bp, bn, ap, an, tp);
+    }
+}
+
+/**
+ * rp = {ap, an} mod m, cp is a copy of ap because mpn_sec_div_r() overwrites its input
+ */
+static void catcrypt_rsa_sec_mod(mp_limb_t* rp, const mp_limb_t* ap, mp_size_t an, mpz_t m, mp_limb_t* cp, mp_limb_t* tp) {
+    mp_size_t mn = mpz_size(m);
+
+    if (an < mn) {
+        mpn_copyi(rp, ap, an);
+        mpn_zero(rp + an, mn - an);
+        return;
+    }
+
+    mpn_copyi(cp, ap, an);
+    mpn_sec_div_r(cp, an, mpz_limbs_read(m), mn, tp);
+    mpn_copyi(rp, cp, mn);
+}
+
+/**
+ * rp = {bp, bn} ^ exponent mod modulus. The exponent is padded to the size of the modulus,
+ * so neither its length nor its bits change the sequence of operations.
+ */
+static void catcrypt_rsa_sec_powm_prime(mp_limb_t* rp, const mp_limb_t* bp, mp_size_t bn, mpz_t exponent, mpz_t modulus, mp_limb_t* ep, mp_limb_t* tp) {
+    mp_size_t mn = mpz_size(modulus);
+
+    catcrypt_mont_limbs_from_mpz(ep, mn, exponent);
+    mpn_sec_powm(rp, bp, bn, ep, mpz_sizeinbase(modulus, 2), mpz_limbs_read(modulus), mn, tp);
+}
+
+/**
+ * One Garner step: acc = acc + product * ((mi - acc) * coefficient mod prime),
+ * product = product * prime. coefficient is product^-1 mod prime.
+ */
+static void catcrypt_rsa_sec_garner(mp_limb_t* acc, mp_size_t* acc_size, mp_limb_t* product, mp_size_t* product_size,
+                                    mp_limb_t* mi, mpz_t prime, mpz_t coefficient, mp_limb_t* buffers, mp_limb_t* wide, mp_limb_t* tp) {
+    mp_size_t pn = mpz_size(prime);
+    const mp_limb_t* pp = mpz_limbs_read(prime);
+
+    // reduced and difference are also the 2 * pn limbs copy for the last reduction, both are used up by then
+    mp_limb_t* reduced = buffers;
+    mp_limb_t* difference = buffers + pn;
+    mp_limb_t* factor = buffers + 2 * pn;
+    mp_limb_t* h = buffers + 3 * pn;
+
+    catcrypt_rsa_sec_mod(reduced, acc, *acc_size, prime, wide, tp);
+    mp_limb_t borrow = mpn_sub_n(difference, mi, reduced, pn);
+    mpn_cnd_add_n(borrow, difference, difference, pp, pn);
+
+    catcrypt_mont_limbs_from_mpz(factor, pn, coefficient);
+    mpn_sec_mul(wide, difference, pn, factor, pn, tp);
+    catcrypt_rsa_sec_mod(h, wide, 2 * pn, prime, reduced, tp);
+
+    mp_size_t size = *product_size + pn;
+
+    catcrypt_rsa_sec_mul(wide, product, *product_size, h, pn, tp);
+    mpn_zero(acc + *acc_size, size - *acc_size);
+    mpn_add_n(acc, acc, wide, size);
+    *acc_size = size;
+
+    catcrypt_rsa_sec_mul(wide, product, *product_size, pp, pn, tp);
+    mpn_copyi(product, wide, size);
+    *product_size = size;
+}
+
+/**
+ * Private key operation with mpn_sec_powm() and mpn_sec_* arithmetic for the CRT recombination,
+ * the sequence of operations and memory accesses only depends on the sizes of the key.
+ */
+static void catcrypt_rsa_key_sec_powm(mpz_t rop, mpz_t base, catcrypt_rsa_key_t* key) {
+    mpz_srcptr reduced_base = base;
+    mpz_t base_mod_n;
+
+    // The ciphertext is public, reducing it in variable time leaks nothing
+    if ((mpz_sgn(base) < 0) || (mpz_cmp(base, key->n) >= 0)) {
+        mpz_init(base_mod_n);
+        mpz_mod(base_mod_n, base, key->n);
+        reduced_base = base_mod_n;
+    }
+
+    if (mpz_sgn(reduced_base) == 0) {
+        mpz_set_ui(rop, 0);
+    } else {
+        mp_size_t size = mpz_size(key->n);
+        mp_size_t prime_size = catcrypt_rsa_sec_prime_size(key);
+        mp_size_t wide_size = size + 2 * prime_size + CATCRYPT_RSA_MAX_PRIMES;
+
+        mp_limb_t* scratch = catcrypt_rsa_sec_get_scratch(catcrypt_rsa_sec_itch(key));
+        mp_limb_t* ep = scratch;
+        mp_limb_t* mi = ep + prime_size;
+        mp_limb_t* buffers = mi + prime_size;
+        mp_limb_t* acc = buffers + 4 * prime_size;
+        mp_limb_t* product = acc + wide_size;
+        mp_limb_t* wide = product + wide_size;
+        mp_limb_t* tp = wide + 2 * wide_size;
+
+        const mp_limb_t* bp = mpz_limbs_read(reduced_base);
+        mp_size_t bn = mpz_size(reduced_base);
+        mp_size_t acc_size;
+
+        if (!key->is_crt) {
+            catcrypt_rsa_sec_powm_prime(acc, bp, bn, key->e, key->n, ep, tp);
+            acc_size = size;
+        } else {
+            // acc = m2, product = q, then the Garner step with p makes it m (mod p * q)
+            mp_size_t qn = mpz_size(key->q);
+            catcrypt_rsa_sec_powm_prime(acc, bp, bn, key->dq, key->q, ep, tp);
+            acc_size = qn;
+            mpn_copyi(product, mpz_limbs_read(key->q), qn);
+            mp_size_t product_size = qn;
+
+            catcrypt_rsa_sec_powm_prime(mi, bp, bn, key->dp, key->p, ep, tp);
+            catcrypt_rsa_sec_garner(acc, &acc_size, product, &product_size, mi, key->p, key->qinv, buffers, wide, tp);
+
+            for (int i = 0; i < (key->primes - 2); i++) {
+                catcrypt_rsa_crt_prime_t* prime = &key->extra_primes[i];
+
+                catcrypt_rsa_sec_powm_prime(mi, bp, bn, prime->d, prime->r, ep, tp);
+                catcrypt_rsa_sec_garner(acc, &acc_size, product, &product_size, mi, prime->r, prime->t, buffers, wide, tp);
+            }
+        }
+
+        catcrypt_mont_limbs_to_mpz(rop, acc, acc_size);
+    }
+
+    if (reduced_base != base) {
+        mpz_clear(base_mod_n);
+    }
+}
+
+static void catcrypt_rsa_key_powm_unblinded(mpz_t rop, mpz_t base, catcrypt_rsa_key_t* key) {
+    if (key->flags & CATCRYPT_RSA_FLAG_CONSTANT_TIME) {
+        catcrypt_rsa_key_sec_powm(rop, base, key);
+        return;
     }
 
-    for (int i=remaining; i > 0; i--) {
-        *(((unsigned char *)(&hash)) + ((4 - i) % 4)) = data[i % ((4 - i) % (4 - remaining))];
-    }
+    catcrypt_rsa_prepared_t* prepared = atomic_load_explicit(&key->prepared, memory_order_acquire);
+
+    // Anything that isn't below n (only a bad signature can be) goes the slow way
+    if (prepared && (mpz_sgn(base) >= 0) && (mpz_cmp(base, key->n) < 0)) {
+        catcrypt_rsa_prepared_powm(rop, base, prepared);
+        return;
+    }
+
+    if (!key->is_crt) {
+        mpz_powm(rop, base, key->e, key->n);
+        return;
+    }
+
+    mpz_t m1;
+    mpz_init(m1);
+    mpz_t m2;
+    mpz_init(m2);
+    mpz_t h;
+    mpz_init(h);
+
+    mpz_mod(m1, base, key->p);
+    mpz_powm(m1, m1, key->dp, key->p);
+    mpz_mod(m2, base, key->q);
+    mpz_powm(m2, m2, key->dq, key->q);
+
+    // Garner: m = m2 + q * (qinv * (m1 - m2) mod p)
+    mpz_sub(h, m1, m2);
+    mpz_mul(h, h, key->qinv);
+    mpz_mod(h, h, key->p);
+    mpz_mul(h, h, key->q);
+    mpz_add(rop, m2, h);
+
+    if (key->primes > 2) {
+        // m1 is the product of the primes so far
+        mpz_mul(m1, key->p, key->q);
+
+        for (int i = 0; i < (key->primes - 2); i++) {
+            catcrypt_rsa_crt_prime_t* prime = &key->extra_primes[i];
+
+            mpz_mod(m2, base, prime->r);
+            mpz_powm(m2, m2, prime->d, prime->r);
+
+            // m = m + (p * q * ...) * (t * (m_i - m) mod r)
+            mpz_sub(h, m2, rop);
+            mpz_mul(h, h, prime->t);
+            mpz_mod(h, h, prime->r);
+            mpz_mul(h, h, m1);
+            mpz_add(rop, rop, h);
+
+            mpz_mul(m1, m1, prime->r);
+        }
+    }
+
+    mpz_clear(m1);
+    mpz_clear(m2);
+    mpz_clear(h);
+}
+
+/**
+ * The public exponent of a private key, 0 if it can't be used in a batch.
+ * It is the same every time, threads that find it at the same time store the same value.
+ */
+static unsigned long catcrypt_rsa_key_public_exponent(catcrypt_rsa_key_t* key) {
+    unsigned long e = atomic_load_explicit(&key->public_e, memory_order_relaxed);
+    if (e || !key->is_crt) {
+        return (e == 1) ? 0: e;
+    }
+
+    mpz_t phi;
+    mpz_init(phi);
+    mpz_t pmo;
+    mpz_init(pmo);
+
+    mpz_sub_ui(phi, key->p, 1);
+    mpz_sub_ui(pmo, key->q, 1);
+    mpz_mul(phi, phi, pmo);
+    for (int i = 0; i < (key->primes - 2); i++) {
+        mpz_sub_ui(pmo, key->extra_primes[i].r, 1);
+        mpz_mul(phi, phi, pmo);
+    }
+
+    e = (mpz_invert(pmo, key->e, phi) && mpz_fits_ulong_p(pmo)) ? mpz_get_ui(pmo): 1;
+    atomic_store_explicit(&key->public_e, e, memory_order_relaxed);
+
+    mpz_clear(phi);
+    mpz_clear(pmo);
+
+    return (e == 1) ? 0: e;
+}
+
+/**
+ * A CRT result that doesn't give base back under the public exponent (a fault in one of the primes) would give
+ * a factor of n away through gcd(rop^e - base, n), it is computed again without CRT.
+ * Keys whose public exponent doesn't fit in an unsigned long can't be checked and always go without CRT.
+ */
+static void catcrypt_rsa_key_powm_checked(mpz_t rop, mpz_t base, catcrypt_rsa_key_t* key) {
+    catcrypt_rsa_key_powm_unblinded(rop, base, key);
+    if (!key->is_crt) {
+        return;
+    }
+
+    unsigned long e = catcrypt_rsa_key_public_exponent(key);
+
+    mpz_t check;
+    mpz_init(check);
+    mpz_t expected;
+    mpz_init(expected);
+
+    if (e) {
+        mpz_powm_ui(check, rop, e, key->n);
+        mpz_mod(expected, base, key->n);
+    }
+
+    if (!e || (mpz_cmp(check, expected) != 0)) {
+        if (key->flags & CATCRYPT_RSA_FLAG_CONSTANT_TIME) {
+            mpz_powm_sec(rop, base, key->e, key->n);
+        } else {
+            mpz_powm(rop, base, key->e, key->n);
+        }
+    }
+
+    mpz_clear(check);
+    mpz_clear(expected);
+}
+
+void catcrypt_rsa_key_powm(mpz_t rop, mpz_t base, catcrypt_rsa_key_t* key) {
+    catcrypt_rsa_blinding_t* blinding = (key->flags & CATCRYPT_RSA_FLAG_BLINDING) ? catcrypt_rsa_key_get_blinding(key): NULL;
+    if (!blinding) {
+        catcrypt_rsa_key_powm_checked(rop, base, key);
+        return;
+    }
+
+    mpz_t forward;
+    mpz_init(forward);
+    mpz_t inverse;
+    mpz_init(inverse);
+    mpz_t blinded;
+    mpz_init(blinded);
+
+    catcrypt_rsa_blinding_take(blinding, key->n, forward, inverse);
+
+    // (base * r^e)^d = base^d * r
+    mpz_mul(blinded, base, forward);
+    mpz_mod(blinded, blinded, key->n);
+    catcrypt_rsa_key_powm_checked(rop, blinded, key);
+    mpz_mul(rop, rop, inverse);
+    mpz_mod(rop, rop, key->n);
+
+    catcrypt_rsa_blinding_give_back(blinding, key->n, forward, inverse);
+
+    mpz_clear(forward);
+    mpz_clear(inverse);
+    mpz_clear(blinded);
+}
+
+/**
+ * A node of the batch product tree: e is the product of the exponents below it,
+ * v is the product of every base below it raised to e / (its own exponent).
+ */
+typedef struct catcrypt_rsa_batch_node {
+    mpz_t e;
+    mpz_t v;
+} catcrypt_rsa_batch_node_t;
+
+static void catcrypt_rsa_batch_up(catcrypt_rsa_batch_node_t* nodes, int node, int low, int high,
+                                  mpz_ptr* bases, unsigned long* exponents, mpz_t n, mpz_t tmp) {
+    catcrypt_rsa_batch_node_t* self = &nodes[node];
+
+    if ((high - low) == 1) {
+        mpz_set_ui(self->e, exponents[low]);
+        mpz_set(self->v, bases[low]);
+        return;
+    }
+
+    int middle = (low + high) / 2;
+    catcrypt_rsa_batch_node_t* left = &nodes[node * 2];
+    catcrypt_rsa_batch_node_t* right = &nodes[(node * 2) + 1];
+
+    catcrypt_rsa_batch_up(nodes, node * 2, low, middle, bases, exponents, n, tmp);
+    catcrypt_rsa_batch_up(nodes, (node * 2) + 1, middle, high, bases, exponents, n, tmp);
+
+    // v = v_left ^ e_right * v_right ^ e_left
+    mpz_mul(self->e, left->e, right->e);
+    mpz_powm(tmp, left->v, right->e, n);
+    mpz_powm(self->v, right->v, left->e, n);
+    mpz_mul(self->v, self->v, tmp);
+    mpz_mod(self->v, self->v, n);
+}
+
+/**
+ * Splits m = m_left * m_right (m_left ^ e_left = v_left, m_right ^ e_right = v_right) with
+ * X = 0 mod e_left, X = 1 mod e_right: m ^ X = v_left ^ (X / e_left) * m_right * v_right ^ ((X - 1) / e_right).
+ * false if something on the way isn't invertible mod n.
+ */
+static bool catcrypt_rsa_batch_down(catcrypt_rsa_batch_node_t* nodes, int node, int low, int high,
+                                    mpz_t m, mpz_t* rops, mpz_t n) {
+    if ((high - low) == 1) {
+        mpz_set(rops[low], m);
+        return true;
+    }
+
+    int middle = (low + high) / 2;
+    catcrypt_rsa_batch_node_t* left = &nodes[node * 2];
+    catcrypt_rsa_batch_node_t* right = &nodes[(node * 2) + 1];
+
+    mpz_t a;
+    mpz_init(a);
+    mpz_t b;
+    mpz_init(b);
+    mpz_t x;
+    mpz_init(x);
+    mpz_t m_left;
+    mpz_init(m_left);
+    mpz_t m_right;
+    mpz_init(m_right);
+
+    // a = X / e_left, b = (X - 1) / e_right
+    CATCRYPT_UTIL_ASSERT(mpz_invert(a, left->e, right->e));
+    mpz_mul(x, a, left->e);
+    mpz_sub_ui(b, x, 1);
+    mpz_divexact(b, b, right->e);
+
+    mpz_powm(m_right, m, x, n);
+    mpz_powm(a, left->v, a, n);
+    mpz_powm(b, right->v, b, n);
+    mpz_mul(a, a, b);
+    mpz_mod(a, a, n);
+
+    bool is_split = mpz_invert(a, a, n);
+    if (is_split) {
+        mpz_mul(m_right, m_right, a);
+        mpz_mod(m_right, m_right, n);
+
+        is_split = mpz_invert(m_left, m_right, n);
+    }
+    if (is_split) {
+        mpz_mul(m_left, m_left, m);
+        mpz_mod(m_left, m_left, n);
+
+        is_split = catcrypt_rsa_batch_down(nodes, node * 2, low, middle, m_left, rops, n)
+                && catcrypt_rsa_batch_down(nodes, (node * 2) + 1, middle, high, m_right, rops, n);
+    }
+
+    mpz_clear(a);
+    mpz_clear(b);
+    mpz_clear(x);
+    mpz_clear(m_left);
+    mpz_clear(m_right);
+
+    return is_split;
+}
+
+/**
+ * The root of the tree is prod(c_i ^ (E / e_i)), its E-th root is prod(m_i). That one exponentiation goes through
+ * a key with the primes of the batch and the exponent E^-1, so it takes the CRT and constant time paths too.
+ * Blinding the first base with a pair of the first key (r^e_0, r^-1) blinds the root with r^E, and only the first result has r in it.
+ */
+static bool catcrypt_rsa_key_powm_batch(mpz_t* rops, mpz_ptr* bases, unsigned long* exponents, catcrypt_rsa_key_t* key, int count) {
+    // Heap order from 1, a tree that isn't full goes up to 4 * count
+    catcrypt_rsa_batch_node_t nodes[CATCRYPT_RSA_BATCH_MAX * 4];
+    for (int i = 0; i < (count * 4); i++) {
+        mpz_init(nodes[i].e);
+        mpz_init(nodes[i].v);
+    }
+
+    mpz_t m;
+    mpz_init(m);
+    mpz_t pmo;
+    mpz_init(pmo);
+
+    mpz_t forward;
+    mpz_init(forward);
+    mpz_t inverse;
+    mpz_init(inverse);
+    mpz_t blinded;
+    mpz_init(blinded);
+
+    catcrypt_rsa_blinding_t* blinding = (key->flags & CATCRYPT_RSA_FLAG_BLINDING) ? catcrypt_rsa_key_get_blinding(key): NULL;
+    mpz_ptr first = bases[0];
+    if (blinding) {
+        catcrypt_rsa_blinding_take(blinding, key->n, forward, inverse);
+        mpz_mul(blinded, bases[0], forward);
+        mpz_mod(blinded, blinded, key->n);
+        bases[0] = blinded;
+    }
+
+    catcrypt_rsa_batch_up(nodes, 1, 0, count, bases, exponents, key->n, m);
+    bases[0] = first;
+
+    catcrypt_rsa_key_t* root_key = catcrypt_rsa_key_new();
+    mpz_set(root_key->n, key->n);
+    root_key->bits = key->bits;
+    root_key->flags = key->flags & ~CATCRYPT_RSA_FLAG_BLINDING;
+    root_key->is_crt = true;
+    root_key->primes = key->primes;
+    mpz_set(root_key->p, key->p);
+    mpz_set(root_key->q, key->q);
+    mpz_set(root_key->qinv, key->qinv);
+
+    // Every e_i is coprime to every p - 1, so is their product
+    mpz_sub_ui(pmo, key->p, 1);
+    mpz_set(root_key->e, pmo);
+    CATCRYPT_UTIL_ASSERT(mpz_invert(root_key->dp, nodes[1].e, pmo));
+    mpz_sub_ui(pmo, key->q, 1);
+    mpz_mul(root_key->e, root_key->e, pmo);
+    CATCRYPT_UTIL_ASSERT(mpz_invert(root_key->dq, nodes[1].e, pmo));
+    for (int i = 0; i < (key->primes - 2); i++) {
+        mpz_set(root_key->extra_primes[i].r, key->extra_primes[i].r);
+        mpz_set(root_key->extra_primes[i].t, key->extra_primes[i].t);
+        mpz_sub_ui(pmo, key->extra_primes[i].r, 1);
+        mpz_mul(root_key->e, root_key->e, pmo);
+        CATCRYPT_UTIL_ASSERT(mpz_invert(root_key->extra_primes[i].d, nodes[1].e, pmo));
+    }
+    CATCRYPT_UTIL_ASSERT(mpz_invert(root_key->e, nodes[1].e, root_key->e));
+
+    // The root key has no public exponent to check with, the results are checked with their own
+    catcrypt_rsa_key_powm_unblinded(m, nodes[1].v, root_key);
+    bool is_done = catcrypt_rsa_batch_down(nodes, 1, 0, count, m, rops, key->n);
+
+    if (blinding) {
+        mpz_mul(rops[0], rops[0], inverse);
+        mpz_mod(rops[0], rops[0], key->n);
+        catcrypt_rsa_blinding_give_back(blinding, key->n, forward, inverse);
+    }
+
+    for (int i = 0; is_done && (i < count); i++) {
+        mpz_powm_ui(m, rops[i], exponents[i], key->n);
+        is_done = mpz_cmp(m, bases[i]) == 0;
+    }
+
+    CATCRYPT_REF_COUNTED_LEAVE(root_key);
+
+    for (int i = 0; i < (count * 4); i++) {
+        mpz_clear(nodes[i].e);
+        mpz_clear(nodes[i].v);
+    }
+    mpz_clear(m);
+    mpz_clear(pmo);
+    mpz_clear(forward);
+    mpz_clear(inverse);
+    mpz_clear(blinded);
+
+    return is_done;
+}
+
+void catcrypt_rsa_key_powm__batch(mpz_t* rops, mpz_t* bases, catcrypt_rsa_key_t** keys, int count) {
+    bool* is_done = calloc(count, sizeof(bool));
+
+    int indexes[CATCRYPT_RSA_BATCH_MAX];
+    unsigned long exponents[CATCRYPT_RSA_BATCH_MAX];
+    mpz_t batch_rops[CATCRYPT_RSA_BATCH_MAX];
+    mpz_t batch_product;
+    mpz_init(batch_product);
+    for (int i = 0; i < CATCRYPT_RSA_BATCH_MAX; i++) {
+        mpz_init(batch_rops[i]);
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (is_done[i]) {
+            continue;
+        }
+
+        catcrypt_rsa_key_t* key = keys[i];
+        int length = 0;
+
+        // Zero (or anything not below n) can't be split back out
+        if ((mpz_sgn(bases[i]) > 0) && (mpz_cmp(bases[i], key->n) < 0) && (exponents[0] = catcrypt_rsa_key_public_exponent(key))) {
+            indexes[0] = i;
+            length = 1;
+            mpz_set_ui(batch_product, exponents[0]);
+
+            for (int j = i + 1; (j < count) && (length < CATCRYPT_RSA_BATCH_MAX); j++) {
+                if (is_done[j] || (mpz_cmp(keys[j]->n, key->n) != 0)
+                 || (mpz_sgn(bases[j]) <= 0) || (mpz_cmp(bases[j], key->n) >= 0)) {
+                    continue;
+                }
+
+                unsigned long e = catcrypt_rsa_key_public_exponent(keys[j]);
+                if (!e || (mpz_gcd_ui(NULL, batch_product, e) != 1)) {
+                    continue;
+                }
+
+                indexes[length] = j;
+                exponents[length] = e;
+                length++;
+                mpz_mul_ui(batch_product, batch_product, e);
+            }
+        }
+
+        mpz_ptr batch_bases[CATCRYPT_RSA_BATCH_MAX];
+        for (int j = 0; j < length; j++) {
+            batch_bases[j] = bases[indexes[j]];
+        }
+
+        if ((length > 1) && catcrypt_rsa_key_powm_batch(batch_rops, batch_bases, exponents, key, length)) {
+            for (int j = 0; j < length; j++) {
+                mpz_set(rops[indexes[j]], batch_rops[j]);
+                is_done[indexes[j]] = true;
+            }
+        } else {
+            catcrypt_rsa_key_powm(rops[i], bases[i], key);
+            is_done[i] = true;
+        }
+    }
+
+    for (int i = 0; i < CATCRYPT_RSA_BATCH_MAX; i++) {
+        mpz_clear(batch_rops[i]);
+    }
+    mpz_clear(batch_product);
+    free(is_done);
+}
+
+static catcrypt_rsa_keypair_t* catcrypt_rsa_keypair_new_from_primes(mpz_t* primes, int count, mpz_t n, mpz_t e, unsigned int flags) {
+    catcrypt_rsa_keypair_t* keypair = malloc(sizeof(catcrypt_rsa_keypair_t));
+    CATCRYPT_REF_COUNTED_INIT(keypair, catcrypt_rsa_keypair_free);
+    CATCRYPT_REF_COUNTED_USE(keypair);
+    
+    keypair->pubkey = catcrypt_rsa_key_new();
+    CATCRYPT_REF_COUNTED_USE(keypair->pubkey);
+    keypair->privkey = catcrypt_rsa_key_new();
+    CATCRYPT_REF_COUNTED_USE(keypair->privkey);
+
+    mpz_t phi;
+    mpz_init_set_ui(phi, 1);
+    mpz_t d;
+    mpz_init(d);
+    mpz_t pmo;
+    mpz_init(pmo);
+    mpz_t product;
+    mpz_init(product);
+
+    for (int i = 0; i < count; i++) {
+        mpz_sub_ui(pmo, primes[i], 1);
+        mpz_mul(phi, phi, pmo);
+    }
+
+    CATCRYPT_UTIL_ASSERT(mpz_invert(d, e, phi));
+
+    mpz_set(keypair->pubkey->e, e);
+    mpz_set(keypair->pubkey->n, n);
+    keypair->pubkey->bits = mpz_sizeinbase(n, 2);
+    // The side-channel flags are for the private exponent, public operations keep the prepared fast path
+    keypair->pubkey->flags = flags & ~(CATCRYPT_RSA_FLAG_CONSTANT_TIME | CATCRYPT_RSA_FLAG_BLINDING);
+    catcrypt_rsa_key_prepare(keypair->pubkey);
+    
+    mpz_set(keypair->privkey->e, d);
+    mpz_set(keypair->privkey->n, n);
+    keypair->privkey->bits = mpz_sizeinbase(n, 2);
+    keypair->privkey->flags = flags;
+    atomic_store(&keypair->privkey->public_e, mpz_fits_ulong_p(e) ? mpz_get_ui(e): 1);
+
+    keypair->privkey->is_crt = true;
+    keypair->privkey->primes = count;
+    mpz_set(keypair->privkey->p, primes[0]);
+    mpz_set(keypair->privkey->q, primes[1]);
+    mpz_sub_ui(pmo, primes[0], 1);
+    mpz_mod(keypair->privkey->dp, d, pmo);
+    mpz_sub_ui(pmo, primes[1], 1);
+    mpz_mod(keypair->privkey->dq, d, pmo);
+    CATCRYPT_UTIL_ASSERT(mpz_invert(keypair->privkey->qinv, primes[1], primes[0]));
+
+    mpz_mul(product, primes[0], primes[1]);
+    for (int i = 2; i < count; i++) {
+        catcrypt_rsa_crt_prime_t* prime = &keypair->privkey->extra_primes[i - 2];
+
+        mpz_set(prime->r, primes[i]);
+        mpz_sub_ui(pmo, primes[i], 1);
+        mpz_mod(prime->d, d, pmo);
+        CATCRYPT_UTIL_ASSERT(mpz_invert(prime->t, product, primes[i]));
+
+        mpz_mul(product, product, primes[i]);
+    }
+
+    mpz_clear(phi);
+    mpz_clear(d);
+    mpz_clear(pmo);
+    mpz_clear(product);
+
+    return keypair;
+}
+
+static bool catcrypt_rsa_prime_fits_exponent(mpz_t prime, mpz_t e) {
+    mpz_t gcd;
+    mpz_init(gcd);
+
+    mpz_sub_ui(gcd, prime, 1);
+    mpz_gcd(gcd, gcd, e);
+    bool is_fit = mpz_cmp_ui(gcd, 1) == 0;
+
+    mpz_clear(gcd);
+
+    return is_fit;
+}
+
+typedef struct catcrypt_rsa_prime_hunt {
+    pthread_mutex_t mutex;
+    atomic_bool is_found;
+    size_t bits;
+    catcrypt_prime_mode_t mode;
+    mpz_srcptr e;
+    mpz_t prime;
+} catcrypt_rsa_prime_hunt_t;
+
+/**
+ * Searches a prime with gcd(prime - 1, e) = 1 so that e has an inverse.
+ */
+static bool catcrypt_rsa_prime_hunt_search(catcrypt_rsa_prime_hunt_t* hunt, mpz_t num) {
+    do {
+        catcrypt_rsa_random_prime_candidate(num, hunt->bits);
+
+        while (catcrypt_prime_search(num, hunt->mode, NULL, &hunt->is_found)) {
+            // Past 2^bits the modulus would not have its exact size, starts over with a new candidate
+            if (mpz_sizeinbase(num, 2) > hunt->bits) {
+                break;
+            }
+            if (catcrypt_rsa_prime_fits_exponent(num, (mpz_ptr) hunt->e)) {
+                return true;
+            }
+            mpz_add_ui(num, num, 2);
+        }
+    } while (!atomic_load(&hunt->is_found));
+
+    return false;
+}
+
+static void* catcrypt_rsa_prime_hunt_worker(void* arg) {
+    catcrypt_rsa_prime_hunt_t* hunt = arg;
+
+    mpz_t num;
+    mpz_init(num);
+
+    // Every worker starts from its own random candidate, the first one that finds a prime cancels the others
+    if (catcrypt_rsa_prime_hunt_search(hunt, num)) {
+        pthread_mutex_lock(&hunt->mutex);
+        if (!atomic_load(&hunt->is_found)) {
+            mpz_set(hunt->prime, num);
+            atomic_store(&hunt->is_found, true);
+        }
+        pthread_mutex_unlock(&hunt->mutex);
+    }
+
+    mpz_clear(num);
+
+    return NULL;
+}
+
+static int catcrypt_rsa_flags_primes(unsigned int flags) {
+    if (flags & CATCRYPT_RSA_FLAG_4_PRIMES) {
+        return 4;
+    }
+    if (flags & CATCRYPT_RSA_FLAG_3_PRIMES) {
+        return 3;
+    }
+
+    return 2;
+}
+
+/**
+ * The primes must be distinct and their product must have exactly the key size.
+ * Two primes with their top two bits set always have it, three or four may fall one bit short.
+ */
+static bool catcrypt_rsa_primes_fit(catcrypt_rsa_prime_hunt_t* hunts, int count, mpz_t n, size_t bits) {
+    for (int i = 0; i < count; i++) {
+        for (int j = i + 1; j < count; j++) {
+            if (mpz_cmp(hunts[i].prime, hunts[j].prime) == 0) {
+                return false;
+            }
+        }
+    }
+
+    mpz_set(n, hunts[0].prime);
+    for (int i = 1; i < count; i++) {
+        mpz_mul(n, n, hunts[i].prime);
+    }
+
+    return mpz_sizeinbase(n, 2) == bits;
+}
+
+/**
+ * Every prime must be at least as big as a prime of the smallest two-prime key
+ */
+static bool catcrypt_rsa_bits_fit(size_t bits, unsigned int flags) {
+    return (bits / catcrypt_rsa_flags_primes(flags)) >= (CATCRYPT_RSA_MIN_KEY_BITS / 2);
+}
+
+/**
+ * Finds the primes of a bits bit n, e must have an inverse mod every (prime - 1). Returns how many primes there are.
+ */
+static int catcrypt_rsa_find_primes(mpz_t* primes, mpz_t n, size_t bits, mpz_t exponent, unsigned int flags, int threads) {
+    int count = catcrypt_rsa_flags_primes(flags);
+
+    catcrypt_rsa_prime_hunt_t hunts[CATCRYPT_RSA_MAX_PRIMES];
+    for (int i = 0; i < count; i++) {
+        pthread_mutex_init(&hunts[i].mutex, NULL);
+        atomic_init(&hunts[i].is_found, false);
+        // The first primes take the bits that don't divide evenly
+        hunts[i].bits = (bits / count) + ((i < (bits % count)) ? 1: 0);
+        hunts[i].mode = (flags & CATCRYPT_RSA_FLAG_PARANOID) ? CATCRYPT_PRIME_MODE_PARANOID: CATCRYPT_RSA_PRIME_MODE;
+        hunts[i].e = exponent;
+        mpz_init(hunts[i].prime);
+    }
+
+    if (threads < 2) {
+        for (int i = 0; i < count; i++) {
+            catcrypt_rsa_prime_hunt_search(&hunts[i], hunts[i].prime);
+        }
+    } else {
+        if (threads < count) {
+            threads = count;
+        }
+
+        pthread_t* workers = malloc(sizeof(pthread_t) * threads);
+
+        // Workers are split evenly between the primes, all searches run at the same time
+        for (int i = 0; i < threads; i++) {
+            catcrypt_rsa_prime_hunt_t* hunt = &hunts[(i * count) / threads];
+            CATCRYPT_UTIL_ASSERT(pthread_create(&workers[i], NULL, catcrypt_rsa_prime_hunt_worker, hunt) == 0);
+        }
+
+        for (int i = 0; i < threads; i++) {
+            pthread_join(workers[i], NULL);
+        }
+
+        free(workers);
+    }
+
+    // The primes are drawn again in turn, the others can be too small for any last prime to give n its size
+    for (int i = count - 1; !catcrypt_rsa_primes_fit(hunts, count, n, bits); i = (i + 1) % count) {
+        atomic_store(&hunts[i].is_found, false);
+        catcrypt_rsa_prime_hunt_search(&hunts[i], hunts[i].prime);
+    }
+
+    for (int i = 0; i < count; i++) {
+        mpz_set(primes[i], hunts[i].prime);
+        pthread_mutex_destroy(&hunts[i].mutex);
+        mpz_clear(hunts[i].prime);
+    }
+
+    return count;
+}
+
+catcrypt_rsa_keypair_t* catcrypt_rsa_keypair_new_ex__threads(size_t bits, unsigned long e, unsigned int flags, int threads) {
+    if (!catcrypt_rsa_bits_fit(bits, flags) || (e < 3) || ((e % 2) == 0)) {
+        return NULL;
+    }
+
+    mpz_t exponent;
+    mpz_init_set_ui(exponent, e);
+    mpz_t n;
+    mpz_init(n);
+    mpz_t primes[CATCRYPT_RSA_MAX_PRIMES];
+    for (int i = 0; i < CATCRYPT_RSA_MAX_PRIMES; i++) {
+        mpz_init(primes[i]);
+    }
+
+    int count = catcrypt_rsa_find_primes(primes, n, bits, exponent, flags, threads);
+    catcrypt_rsa_keypair_t* keypair = catcrypt_rsa_keypair_new_from_primes(primes, count, n, exponent, flags);
+
+    for (int i = 0; i < CATCRYPT_RSA_MAX_PRIMES; i++) {
+        mpz_clear(primes[i]);
+    }
+    mpz_clear(exponent);
+    mpz_clear(n);
+
+    return keypair;
+}
+
+catcrypt_rsa_keypair_t* catcrypt_rsa_keypair_new_ex(size_t bits, unsigned long e, unsigned int flags) {
+    return catcrypt_rsa_keypair_new_ex__threads(bits, e, flags, 1);
+}
+
+catcrypt_rsa_keypair_t* catcrypt_rsa_keypair_new() {
+    return catcrypt_rsa_keypair_new_ex(CATCRYPT_RSA_KEY_BITS, CATCRYPT_RSA_PUB_EXPONENT, 0);
+}
+
+catcrypt_rsa_keypair_t* catcrypt_rsa_keypair_new__threads(int threads) {
+    return catcrypt_rsa_keypair_new_ex__threads(CATCRYPT_RSA_KEY_BITS, CATCRYPT_RSA_PUB_EXPONENT, 0, threads);
+}
+
+catcrypt_rsa_keypair_t* catcrypt_rsa_keypair_new__primes(int primes) {
+    CATCRYPT_UTIL_ASSERT((primes >= 2) && (primes <= CATCRYPT_RSA_MAX_PRIMES));
+
+    unsigned int flags = (primes == 4) ? CATCRYPT_RSA_FLAG_4_PRIMES: ((primes == 3) ? CATCRYPT_RSA_FLAG_3_PRIMES: 0);
+    return catcrypt_rsa_keypair_new_ex(CATCRYPT_RSA_KEY_BITS, CATCRYPT_RSA_PUB_EXPONENT, flags);
+}
+
+bool catcrypt_rsa_keypair_new_family__threads(catcrypt_rsa_keypair_t** keypairs, int count, size_t bits, unsigned int flags, int threads) {
+    if ((count < 1) || !catcrypt_rsa_bits_fit(bits, flags)) {
+        return false;
+    }
+
+    mpz_t* exponents = malloc(sizeof(mpz_t) * count);
+    mpz_t product;
+    mpz_init_set_ui(product, 1);
+    for (int i = 0; i < count; i++) {
+        mpz_init(exponents[i]);
+        if (i == 0) {
+            mpz_set_ui(exponents[i], CATCRYPT_RSA_PUB_EXPONENT);
+        } else {
+            mpz_nextprime(exponents[i], exponents[i - 1]);
+        }
+        mpz_mul(product, product, exponents[i]);
+    }
+
+    mpz_t n;
+    mpz_init(n);
+    mpz_t primes[CATCRYPT_RSA_MAX_PRIMES];
+    for (int i = 0; i < CATCRYPT_RSA_MAX_PRIMES; i++) {
+        mpz_init(primes[i]);
+    }
+
+    // Primes that fit the product fit every exponent
+    int primes_count = catcrypt_rsa_find_primes(primes, n, bits, product, flags, threads);
+    for (int i = 0; i < count; i++) {
+        keypairs[i] = catcrypt_rsa_keypair_new_from_primes(primes, primes_count, n, exponents[i], flags);
+        mpz_clear(exponents[i]);
+    }
+
+    for (int i = 0; i < CATCRYPT_RSA_MAX_PRIMES; i++) {
+        mpz_clear(primes[i]);
+    }
+    free(exponents);
+    mpz_clear(product);
+    mpz_clear(n);
+
+    return true;
+}
+
+bool catcrypt_rsa_keypair_new_family(catcrypt_rsa_keypair_t** keypairs, int count, size_t bits, unsigned int flags) {
+    return catcrypt_rsa_keypair_new_family__threads(keypairs, count, bits, flags, 1);
+}
+
+catcrypt_rsa_keypair_t* catcrypt_rsa_keypair_new_from_keys(catcrypt_rsa_key_t* pubkey, catcrypt_rsa_key_t* privkey) {
+    catcrypt_rsa_keypair_t* keypair = malloc(sizeof(catcrypt_rsa_keypair_t));
+    CATCRYPT_REF_COUNTED_INIT(keypair, catcrypt_rsa_keypair_free);
+    CATCRYPT_REF_COUNTED_USE(keypair);
+
+    keypair->pubkey = pubkey;
+    CATCRYPT_REF_COUNTED_USE(keypair->pubkey);
+    keypair->privkey = privkey;
+    CATCRYPT_REF_COUNTED_USE(keypair->privkey);
+
+    return keypair;
+}
+
+void catcrypt_rsa_keypair_free(catcrypt_rsa_keypair_t* keypair) {
+    CATCRYPT_REF_COUNTED_LEAVE(keypair->pubkey);
+    CATCRYPT_REF_COUNTED_LEAVE(keypair->privkey);
+    free(keypair);
+}
+
+catcrypt_rsa_encrypted_t* catcrypt_rsa_encrypted_new() {
+    catcrypt_rsa_encrypted_t* encrypted = malloc(sizeof(catcrypt_rsa_encrypted_t));
+    CATCRYPT_REF_COUNTED_INIT(encrypted, catcrypt_rsa_encrypted_free);
+    
+    encrypted->data = NULL;
+    encrypted->key = NULL;
+
+    return encrypted;
+}
+
+void catcrypt_rsa_encrypted_set_key(catcrypt_rsa_encrypted_t* encrypted, catcrypt_rsa_key_t* key) {
+    CATCRYPT_REF_COUNTED_LEAVE(encrypted->key);
+    CATCRYPT_REF_COUNTED_USE(key);
+    encrypted->key = key;
+}
+
+void catcrypt_rsa_encrypted_set_data(catcrypt_rsa_encrypted_t* encrypted, catcrypt_string_t* data) {
+    CATCRYPT_REF_COUNTED_LEAVE(encrypted->data);
+    CATCRYPT_REF_COUNTED_USE(data);
+    encrypted->data = data;
+}
+
+void catcrypt_rsa_encrypted_free(catcrypt_rsa_encrypted_t* encrypted) {
+    CATCRYPT_REF_COUNTED_LEAVE(encrypted->data);
+    CATCRYPT_REF_COUNTED_LEAVE(encrypted->key);
+    free(encrypted);
+}
+
+static void catcrypt_rsa_be_write(char* cursor, uint64_t value, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        cursor[size - 1 - i] = (char) (value >> (8 * i));
+    }
+}
+
+static uint64_t catcrypt_rsa_be_read(char* cursor, size_t size) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < size; i++) {
+        value = (value << 8) | (unsigned char) cursor[i];
+    }
+
+    return value;
+}
+
+/**
+ * v1 data starts with the size_t length of a block (at most key_size), it can't start with the magic on either endianness.
+ */
+static bool catcrypt_rsa_is_v2(catcrypt_string_t* data) {
+    size_t magic_size = strlen(CATCRYPT_RSA_FORMAT_MAGIC);
+    return (data->length >= magic_size) && (memcmp(data->value, CATCRYPT_RSA_FORMAT_MAGIC, magic_size) == 0);
+}
+
+static void catcrypt_rsa_header_write(char* cursor, catcrypt_rsa_header_t* header) {
+    memcpy(cursor, CATCRYPT_RSA_FORMAT_MAGIC, 4);
+    catcrypt_rsa_be_write(cursor + 4, header->version, 1);
+    catcrypt_rsa_be_write(cursor + 5, header->flags, 1);
+    catcrypt_rsa_be_write(cursor + 6, header->block_size, 2);
+    catcrypt_rsa_be_write(cursor + 8, header->key_size, 4);
+    catcrypt_rsa_be_write(cursor + 12, header->fingerprint, 8);
+    catcrypt_rsa_be_write(cursor + 20, header->blocks, 8);
+    catcrypt_rsa_be_write(cursor + 28, header->length, 8);
+}
+
+/**
+ * Reads CATCRYPT_RSA_HEADER_SIZE bytes, false if the fields don't fit together. The size of the data isn't checked here.
+ */
+static bool catcrypt_rsa_header_parse(char* cursor, catcrypt_rsa_header_t* header) {
+    if (memcmp(cursor, CATCRYPT_RSA_FORMAT_MAGIC, strlen(CATCRYPT_RSA_FORMAT_MAGIC)) != 0) {
+        return false;
+    }
+
+    header->version = catcrypt_rsa_be_read(cursor + 4, 1);
+    header->flags = catcrypt_rsa_be_read(cursor + 5, 1);
+    header->block_size = catcrypt_rsa_be_read(cursor + 6, 2);
+    header->key_size = catcrypt_rsa_be_read(cursor + 8, 4);
+    header->fingerprint = catcrypt_rsa_be_read(cursor + 12, 8);
+    header->blocks = catcrypt_rsa_be_read(cursor + 20, 8);
+    header->length = catcrypt_rsa_be_read(cursor + 28, 8);
+
+    // Every block must be able to hold block_size bytes below n
+    if ((header->version != CATCRYPT_RSA_FORMAT_V2) || (header->flags & ~CATCRYPT_RSA_HEADER_FLAG_FULL_BLOCKS) || (header->block_size == 0) || (header->block_size >= header->key_size)) {
+        return false;
+    }
+
+    // Full blocks fill the modulus, data from before them has blocks of at most CATCRYPT_RSA_BLOCK_SIZE
+    if (header->flags & CATCRYPT_RSA_HEADER_FLAG_FULL_BLOCKS) {
+        if (header->block_size != catcrypt_rsa_full_block_size(header->key_size)) {
+            return false;
+        }
+    } else if (header->block_size > CATCRYPT_RSA_BLOCK_SIZE) {
+        return false;
+    }
+
+    // Only the last block can be short and it can't be empty
+    if (header->blocks == 0) {
+        return header->length == 0;
+    }
+
+    if (header->blocks > (UINT64_MAX / header->key_size)) {
+        return false;
+    }
+
+    uint64_t max_length = header->blocks * header->block_size;
+    return (header->length <= max_length) && (header->length > (max_length - header->block_size));
+}
+
+static bool catcrypt_rsa_header_read__n(char* data, size_t length, catcrypt_rsa_header_t* header) {
+    if ((length < CATCRYPT_RSA_HEADER_SIZE) || !catcrypt_rsa_header_parse(data, header)) {
+        return false;
+    }
+
+    size_t payload_size = length - CATCRYPT_RSA_HEADER_SIZE;
+    return (header->blocks <= (payload_size / header->key_size)) && ((header->blocks * header->key_size) == payload_size);
+}
+
+bool catcrypt_rsa_header_read(catcrypt_string_t* data, catcrypt_rsa_header_t* header) {
+    return catcrypt_rsa_header_read__n(data->value, data->length, header);
+}
+
+/**
+ * Header of length bytes encrypted with key in full blocks.
+ */
+static void catcrypt_rsa_header_init(catcrypt_rsa_header_t* header, catcrypt_rsa_key_t* key, size_t length) {
+    size_t block_size = catcrypt_rsa_key_block_size(key);
+
+    header->version = CATCRYPT_RSA_FORMAT_V2;
+    header->flags = CATCRYPT_RSA_HEADER_FLAG_FULL_BLOCKS;
+    header->block_size = block_size;
+    header->key_size = catcrypt_rsa_key_size(key);
+    header->fingerprint = catcrypt_rsa_key_fingerprint(key);
+    header->blocks = (length / block_size) + ((length % block_size) != 0);
+    header->length = length;
+}
+
+/**
+ * Whether header was made for key.
+ */
+static bool catcrypt_rsa_header_is_for_key(catcrypt_rsa_header_t* header, catcrypt_rsa_key_t* key) {
+    return (header->key_size == catcrypt_rsa_key_size(key)) && (header->fingerprint == catcrypt_rsa_key_fingerprint(key));
+}
+
+/**
+ * v2 data that can be decrypted with key: a header that is read and made for a key of the same size and fingerprint.
+ */
+static bool catcrypt_rsa_header_read_for_key__n(char* data, size_t length, catcrypt_rsa_key_t* key, catcrypt_rsa_header_t* header) {
+    return catcrypt_rsa_header_read__n(data, length, header) && catcrypt_rsa_header_is_for_key(header, key) && (header->blocks <= INT_MAX);
+}
+
+static bool catcrypt_rsa_header_read_for_key(catcrypt_string_t* data, catcrypt_rsa_key_t* key, catcrypt_rsa_header_t* header) {
+    return catcrypt_rsa_header_read_for_key__n(data->value, data->length, key, header);
+}
+
+size_t catcrypt_rsa_encrypted_size(catcrypt_rsa_key_t* key, size_t length) {
+    size_t block_size = catcrypt_rsa_key_block_size(key);
+    size_t blocks = (length / block_size) + ((length % block_size) != 0);
+
+    return CATCRYPT_RSA_HEADER_SIZE + (blocks * catcrypt_rsa_key_size(key));
+}
+
+/**
+ * Blocks of one encryption or decryption. Workers take the next block from one counter and never wait for each other.
+ * Block i is read from input + i * input_stride (inputs[i] for v1 data) and written to output + i * output_stride
+ * as a fixed-width big-endian number, only the last block of input_length or output_length bytes can be shorter.
+ * A block that is >= n or doesn't fit its output sets is_failed.
+ * v1 decryption writes the length of a result before it instead (is_prefixed), the caller packs those slots afterwards.
+ */
+typedef struct catcrypt_rsa_blocks {
+    atomic_int next;
+    atomic_bool is_failed;
+    int count;
+    catcrypt_rsa_key_t* key;
+    char* input;
+    size_t input_stride;
+    size_t input_length;
+    char** inputs;
+    size_t* input_sizes;
+    char* output;
+    size_t output_stride;
+    size_t output_length;
+    bool is_prefixed;
+} catcrypt_rsa_blocks_t;
+
+static size_t catcrypt_rsa_block_width(size_t stride, size_t length, size_t index) {
+    size_t offset = index * stride;
+    return ((length - offset) < stride) ? (length - offset): stride;
+}
+
+/**
+ * num as exactly size big-endian bytes, false if it needs more.
+ */
+static bool catcrypt_rsa_block_export(char* output, size_t size, mpz_t num) {
+    size_t num_size = (mpz_sgn(num) == 0) ? 0: mpz_sizeinbase(num, 256);
+    if (num_size > size) {
+        return false;
+    }
+
+    memset(output, 0, size - num_size);
+    if (num_size) {
+        mpz_export(output + (size - num_size), NULL, CATCRYPT_MPZ_ORDER, 1, CATCRYPT_MPZ_ENDIAN, 0, num);
+    }
+
+    return true;
+}
+
+static void* catcrypt_rsa_blocks_worker(void* arg) {
+    catcrypt_rsa_blocks_t* blocks = arg;
+
+    mpz_t input;
+    mpz_init(input);
+    mpz_t output;
+    mpz_init(output);
+
+    for (int i; (i = atomic_fetch_add(&blocks->next, 1)) < blocks->count;) {
+        char* slot = blocks->output + ((size_t) i * blocks->output_stride);
+
+        if (blocks->inputs) {
+            mpz_import(input, blocks->input_sizes[i], CATCRYPT_MPZ_ORDER, 1, CATCRYPT_MPZ_ENDIAN, 0, blocks->inputs[i]);
+        } else {
+            size_t input_size = catcrypt_rsa_block_width(blocks->input_stride, blocks->input_length, i);
+            mpz_import(input, input_size, CATCRYPT_MPZ_ORDER, 1, CATCRYPT_MPZ_ENDIAN, 0, blocks->input + ((size_t) i * blocks->input_stride));
+        }
+
+        // c >= n would come out as c mod n, it can't be from catcrypt_rsa_encrypt()
+        if (mpz_cmp(input, blocks->key->n) >= 0) {
+            atomic_store(&blocks->is_failed, true);
+            continue;
+        }
+
+        catcrypt_rsa_key_powm(output, input, blocks->key);
+
+        if (blocks->is_prefixed) {
+            size_t bignum_size = 0;
+            mpz_export(slot + sizeof(size_t), &bignum_size, CATCRYPT_MPZ_ORDER, 1, CATCRYPT_MPZ_ENDIAN, 0, output);
+            memcpy(slot, &bignum_size, sizeof(bignum_size));
+        } else if (!catcrypt_rsa_block_export(slot, catcrypt_rsa_block_width(blocks->output_stride, blocks->output_length, i), output)) {
+            atomic_store(&blocks->is_failed, true);
+        }
+    }
+
+    mpz_clear(input);
+    mpz_clear(output);
+
+    return NULL;
+}
+
+/**
+ * Small payloads stay on the calling thread, starting threads would cost more than their blocks.
+ */
+static void catcrypt_rsa_blocks_run(catcrypt_rsa_blocks_t* blocks, int threads) {
+    atomic_init(&blocks->next, 0);
+    atomic_init(&blocks->is_failed, false);
+
+    if ((threads < 2) || (blocks->count < CATCRYPT_RSA_PARALLEL_MIN_BLOCKS)) {
+        catcrypt_rsa_blocks_worker(blocks);
+        return;
+    }
+
+    if (threads > blocks->count) {
+        threads = blocks->count;
+    }
+
+    // The calling thread is one of the workers
+    pthread_t* workers = malloc(sizeof(pthread_t) * (threads - 1));
+    for (int i = 0; i < (threads - 1); i++) {
+        CATCRYPT_UTIL_ASSERT(pthread_create(&workers[i], NULL, catcrypt_rsa_blocks_worker, blocks) == 0);
+    }
+
+    catcrypt_rsa_blocks_worker(blocks);
+
+    for (int i = 0; i < (threads - 1); i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    free(workers);
+}
+
+/**
+ * Writes the header and every block of length bytes of data to output, catcrypt_rsa_encrypted_size() bytes.
+ */
+static void catcrypt_rsa_encrypt_blocks(char* output, char* data, size_t length, catcrypt_rsa_key_t* pubkey, int threads) {
+    catcrypt_rsa_header_t header;
+    catcrypt_rsa_header_init(&header, pubkey, length);
+    catcrypt_rsa_header_write(output, &header);
+
+    catcrypt_rsa_blocks_t blocks;
+    blocks.count = header.blocks;
+    blocks.key = pubkey;
+    blocks.input = data;
+    blocks.input_stride = header.block_size;
+    blocks.input_length = length;
+    blocks.inputs = NULL;
+    blocks.input_sizes = NULL;
+    blocks.output = output + CATCRYPT_RSA_HEADER_SIZE;
+    blocks.output_stride = header.key_size;
+    blocks.output_length = header.blocks * header.key_size;
+    blocks.is_prefixed = false;
+
+    catcrypt_rsa_blocks_run(&blocks, threads);
+}
+
+catcrypt_rsa_encrypted_t* catcrypt_rsa_encrypt__threads(catcrypt_string_t* data, catcrypt_rsa_key_t* pubkey, int threads) {
+    CATCRYPT_REF_COUNTED_USE(data);
+    CATCRYPT_REF_COUNTED_USE(pubkey);
+
+    // The size is known before anything is encrypted, the output is allocated once and every block is written in its place
+    size_t size = catcrypt_rsa_encrypted_size(pubkey, data->length);
+    if (size > CATCRYPT_STRING_MAX_LENGTH) {
+        CATCRYPT_REF_COUNTED_LEAVE(data);
+        CATCRYPT_REF_COUNTED_LEAVE(pubkey);
+        return NULL;
+    }
+
+    catcrypt_rsa_encrypted_t* encrypted = catcrypt_rsa_encrypted_new();
+    catcrypt_rsa_encrypted_set_key(encrypted, pubkey);
+
+    catcrypt_string_t* encrypted_data = catcrypt_string_new__n(size);
+    encrypted_data->length = size;
+    encrypted_data->value[size] = '\0';
+    catcrypt_rsa_encrypted_set_data(encrypted, encrypted_data);
+
+    catcrypt_rsa_encrypt_blocks(encrypted_data->value, data->value, data->length, pubkey, threads);
+
+    CATCRYPT_REF_COUNTED_LEAVE(data);
+    CATCRYPT_REF_COUNTED_LEAVE(pubkey);
+
+    return encrypted; 
+}
+
+catcrypt_rsa_encrypted_t* catcrypt_rsa_encrypt(catcrypt_string_t* data, catcrypt_rsa_key_t* pubkey) {
+    return catcrypt_rsa_encrypt__threads(data, pubkey, 1);
+}
+
+/**
+ * A position in an iovec array, index == count when every fragment is used up.
+ */
+typedef struct catcrypt_rsa_iov_cursor {
+    struct iovec* iov;
+    int count;
+    int index;
+    size_t offset;
+} catcrypt_rsa_iov_cursor_t;
+
+/**
+ * Skips used up (and empty) fragments, returns how many bytes are left in the current one.
+ */
+static size_t catcrypt_rsa_iov_cursor_available(catcrypt_rsa_iov_cursor_t* cursor) {
+    while ((cursor->index < cursor->count) && (cursor->offset == cursor->iov[cursor->index].iov_len)) {
+        cursor->index++;
+        cursor->offset = 0;
+    }
+
+    return (cursor->index < cursor->count) ? (cursor->iov[cursor->index].iov_len - cursor->offset): 0;
+}
+
+static char* catcrypt_rsa_iov_cursor_position(catcrypt_rsa_iov_cursor_t* cursor) {
+    return (char *) cursor->iov[cursor->index].iov_base + cursor->offset;
+}
+
+/**
+ * Copies length bytes between buffer and the fragments (into them if is_scatter), false if the fragments end first.
+ */
+static bool catcrypt_rsa_iov_cursor_copy(catcrypt_rsa_iov_cursor_t* cursor, char* buffer, size_t length, bool is_scatter) {
+    while (length > 0) {
+        size_t available = catcrypt_rsa_iov_cursor_available(cursor);
+        if (available == 0) {
+            return false;
+        }
+
+        size_t part = (available < length) ? available: length;
+        if (is_scatter) {
+            memcpy(catcrypt_rsa_iov_cursor_position(cursor), buffer, part);
+        } else {
+            memcpy(buffer, catcrypt_rsa_iov_cursor_position(cursor), part);
+        }
+
+        cursor->offset += part;
+        buffer += part;
+        length -= part;
+    }
+
+    return true;
+}
+
+static size_t catcrypt_rsa_iov_length(struct iovec* iov, int count) {
+    size_t length = 0;
+    for (int i = 0; i < count; i++) {
+        length += iov[i].iov_len;
+    }
+
+    return length;
+}
+
+int catcrypt_rsa_encrypt__iov(struct iovec* output, int output_count, struct iovec* input, int input_count, catcrypt_rsa_key_t* pubkey) {
+    size_t length = catcrypt_rsa_iov_length(input, input_count);
+    if (catcrypt_rsa_iov_length(output, output_count) < catcrypt_rsa_encrypt_itch(pubkey, length)) {
+        return -1;
+    }
+
+    catcrypt_rsa_header_t header;
+    catcrypt_rsa_header_init(&header, pubkey, length);
+
+    catcrypt_rsa_iov_cursor_t in = {input, input_count, 0, 0};
+    catcrypt_rsa_iov_cursor_t out = {output, output_count, 0, 0};
+
+    // Blocks that cross a fragment boundary go through staging, the header too
+    char* staging = malloc(header.block_size + header.key_size);
+    char* staging_output = staging + header.block_size;
+
+    catcrypt_rsa_header_write(staging_output, &header);
+    catcrypt_rsa_iov_cursor_copy(&out, staging_output, CATCRYPT_RSA_HEADER_SIZE, true);
+
+    bool is_failed = false;
+    for (uint64_t block = 0; (block < header.blocks) && !is_failed;) {
+        size_t input_left = length - (block * header.block_size);
+        size_t input_available = catcrypt_rsa_iov_cursor_available(&in);
+        size_t output_available = catcrypt_rsa_iov_cursor_available(&out);
+
+        // A run of blocks that are whole in one input fragment and one output fragment is done in place
+        uint64_t input_blocks = (input_left <= input_available) ? (header.blocks - block): (input_available / header.block_size);
+        uint64_t output_blocks = output_available / header.key_size;
+        uint64_t count = (input_blocks < output_blocks) ? input_blocks: output_blocks;
+        count = (count < INT_MAX) ? count: INT_MAX;
+
+        catcrypt_rsa_blocks_t blocks;
+        blocks.key = pubkey;
+        blocks.input_stride = header.block_size;
+        blocks.inputs = NULL;
+        blocks.input_sizes = NULL;
+        blocks.output_stride = header.key_size;
+        blocks.is_prefixed = false;
+
+        if (count > 0) {
+            blocks.count = count;
+            blocks.input = catcrypt_rsa_iov_cursor_position(&in);
+            blocks.input_length = ((count * header.block_size) < input_left) ? (count * header.block_size): input_left;
+            blocks.output = catcrypt_rsa_iov_cursor_position(&out);
+            blocks.output_length = count * header.key_size;
+
+            catcrypt_rsa_blocks_run(&blocks, 1);
+
+            in.offset += blocks.input_length;
+            out.offset += blocks.output_length;
+        } else {
+            count = 1;
+
+            blocks.count = 1;
+            blocks.input = staging;
+            blocks.input_length = catcrypt_rsa_block_width(header.block_size, length, block);
+            blocks.output = staging_output;
+            blocks.output_length = header.key_size;
+
+            catcrypt_rsa_iov_cursor_copy(&in, staging, blocks.input_length, false);
+            catcrypt_rsa_blocks_run(&blocks, 1);
+            catcrypt_rsa_iov_cursor_copy(&out, staging_output, header.key_size, true);
+        }
+
+        is_failed = atomic_load(&blocks.is_failed);
+        block += count;
+    }
+
+    free(staging);
+
+    if (is_failed) {
+        return -1;
+    }
+
+    // The fragments that hold the encrypted data are cut to what was written into them
+    catcrypt_rsa_iov_cursor_available(&out);
+    if (out.index == output_count) {
+        return output_count;
+    }
+
+    output[out.index].iov_len = out.offset;
+    return out.index + (out.offset > 0);
+}
+
+size_t catcrypt_rsa_encrypt_itch(catcrypt_rsa_key_t* pubkey, size_t length) {
+    return catcrypt_rsa_encrypted_size(pubkey, length);
+}
+
+bool catcrypt_rsa_encrypt__into(char* output, size_t size, char* data, size_t length, catcrypt_rsa_key_t* pubkey) {
+    if (size < catcrypt_rsa_encrypt_itch(pubkey, length)) {
+        return false;
+    }
+
+    catcrypt_rsa_encrypt_blocks(output, data, length, pubkey, 1);
+    return true;
+}
+
+/**
+ * Decrypts every block of data to output, header.length bytes. Block i is written below the end of its input,
+ * on one thread output can be data itself.
+ */
+static bool catcrypt_rsa_decrypt_blocks(char* output, char* data, catcrypt_rsa_header_t* header, catcrypt_rsa_key_t* privkey, int threads) {
+    catcrypt_rsa_blocks_t blocks;
+    blocks.count = header->blocks;
+    blocks.key = privkey;
+    blocks.input = data + CATCRYPT_RSA_HEADER_SIZE;
+    blocks.input_stride = header->key_size;
+    blocks.input_length = header->blocks * header->key_size;
+    blocks.inputs = NULL;
+    blocks.input_sizes = NULL;
+    blocks.output = output;
+    blocks.output_stride = header->block_size;
+    blocks.output_length = header->length;
+    blocks.is_prefixed = false;
+
+    catcrypt_rsa_blocks_run(&blocks, threads);
+
+    return !atomic_load(&blocks.is_failed);
+}
+
+/**
+ * Blocks and their results are at known offsets, the output is exactly the original data.
+ */
+static catcrypt_string_t* catcrypt_rsa_decrypt_v2(catcrypt_string_t* data, catcrypt_rsa_key_t* privkey, int threads) {
+    catcrypt_rsa_header_t header;
+    if (!catcrypt_rsa_header_read_for_key(data, privkey, &header) || (header.length > CATCRYPT_STRING_MAX_LENGTH)) {
+        return NULL;
+    }
+
+    catcrypt_string_t* decrypted = catcrypt_string_new__n(header.length);
+    decrypted->length = header.length;
+    decrypted->value[header.length] = '\0';
+
+    if (!catcrypt_rsa_decrypt_blocks(decrypted->value, data->value, &header, privkey, threads)) {
+        catcrypt_string_free(decrypted);
+        return NULL;
+    }
+
+    return decrypted;
+}
+
+/**
+ * Reads the size prefix of the block at index, false if the prefix or its block runs past the data.
+ */
+static bool catcrypt_rsa_v1_block(catcrypt_string_t* data, size_t index, size_t* size) {
+    if ((index > data->length) || ((data->length - index) < sizeof(size_t))) {
+        return false;
+    }
+
+    memcpy(size, data->value + index, sizeof(size_t));
+    return *size <= (data->length - index - sizeof(size_t));
+}
+
+/**
+ * -1 for malformed data.
+ */
+static int catcrypt_rsa_v1_count(catcrypt_string_t* data) {
+    int count = 0;
+    for (size_t index = 0; index < data->length; count++) {
+        size_t size;
+        if (!catcrypt_rsa_v1_block(data, index, &size)) {
+            return -1;
+        }
+
+        index += sizeof(size_t) + size;
+    }
+
+    return count;
+}
+
+/**
+ * Blocks have to be found one after another and results are as long as their numbers, they are packed after decryption.
+ */
+static catcrypt_string_t* catcrypt_rsa_decrypt_v1(catcrypt_string_t* data, catcrypt_rsa_key_t* privkey, int threads) {
+    int count = catcrypt_rsa_v1_count(data);
+    if ((count < 0) || (data->length > CATCRYPT_STRING_MAX_LENGTH)) {
+        return NULL;
+    }
+
+    // A block never decrypts to more bytes than n, the slots are packed into the output in place
+    size_t slots_size = count * (sizeof(size_t) + catcrypt_rsa_key_size(privkey));
+    if (slots_size > CATCRYPT_STRING_MAX_LENGTH) {
+        return NULL;
+    }
+
+    catcrypt_rsa_blocks_t blocks;
+    blocks.count = count;
+    blocks.key = privkey;
+    blocks.inputs = malloc(sizeof(char *) * count);
+    blocks.input_sizes = malloc(sizeof(size_t) * count);
+    blocks.output_stride = sizeof(size_t) + catcrypt_rsa_key_size(privkey);
+    blocks.is_prefixed = true;
+
+    size_t index = 0;
+    for (int i = 0; i < count; i++) {
+        catcrypt_rsa_v1_block(data, index, &blocks.input_sizes[i]);
+        blocks.inputs[i] = data->value + index + sizeof(size_t);
+        index += sizeof(size_t) + blocks.input_sizes[i];
+    }
+
+    catcrypt_string_t* decrypted = catcrypt_string_new__n((slots_size > data->length) ? slots_size: data->length);
+    blocks.output = decrypted->value;
+
+    catcrypt_rsa_blocks_run(&blocks, threads);
+
+    free(blocks.inputs);
+    free(blocks.input_sizes);
+
+    // Failed blocks don't write their slots
+    if (atomic_load(&blocks.is_failed)) {
+        catcrypt_string_free(decrypted);
+        return NULL;
+    }
+
+    size_t length = 0;
+    for (int i = 0; i < count; i++) {
+        char* slot = blocks.output + (i * blocks.output_stride);
+        size_t bignum_size;
+        memcpy(&bignum_size, slot, sizeof(bignum_size));
+
+        memmove(decrypted->value + length, slot + sizeof(size_t), bignum_size);
+        length += bignum_size;
+    }
+    decrypted->length = length;
+    decrypted->value[length] = '\0';
+
+    return decrypted;
+}
+
+catcrypt_string_t* catcrypt_rsa_decrypt__threads(catcrypt_rsa_encrypted_t* encrypted, catcrypt_rsa_key_t* privkey, int threads) {
+    CATCRYPT_REF_COUNTED_USE(encrypted);
+    CATCRYPT_REF_COUNTED_USE(privkey);
+
+    catcrypt_string_t* decrypted = catcrypt_rsa_is_v2(encrypted->data)
+                                   ? catcrypt_rsa_decrypt_v2(encrypted->data, privkey, threads)
+                                   : catcrypt_rsa_decrypt_v1(encrypted->data, privkey, threads);
+
+    CATCRYPT_REF_COUNTED_LEAVE(encrypted);
+    CATCRYPT_REF_COUNTED_LEAVE(privkey);
+
+    return decrypted;
+}
+
+catcrypt_string_t* catcrypt_rsa_decrypt(catcrypt_rsa_encrypted_t* encrypted, catcrypt_rsa_key_t* privkey) {
+    return catcrypt_rsa_decrypt__threads(encrypted, privkey, 1);
+}
+
+size_t catcrypt_rsa_decrypt_itch(char* encrypted, size_t length) {
+    catcrypt_rsa_header_t header;
+    return catcrypt_rsa_header_read__n(encrypted, length, &header) ? header.length: 0;
+}
+
+bool catcrypt_rsa_decrypt__into(char* output, size_t size, char* encrypted, size_t length, catcrypt_rsa_key_t* privkey) {
+    // The header is read before block 0 can overwrite it
+    catcrypt_rsa_header_t header;
+    if (!catcrypt_rsa_header_read_for_key__n(encrypted, length, privkey, &header) || (size < header.length)) {
+        return false;
+    }
+
+    return catcrypt_rsa_decrypt_blocks(output, encrypted, &header, privkey, 1);
+}
+
+catcrypt_string_t* catcrypt_rsa_decrypt_block(catcrypt_rsa_encrypted_t* encrypted, catcrypt_rsa_key_t* privkey, size_t index) {
+    CATCRYPT_REF_COUNTED_USE(encrypted);
+    CATCRYPT_REF_COUNTED_USE(privkey);
+
+    catcrypt_string_t* decrypted = NULL;
+    catcrypt_rsa_header_t header;
+
+    if (catcrypt_rsa_header_read_for_key(encrypted->data, privkey, &header) && (index < header.blocks)) {
+        size_t size = catcrypt_rsa_block_width(header.block_size, header.length, index);
+        decrypted = catcrypt_string_new__n(size);
+        decrypted->length = size;
+        decrypted->value[size] = '\0';
+
+        // The block is found from its index alone
+        catcrypt_rsa_blocks_t blocks;
+        blocks.count = 1;
+        blocks.key = privkey;
+        blocks.input = encrypted->data->value + CATCRYPT_RSA_HEADER_SIZE + (index * header.key_size);
+        blocks.input_stride = header.key_size;
+        blocks.input_length = header.key_size;
+        blocks.inputs = NULL;
+        blocks.input_sizes = NULL;
+        blocks.output = decrypted->value;
+        blocks.output_stride = size;
+        blocks.output_length = size;
+        blocks.is_prefixed = false;
+
+        catcrypt_rsa_blocks_run(&blocks, 1);
+
+        if (atomic_load(&blocks.is_failed)) {
+            catcrypt_string_free(decrypted);
+            decrypted = NULL;
+        }
+    }
+
+    CATCRYPT_REF_COUNTED_LEAVE(encrypted);
+    CATCRYPT_REF_COUNTED_LEAVE(privkey);
+
+    return decrypted;
+}
+
+void catcrypt_rsa_decrypt__batch(catcrypt_string_t** decrypted, catcrypt_rsa_encrypted_t** encrypted, catcrypt_rsa_key_t** privkeys, int count) {
+    // version is 0 for v2 data that can't be decrypted with its key, for malformed v1 data and for data longer than a string can be,
+    // blocks is the count of v1 blocks too
+    catcrypt_rsa_header_t* headers = malloc(sizeof(catcrypt_rsa_header_t) * count);
+    bool* is_failed = calloc(count, sizeof(bool));
+
+    int blocks = 0;
+    for (int i = 0; i < count; i++) {
+        CATCRYPT_REF_COUNTED_USE(encrypted[i]);
+        CATCRYPT_REF_COUNTED_USE(privkeys[i]);
+
+        // Outputs are allocated at the length of their data at most (a v2 payload is shorter than its blocks)
+        if (encrypted[i]->data->length > CATCRYPT_STRING_MAX_LENGTH) {
+            headers[i].version = 0;
+            headers[i].blocks = 0;
+        } else if (!catcrypt_rsa_is_v2(encrypted[i]->data)) {
+            int v1_count = catcrypt_rsa_v1_count(encrypted[i]->data);
+            headers[i].version = (v1_count < 0) ? 0: CATCRYPT_RSA_FORMAT_V1;
+            headers[i].blocks = (v1_count < 0) ? 0: v1_count;
+        } else if (!catcrypt_rsa_header_read_for_key(encrypted[i]->data, privkeys[i], &headers[i])) {
+            headers[i].version = 0;
+            headers[i].blocks = 0;
+        }
+
+        blocks += headers[i].blocks;
+    }
+
+    mpz_t* c = malloc(sizeof(mpz_t) * blocks);
+    mpz_t* m = malloc(sizeof(mpz_t) * blocks);
+    catcrypt_rsa_key_t** keys = malloc(sizeof(catcrypt_rsa_key_t *) * blocks);
+
+    // Every block of every message goes into the same batch call, a message's blocks have the same exponent so they go to different batches
+    int block = 0;
+    for (int i = 0; i < count; i++) {
+        char* cursor = encrypted[i]->data->value + ((headers[i].version == CATCRYPT_RSA_FORMAT_V2) ? CATCRYPT_RSA_HEADER_SIZE: 0);
+
+        for (uint64_t j = 0; j < headers[i].blocks; j++, block++) {
+            size_t to_decrypt = headers[i].key_size;
+            if (headers[i].version == CATCRYPT_RSA_FORMAT_V1) {
+                memcpy(&to_decrypt, cursor, sizeof(to_decrypt));
+                cursor += sizeof(size_t);
+            }
+
+            mpz_init(c[block]);
+            mpz_init(m[block]);
+            mpz_import(c[block], to_decrypt, CATCRYPT_MPZ_ORDER, 1, CATCRYPT_MPZ_ENDIAN, 0, cursor);
+            keys[block] = privkeys[i];
+
+            if (mpz_cmp(c[block], privkeys[i]->n) >= 0) {
+                mpz_set_ui(c[block], 0);
+                is_failed[i] = true;
+            }
+
+            cursor += to_decrypt;
+        }
+    }
+
+    catcrypt_rsa_key_powm__batch(m, c, keys, blocks);
+
+    block = 0;
+    for (int i = 0; i < count; i++) {
+        if (headers[i].version == 0) {
+            decrypted[i] = NULL;
+            continue;
+        }
+
+        if (headers[i].version == CATCRYPT_RSA_FORMAT_V2) {
+            decrypted[i] = catcrypt_string_new__n(headers[i].length);
+            decrypted[i]->length = headers[i].length;
+            decrypted[i]->value[headers[i].length] = '\0';
+        } else {
+            decrypted[i] = catcrypt_string_new__n(encrypted[i]->data->length);
+        }
+
+        char* m_str = malloc(catcrypt_rsa_key_size(privkeys[i]));
+
+        for (uint64_t j = 0; j < headers[i].blocks; j++, block++) {
+            if (headers[i].version == CATCRYPT_RSA_FORMAT_V2) {
+                size_t size = catcrypt_rsa_block_width(headers[i].block_size, headers[i].length, j);
+                is_failed[i] |= !catcrypt_rsa_block_export(decrypted[i]->value + (j * headers[i].block_size), size, m[block]);
+            } else {
+                size_t bignum_size = 0;
+                mpz_export(m_str, &bignum_size, CATCRYPT_MPZ_ORDER, 1, CATCRYPT_MPZ_ENDIAN, 0, m[block]);
+                catcrypt_string_append__cstr__n(decrypted[i], m_str, bignum_size);
+            }
+
+            mpz_clear(c[block]);
+            mpz_clear(m[block]);
+        }
+
+        free(m_str);
+
+        if (is_failed[i]) {
+            catcrypt_string_free(decrypted[i]);
+            decrypted[i] = NULL;
+        }
+    }
+
+    free(c);
+    free(m);
+    free(keys);
+    free(headers);
+    free(is_failed);
+
+    for (int i = 0; i < count; i++) {
+        CATCRYPT_REF_COUNTED_LEAVE(encrypted[i]);
+        CATCRYPT_REF_COUNTED_LEAVE(privkeys[i]);
+    }
+}
+
+static catcrypt_rsa_stream_t* catcrypt_rsa_stream_new(catcrypt_rsa_key_t* key, catcrypt_rsa_sink_f_t sink, void* context) {
+    catcrypt_rsa_stream_t* stream = malloc(sizeof(catcrypt_rsa_stream_t));
+    CATCRYPT_REF_COUNTED_INIT(stream, catcrypt_rsa_stream_free);
+
+    CATCRYPT_REF_COUNTED_USE(key);
+    stream->key = key;
+    stream->sink = sink;
+    stream->context = context;
+    stream->is_header_read = false;
+    stream->is_failed = false;
+    stream->blocks = 0;
+    stream->taken = 0;
+
+    // A whole block of either side or the header is the most that is kept between updates
+    size_t key_size = catcrypt_rsa_key_size(key);
+    stream->buffer = malloc((key_size > CATCRYPT_RSA_HEADER_SIZE) ? key_size: CATCRYPT_RSA_HEADER_SIZE);
+    stream->buffer_length = 0;
+    stream->output = malloc(CATCRYPT_RSA_STREAM_BLOCKS * key_size);
+
+    return stream;
+}
+
+/**
+ * Encrypts or decrypts count whole blocks at input, CATCRYPT_RSA_STREAM_BLOCKS at a time, and gives their results to the sink.
+ */
+static bool catcrypt_rsa_stream_run(catcrypt_rsa_stream_t* stream, char* input, uint64_t count) {
+    while ((count > 0) && !stream->is_failed) {
+        int group = (count < CATCRYPT_RSA_STREAM_BLOCKS) ? count: CATCRYPT_RSA_STREAM_BLOCKS;
+        uint64_t input_left = stream->input_length - (stream->blocks * stream->input_stride);
+        uint64_t output_left = stream->output_length - (stream->blocks * stream->output_stride);
+
+        catcrypt_rsa_blocks_t blocks;
+        blocks.count = group;
+        blocks.key = stream->key;
+        blocks.input = input;
+        blocks.input_stride = stream->input_stride;
+        blocks.input_length = ((group * stream->input_stride) < input_left) ? (group * stream->input_stride): input_left;
+        blocks.inputs = NULL;
+        blocks.input_sizes = NULL;
+        blocks.output = stream->output;
+        blocks.output_stride = stream->output_stride;
+        blocks.output_length = ((group * stream->output_stride) < output_left) ? (group * stream->output_stride): output_left;
+        blocks.is_prefixed = false;
+
+        catcrypt_rsa_blocks_run(&blocks, 1);
+
+        if (atomic_load(&blocks.is_failed) || !stream->sink(stream->context, stream->output, blocks.output_length)) {
+            stream->is_failed = true;
+        }
+
+        stream->blocks += group;
+        input += group * stream->input_stride;
+        count -= group;
+    }
+
+    return !stream->is_failed;
+}
+
+/**
+ * Blocks of input_stride bytes go in and blocks of output_stride bytes come out, only the last one can be shorter on either side.
+ */
+static void catcrypt_rsa_stream_set_header(catcrypt_rsa_stream_t* stream, catcrypt_rsa_header_t* header, bool is_encrypt) {
+    stream->header = *header;
+    stream->is_header_read = true;
+
+    uint64_t encrypted_length = header->blocks * header->key_size;
+    stream->input_stride = is_encrypt ? header->block_size: header->key_size;
+    stream->input_length = is_encrypt ? header->length: encrypted_length;
+    stream->output_stride = is_encrypt ? header->key_size: header->block_size;
+    stream->output_length = is_encrypt ? encrypted_length: header->length;
+}
+
+catcrypt_rsa_stream_t* catcrypt_rsa_encrypt_init(catcrypt_rsa_key_t* pubkey, size_t length, catcrypt_rsa_sink_f_t sink, void* context) {
+    catcrypt_rsa_stream_t* stream = catcrypt_rsa_stream_new(pubkey, sink, context);
+
+    catcrypt_rsa_header_t header;
+    catcrypt_rsa_header_init(&header, pubkey, length);
+
+    catcrypt_rsa_stream_set_header(stream, &header, true);
+
+    // The header carries the length, that's why it has to be known before the first chunk
+    catcrypt_rsa_header_write(stream->buffer, &header);
+    stream->is_failed = !sink(context, stream->buffer, CATCRYPT_RSA_HEADER_SIZE);
+
+    return stream;
+}
+
+catcrypt_rsa_stream_t* catcrypt_rsa_decrypt_init(catcrypt_rsa_key_t* privkey, catcrypt_rsa_sink_f_t sink, void* context) {
+    return catcrypt_rsa_stream_new(privkey, sink, context);
+}
+
+bool catcrypt_rsa_stream_update(catcrypt_rsa_stream_t* stream, char* data, size_t length) {
+    if (stream->is_failed) {
+        return false;
+    }
+
+    if (!stream->is_header_read) {
+        size_t header_part = CATCRYPT_RSA_HEADER_SIZE - stream->buffer_length;
+        header_part = (length < header_part) ? length: header_part;
+
+        memcpy(stream->buffer + stream->buffer_length, data, header_part);
+        stream->buffer_length += header_part;
+        data += header_part;
+        length -= header_part;
+
+        if (stream->buffer_length < CATCRYPT_RSA_HEADER_SIZE) {
+            return true;
+        }
+
+        catcrypt_rsa_header_t header;
+        if (!catcrypt_rsa_header_parse(stream->buffer, &header) || !catcrypt_rsa_header_is_for_key(&header, stream->key)) {
+            stream->is_failed = true;
+            return false;
+        }
+
+        catcrypt_rsa_stream_set_header(stream, &header, false);
+        stream->buffer_length = 0;
+    }
+
+    // Nothing can come after the last block
+    if (length > (stream->input_length - stream->taken)) {
+        stream->is_failed = true;
+        return false;
+    }
+
+    stream->taken += length;
+
+    // A block that was started by an earlier chunk is completed first
+    if (stream->buffer_length > 0) {
+        size_t width = catcrypt_rsa_block_width(stream->input_stride, stream->input_length, stream->blocks);
+        size_t part = ((width - stream->buffer_length) < length) ? (width - stream->buffer_length): length;
+
+        memcpy(stream->buffer + stream->buffer_length, data, part);
+        stream->buffer_length += part;
+        data += part;
+        length -= part;
+
+        if (stream->buffer_length < width) {
+            return true;
+        }
+
+        stream->buffer_length = 0;
+        if (!catcrypt_rsa_stream_run(stream, stream->buffer, 1)) {
+            return false;
+        }
+    }
+
+    // Whole blocks are read from data itself, the last block of the stream is whole when all of it is here
+    uint64_t count = length / stream->input_stride;
+    size_t whole_length = count * stream->input_stride;
+    if (length == (stream->input_length - (stream->blocks * stream->input_stride))) {
+        count = stream->header.blocks - stream->blocks;
+        whole_length = length;
+    }
+
+    if (!catcrypt_rsa_stream_run(stream, data, count)) {
+        return false;
+    }
+
+    memcpy(stream->buffer, data + whole_length, length - whole_length);
+    stream->buffer_length = length - whole_length;
+
+    return true;
+}
+
+bool catcrypt_rsa_stream_final(catcrypt_rsa_stream_t* stream) {
+    return !stream->is_failed && stream->is_header_read && (stream->blocks == stream->header.blocks);
+}
+
+void catcrypt_rsa_stream_free(catcrypt_rsa_stream_t* stream) {
+    CATCRYPT_REF_COUNTED_LEAVE(stream->key);
+    free(stream->buffer);
+    free(stream->output);
+    free(stream);
+}
+
+bool catcrypt_rsa_sink_string(void* context, char* data, size_t length) {
+    catcrypt_string_append__cstr__n(context, data, length);
+    return true;
+}
+
+
+size_t catcrypt_rsa_sign_itch(catcrypt_rsa_key_t* privkey) {
+    return catcrypt_rsa_encrypted_size(privkey, sizeof(uint32_t));
+}
+
+bool catcrypt_rsa_sign__into(char* output, size_t size, char* data, size_t length, catcrypt_rsa_key_t* privkey) {
+    if (size < catcrypt_rsa_sign_itch(privkey)) {
+        return false;
+    }
+
+    uint32_t hash = catcrypt_rsa_hash_h32__n(data, length);
+    catcrypt_rsa_encrypt_blocks(output, (char *) &hash, sizeof(hash), privkey, 1);
+
+    return true;
+}
+
+int catcrypt_rsa_sign__iov(struct iovec* output, int output_count, struct iovec* input, int input_count, catcrypt_rsa_key_t* privkey) {
+    uint32_t hash = catcrypt_rsa_hash_h32__iov(input, input_count);
+    struct iovec hash_iov = {&hash, sizeof(hash)};
+
+    return catcrypt_rsa_encrypt__iov(output, output_count, &hash_iov, 1, privkey);
+}
+
+catcrypt_string_t* catcrypt_rsa_sign(catcrypt_string_t* data, catcrypt_rsa_key_t* privkey) {
+    CATCRYPT_REF_COUNTED_USE(data);
+    CATCRYPT_REF_COUNTED_USE(privkey);
+
+    size_t size = catcrypt_rsa_sign_itch(privkey);
+    catcrypt_string_t* signature = catcrypt_string_new__n(size);
+    signature->length = size;
+    signature->value[size] = '\0';
+    catcrypt_rsa_sign__into(signature->value, size, data->value, data->length, privkey);
+
+    CATCRYPT_REF_COUNTED_LEAVE(data);
+    CATCRYPT_REF_COUNTED_LEAVE(privkey);
+
+    return signature;
+}
+
+/**
+ * A v2 signature is one key_size byte block of s under the header of a 4 byte message from the same key.
+ * A v1 signature is its length prefix and at most key_size bytes of s, only a hash that doesn't start with a zero byte
+ * can verify with it (v1 decryption drops leading zeros).
+ * expected is the hash as the number s ^ e must be, false if the signature can't verify.
+ */
+static bool catcrypt_rsa_signature_parse(catcrypt_string_t* data, catcrypt_string_t* signature, catcrypt_rsa_key_t* pubkey, char** block, size_t* block_size, uint32_t* expected) {
+    uint32_t hash = catcrypt_rsa_hash_h32__n(data->value, data->length);
+    unsigned char* hash_bytes = (unsigned char *) &hash;
+
+    if (catcrypt_rsa_is_v2(signature)) {
+        catcrypt_rsa_header_t header;
+        if (!catcrypt_rsa_header_read_for_key(signature, pubkey, &header) || (header.blocks != 1) || (header.length != sizeof(hash))) {
+            return false;
+        }
+
+        *block = signature->value + CATCRYPT_RSA_HEADER_SIZE;
+        *block_size = header.key_size;
+    } else {
+        if (signature->length < sizeof(size_t)) {
+            return false;
+        }
+
+        size_t to_verify;
+        memcpy(&to_verify, signature->value, sizeof(to_verify));
+        if ((signature->length != (sizeof(size_t) + to_verify)) || (to_verify > catcrypt_rsa_key_size(pubkey)) || (hash_bytes[0] == 0)) {
+            return false;
+        }
+
+        *block = signature->value + sizeof(size_t);
+        *block_size = to_verify;
+    }
+
+    // s = 0 would be a signature of a zero hash under every key
+    *expected = ((uint32_t) hash_bytes[0] << 24) | ((uint32_t) hash_bytes[1] << 16) | ((uint32_t) hash_bytes[2] << 8) | hash_bytes[3];
+    return *expected != 0;
+}
+
+/**
+ * Big-endian bytes (at most size limbs of them) into size limbs.
+ */
+static void catcrypt_rsa_limbs_from_bytes(mp_limb_t* rp, mp_size_t size, char* bytes, size_t length) {
+    mpn_zero(rp, size);
+
+    for (size_t i = 0; i < length; i++) {
+        mp_limb_t byte = (unsigned char) bytes[length - 1 - i];
+        rp[i / sizeof(mp_limb_t)] |= byte << (8 * (i % sizeof(mp_limb_t)));
+    }
+}
+
+mp_size_t catcrypt_rsa_verify_itch(catcrypt_rsa_key_t* pubkey) {
+    catcrypt_rsa_key_prepare(pubkey);
+
+    mp_size_t size = mpz_size(pubkey->n);
+    mp_size_t itch = 3 * size;
+
+    catcrypt_rsa_prepared_t* prepared = atomic_load_explicit(&pubkey->prepared, memory_order_acquire);
+    if (prepared) {
+        mp_size_t exponent_itch = catcrypt_mont_powm_exponent_itch(&prepared->mont, &prepared->exponent);
+        itch = (exponent_itch > itch) ? exponent_itch: itch;
+    } else {
+        mp_size_t sec_itch = mpn_sec_powm_itch(size, mpz_sizeinbase(pubkey->e, 2), size);
+        itch = (sec_itch > itch) ? sec_itch: itch;
+    }
+
+    return 2 * size + itch;
+}
+
+bool catcrypt_rsa_verify__scratch(catcrypt_string_t* data, catcrypt_string_t* signature, catcrypt_rsa_key_t* pubkey, mp_limb_t* scratch) {
+    CATCRYPT_REF_COUNTED_USE(data);
+    CATCRYPT_REF_COUNTED_USE(signature);
+    CATCRYPT_REF_COUNTED_USE(pubkey);
+
+    bool result = false;
+
+    char* block;
+    size_t block_size;
+    uint32_t expected;
+    bool is_parsed = catcrypt_rsa_signature_parse(data, signature, pubkey, &block, &block_size, &expected);
+    mp_size_t size = mpz_size(pubkey->n);
+
+    // Generated and loaded public keys are already prepared, this only costs something the first time for the others
+    catcrypt_rsa_key_prepare(pubkey);
+
+    if (is_parsed && mpz_odd_p(pubkey->n)) {
+        if (!scratch) {
+            scratch = catcrypt_rsa_sec_get_scratch(catcrypt_rsa_verify_itch(pubkey));
+        }
+
+        mp_limb_t* bp = scratch;
+        mp_limb_t* rp = bp + size;
+        mp_limb_t* tp = rp + size;
+
+        catcrypt_rsa_limbs_from_bytes(bp, size, block, block_size);
+
+        // s >= n is rejected before the exponentiation, s and s + n must not both be valid signatures
+        if (mpn_cmp(bp, mpz_limbs_read(pubkey->n), size) < 0) {
+            catcrypt_rsa_prepared_t* prepared = atomic_load_explicit(&pubkey->prepared, memory_order_acquire);
+
+            if (prepared && prepared->small_e) {
+                catcrypt_mont_powm_ui(&prepared->mont, rp, bp, prepared->small_e, tp);
+            } else if (prepared) {
+                catcrypt_mont_powm_exponent(&prepared->mont, rp, bp, &prepared->exponent, tp);
+                catcrypt_mont_from(&prepared->mont, rp, rp, tp);
+            } else {
+                mpn_sec_powm(rp, bp, size, mpz_limbs_read(pubkey->e), mpz_sizeinbase(pubkey->e, 2), mpz_limbs_read(pubkey->n), size, tp);
+            }
+
+            result = (rp[0] == expected) && ((size == 1) || mpn_zero_p(rp + 1, size - 1));
+        }
+    }
+
+    CATCRYPT_REF_COUNTED_LEAVE(data);
+    CATCRYPT_REF_COUNTED_LEAVE(signature);
+    CATCRYPT_REF_COUNTED_LEAVE(pubkey);
+
+    return result;
+}
 
-    return hash;
+bool catcrypt_rsa_verify(catcrypt_string_t* data, catcrypt_string_t* signature, catcrypt_rsa_key_t* pubkey) {
+    return catcrypt_rsa_verify__scratch(data, signature, pubkey, NULL);
 }
 
-bool catcrypt_rsa_random_seed(unsigned char* seed, size_t size) {
-    FILE* urandom = fopen("/dev/urandom", "r");
-    if (urandom == NULL) {
+/**
+ * Signatures that can verify are screened as s ^ e = m mod n, the others go through catcrypt_rsa_verify().
+ */
+static bool catcrypt_rsa_signature_screenable(catcrypt_string_t* data, catcrypt_string_t* signature, catcrypt_rsa_key_t* pubkey, mpz_t s, mpz_t m) {
+    char* block;
+    size_t block_size;
+    uint32_t expected;
+    if (!catcrypt_rsa_signature_parse(data, signature, pubkey, &block, &block_size, &expected)) {
         return false;
     }
-    
-    size_t bytes_read = fread(seed, size, 1, urandom);
-    if (bytes_read != 1) {
-        fclose(urandom);
+
+    mpz_import(s, block_size, CATCRYPT_MPZ_ORDER, 1, CATCRYPT_MPZ_ENDIAN, 0, block);
+    if (mpz_cmp(s, pubkey->n) >= 0) {
         return false;
     }
-
-    fclose(urandom);
+    mpz_set_ui(m, expected);
 
     return true;
 }
 
-void catcrypt_rsa_random_prime(mpz_t num) {
-    unsigned char seed[CATCRYPT_RSA_PRIME_BITS / 8];
-    
-    catcrypt_rsa_random_seed_adds_t adds = 0;
-    
-    GEN_ADDS:
-    
-    if (!catcrypt_rsa_random_seed((unsigned char *) &adds, sizeof(adds))) {
-        fprintf(stderr, "catcrypt_rsa_random_prime(): Failed to generate random seed.\n");
+/**
+ * Bellare-Garay-Rabin small exponent test: (prod s_i ^ t_i) ^ e = prod m_i ^ t_i mod n with random CATCRYPT_RSA_SCREEN_BITS bit t_i.
+ * prod s_i ^ t_i is one multi-exponentiation with buckets (Pippenger) in the Montgomery context of the key: a window of c bits
+ * costs one multiplication per item and 2^(c + 1) for the buckets. The s_i go in as they are, so they are read as s_i * R^-1
+ * and the product comes out as P * R^(1 - T), T = sum t_i, one short exponentiation of R fixes it.
+ * The m_i are hashes, their buckets are plain products that only get reduced when they are as long as n.
+ * A bad item passes with probability 2^-CATCRYPT_RSA_SCREEN_BITS, except n - s: (-1) ^ t_i only catches it half the time
+ * (-1 is the only element of small order that is known without the primes).
+ */
+static bool catcrypt_rsa_screen(mpz_t* s, mpz_t* m, int* indexes, int count, catcrypt_rsa_key_t* pubkey) {
+    catcrypt_rsa_prepared_t* prepared = atomic_load_explicit(&pubkey->prepared, memory_order_acquire);
+    catcrypt_mont_t* mont = &prepared->mont;
+    mp_size_t size = mont->size;
+
+    uint64_t* t = malloc(sizeof(uint64_t) * count);
+    if (!catcrypt_rng_fill(t, sizeof(uint64_t) * count)) {
+        fprintf(stderr, "catcrypt_rsa_screen(): Failed to generate random exponents.\n");
         exit(1);
     }
-    adds &= CATCRYPT_RSA_RANDOM_SEED_ADDS_MASK;
 
-    if (adds == 0) {
-        goto GEN_ADDS;
+    mpz_t total;
+    mpz_init(total);
+    for (int i = 0; i < count; i++) {
+        t[i] &= (~(uint64_t) 0) >> (64 - CATCRYPT_RSA_SCREEN_BITS);
+        mpz_add_ui(total, total, t[i]);
+    }
+
+    // The window that costs the least: windows * (count + 2 * buckets)
+    int window_bits = 1;
+    for (int bits = 2; bits <= 12; bits++) {
+        uint64_t cost = ((CATCRYPT_RSA_SCREEN_BITS + bits - 1) / bits) * (uint64_t) (count + (2 << bits));
+        uint64_t best = ((CATCRYPT_RSA_SCREEN_BITS + window_bits - 1) / window_bits) * (uint64_t) (count + (2 << window_bits));
+        if (cost < best) {
+            window_bits = bits;
+        }
+    }
+    int buckets_count = 1 << window_bits;
+    int windows = (CATCRYPT_RSA_SCREEN_BITS + window_bits - 1) / window_bits;
+
+    mp_limb_t* limbs = malloc(sizeof(mp_limb_t) * size * (count + buckets_count + 4));
+    mp_limb_t* s_limbs = limbs;
+    mp_limb_t* s_buckets = s_limbs + (count * size);
+    mp_limb_t* s_acc = s_buckets + (buckets_count * size);
+    mp_limb_t* s_running = s_acc + size;
+    mp_limb_t* tp = s_running + size;
+    bool* is_filled = malloc(sizeof(bool) * buckets_count);
+
+    mpz_t* m_buckets = malloc(sizeof(mpz_t) * buckets_count);
+    for (int i = 0; i < buckets_count; i++) {
+        mpz_init(m_buckets[i]);
+    }
+    mpz_t m_acc;
+    mpz_init_set_ui(m_acc, 1);
+    mpz_t m_running;
+    mpz_init(m_running);
+    mpz_t check;
+    mpz_init(check);
+
+    for (int i = 0; i < count; i++) {
+        catcrypt_mont_limbs_from_mpz(s_limbs + (i * size), size, s[indexes[i]]);
+    }
+    mpn_copyi(s_acc, mont->one, size);
+
+    for (int w = windows - 1; w >= 0; w--) {
+        if (w != (windows - 1)) {
+            for (int i = 0; i < window_bits; i++) {
+                catcrypt_mont_sqr(mont, s_acc, s_acc, tp);
+                mpz_mul(m_acc, m_acc, m_acc);
+                mpz_mod(m_acc, m_acc, pubkey->n);
+            }
+        }
+
+        for (int i = 1; i < buckets_count; i++) {
+            is_filled[i] = false;
+            mpz_set_ui(m_buckets[i], 1);
+        }
+
+        for (int i = 0; i < count; i++) {
+            int digit = (t[i] >> (w * window_bits)) & (buckets_count - 1);
+            if (!digit) {
+                continue;
+            }
+
+            mp_limb_t* bucket = s_buckets + (digit * size);
+            if (is_filled[digit]) {
+                catcrypt_mont_mul(mont, bucket, bucket, s_limbs + (i * size), tp);
+            } else {
+                mpn_copyi(bucket, s_limbs + (i * size), size);
+                is_filled[digit] = true;
+            }
+
+            mpz_mul(m_buckets[digit], m_buckets[digit], m[indexes[i]]);
+            if (mpz_size(m_buckets[digit]) >= size) {
+                mpz_mod(m_buckets[digit], m_buckets[digit], pubkey->n);
+            }
+        }
+
+        // prod bucket_d ^ d: running products from the top bucket down, every one multiplied in
+        bool is_running = false;
+        mpz_set_ui(m_running, 1);
+        for (int i = buckets_count - 1; i > 0; i--) {
+            if (is_filled[i]) {
+                if (is_running) {
+                    catcrypt_mont_mul(mont, s_running, s_running, s_buckets + (i * size), tp);
+                } else {
+                    mpn_copyi(s_running, s_buckets + (i * size), size);
+                    is_running = true;
+                }
+
+                mpz_mul(m_running, m_running, m_buckets[i]);
+                mpz_mod(m_running, m_running, pubkey->n);
+            }
+
+            if (is_running) {
+                catcrypt_mont_mul(mont, s_acc, s_acc, s_running, tp);
+                mpz_mul(m_acc, m_acc, m_running);
+                mpz_mod(m_acc, m_acc, pubkey->n);
+            }
+        }
     }
-    
-    mpz_t to_add;
 
-    ADD:
+    // P = (P * R^(1 - T)) * R^(T - 1)
+    catcrypt_mont_limbs_to_mpz(check, mont->one, size);
+    mpz_sub_ui(total, total, 1);
+    mpz_powm(check, check, total, pubkey->n);
+    catcrypt_mont_limbs_to_mpz(m_running, s_acc, size);
+    mpz_mul(check, check, m_running);
+    mpz_mod(check, check, pubkey->n);
 
-    mpz_init(to_add);
-    if (!catcrypt_rsa_random_seed(seed, CATCRYPT_RSA_PRIME_BITS / 8)) {
-        fprintf(stderr, "catcrypt_rsa_random_prime(): Failed to generate random seed.\n");
-        exit(1);
+    catcrypt_rsa_key_powm(m_running, check, pubkey);
+    bool is_passed = mpz_cmp(m_running, m_acc) == 0;
+
+    for (int i = 0; i < buckets_count; i++) {
+        mpz_clear(m_buckets[i]);
     }
-    mpz_import(to_add, CATCRYPT_RSA_PRIME_BITS / 8, 1, sizeof(seed[0]), 0, 0, seed);
+    free(m_buckets);
+    free(is_filled);
+    free(limbs);
+    free(t);
+    mpz_clear(total);
+    mpz_clear(m_acc);
+    mpz_clear(m_running);
+    mpz_clear(check);
+
+    return is_passed;
+}
 
-    if (adds > 0) {
-        mpz_add(num, num, to_add);
-        adds--;
-        goto ADD;
+/**
+ * A batch that fails is split in two until the bad items are alone, small batches are checked one by one.
+ */
+static void catcrypt_rsa_screen_bisect(uint8_t* results, mpz_t* s, mpz_t* m, int* indexes, int count, catcrypt_rsa_key_t* pubkey) {
+    // Screening needs the Montgomery context of the key
+    if ((count < CATCRYPT_RSA_SCREEN_MIN) || !catcrypt_rsa_key_prepare(pubkey)) {
+        mpz_t rop;
+        mpz_init(rop);
+
+        for (int i = 0; i < count; i++) {
+            catcrypt_rsa_key_powm(rop, s[indexes[i]], pubkey);
+            if (mpz_cmp(rop, m[indexes[i]]) == 0) {
+                CATCRYPT_RSA_BITMAP_SET(results, indexes[i]);
+            }
+        }
+
+        mpz_clear(rop);
+        return;
     }
 
-    mpz_setbit(num, 0);
-    
-    while (!mpz_probab_prime_p(num, CATCRYPT_RSA_PRIME_REPS)) {
-        mpz_add_ui(num, num, 2);
+    if (catcrypt_rsa_screen(s, m, indexes, count, pubkey)) {
+        for (int i = 0; i < count; i++) {
+            CATCRYPT_RSA_BITMAP_SET(results, indexes[i]);
+        }
+        return;
     }
 
-    mpz_clear(to_add);
+    catcrypt_rsa_screen_bisect(results, s, m, indexes, count / 2, pubkey);
+    catcrypt_rsa_screen_bisect(results, s, m, indexes + (count / 2), count - (count / 2), pubkey);
 }
 
-catcrypt_rsa_key_t* catcrypt_rsa_key_new() {
-    catcrypt_rsa_key_t* key = malloc(sizeof(catcrypt_rsa_key_t));
-    CATCRYPT_REF_COUNTED_INIT(key, catcrypt_rsa_key_free);
-    CATCRYPT_REF_COUNTED_USE(key);
-    
-    mpz_init(key->e);
-    mpz_init(key->n);
+bool catcrypt_rsa_verify__batch(uint8_t* results, catcrypt_string_t** data, catcrypt_string_t** signatures, catcrypt_rsa_key_t** pubkeys, int count) {
+    for (int i = 0; i < count; i++) {
+        CATCRYPT_REF_COUNTED_USE(data[i]);
+        CATCRYPT_REF_COUNTED_USE(signatures[i]);
+        CATCRYPT_REF_COUNTED_USE(pubkeys[i]);
+    }
 
-    return key;
-}
+    memset(results, 0, CATCRYPT_RSA_BITMAP_SIZE(count));
 
-void catcrypt_rsa_key_free(catcrypt_rsa_key_t* key) {
-    mpz_clear(key->e);
-    mpz_clear(key->n);
-    free(key);
-}
+    mpz_t* s = malloc(sizeof(mpz_t) * count);
+    mpz_t* m = malloc(sizeof(mpz_t) * count);
+    bool* is_grouped = calloc(count, sizeof(bool));
+    int* indexes = malloc(sizeof(int) * count);
 
-catcrypt_rsa_keypair_t* catcrypt_rsa_keypair_new() {
-    catcrypt_rsa_keypair_t* keypair = malloc(sizeof(catcrypt_rsa_keypair_t));
-    CATCRYPT_REF_COUNTED_INIT(keypair, catcrypt_rsa_keypair_free);
-    CATCRYPT_REF_COUNTED_USE(keypair);
-    
-    keypair->pubkey = catcrypt_rsa_key_new();
-    CATCRYPT_REF_COUNTED_USE(keypair->pubkey);
-    keypair->privkey = catcrypt_rsa_key_new();
-    CATCRYPT_REF_COUNTED_USE(keypair->privkey);
-    
-    mpz_init(keypair->pubkey->n);
-    mpz_init(keypair->pubkey->e);
-    
-    mpz_init(keypair->privkey->n);
-    mpz_init(keypair->privkey->e);
+    for (int i = 0; i < count; i++) {
+        mpz_init(s[i]);
+        mpz_init(m[i]);
 
-    mpz_t p;
-    mpz_init(p);
-    mpz_t q;
-    mpz_init(q);
-    mpz_t n;
-    mpz_init(n);
-    mpz_t phi;
-    mpz_init(phi);
-    mpz_t e;
-    mpz_init(e);
-    mpz_t d;
-    mpz_init(d);
-    mpz_t pmo;
-    mpz_init(pmo);
-    mpz_t qmo;
-    mpz_init(qmo);
+        if (!catcrypt_rsa_signature_screenable(data[i], signatures[i], pubkeys[i], s[i], m[i])) {
+            is_grouped[i] = true;
+            if (catcrypt_rsa_verify(data[i], signatures[i], pubkeys[i])) {
+                CATCRYPT_RSA_BITMAP_SET(results, i);
+            }
+        }
+    }
 
-    mpz_set_ui(e, CATCRYPT_RSA_PUB_EXPONENT);
+    // Items under the same key are screened together
+    for (int i = 0; i < count; i++) {
+        if (is_grouped[i]) {
+            continue;
+        }
+
+        int length = 0;
+        for (int j = i; j < count; j++) {
+            if (!is_grouped[j] && ((pubkeys[j] == pubkeys[i])
+             || ((mpz_cmp(pubkeys[j]->n, pubkeys[i]->n) == 0) && (mpz_cmp(pubkeys[j]->e, pubkeys[i]->e) == 0)))) {
+                is_grouped[j] = true;
+                indexes[length++] = j;
+            }
+        }
+
+        catcrypt_rsa_screen_bisect(results, s, m, indexes, length, pubkeys[i]);
+    }
 
-    catcrypt_rsa_random_prime(p);
-    catcrypt_rsa_random_prime(q);
+    bool is_all_verified = true;
+    for (int i = 0; i < count; i++) {
+        is_all_verified = is_all_verified && CATCRYPT_RSA_BITMAP_GET(results, i);
+        mpz_clear(s[i]);
+        mpz_clear(m[i]);
 
-    mpz_mul(n, p, q);
-    
-    mpz_set(pmo, p);
-    mpz_set(qmo, q);
-    mpz_sub_ui(pmo, p, 1);
-    mpz_sub_ui(qmo, q, 1);
-    mpz_mul(phi, pmo, qmo);
+        CATCRYPT_REF_COUNTED_LEAVE(data[i]);
+        CATCRYPT_REF_COUNTED_LEAVE(signatures[i]);
+        CATCRYPT_REF_COUNTED_LEAVE(pubkeys[i]);
+    }
 
-    CATCRYPT_UTIL_ASSERT(mpz_invert(d, e, phi));
+    free(s);
+    free(m);
+    free(is_grouped);
+    free(indexes);
 
-    mpz_set(keypair->pubkey->e, e);
-    mpz_set(keypair->pubkey->n, n);
-    
-    mpz_set(keypair->privkey->e, d);
-    mpz_set(keypair->privkey->n, n);
+    return is_all_verified;
+}
 
-    mpz_clear(p);
-    mpz_clear(q);
-    mpz_clear(n);
-    mpz_clear(phi);
-    mpz_clear(e);
-    mpz_clear(d);
-    mpz_clear(pmo);
-    mpz_clear(qmo);
 
-    return keypair;
+static const char catcrypt_rsa_hex_digits[] = "0123456789abcdef";
+
+static int catcrypt_rsa_hex_value(char digit) {
+    if ((digit >= '0') && (digit <= '9')) {
+        return digit - '0';
+    }
+    if ((digit >= 'a') && (digit <= 'f')) {
+        return digit - 'a' + 10;
+    }
+    if ((digit >= 'A') && (digit <= 'F')) {
+        return digit - 'A' + 10;
+    }
+
+    return -1;
 }
 
-void catcrypt_rsa_keypair_free(catcrypt_rsa_keypair_t* keypair) {
-    CATCRYPT_REF_COUNTED_LEAVE(keypair->pubkey);
-    CATCRYPT_REF_COUNTED_LEAVE(keypair->privkey);
-    free(keypair);
+/**
+ * length bytes of bin as 2 * length hex digits. bin can be at hex + length, every byte is read before its digits overwrite it.
+ */
+static void catcrypt_rsa_hex_encode(char* hex, char* bin, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        unsigned char byte = bin[i];
+        hex[i * 2] = catcrypt_rsa_hex_digits[byte >> 4];
+        hex[(i * 2) + 1] = catcrypt_rsa_hex_digits[byte & 0x0F];
+    }
 }
 
-catcrypt_rsa_encrypted_t* catcrypt_rsa_encrypted_new() {
-    catcrypt_rsa_encrypted_t* encrypted = malloc(sizeof(catcrypt_rsa_encrypted_t));
-    CATCRYPT_REF_COUNTED_INIT(encrypted, catcrypt_rsa_encrypted_free);
-    
-    encrypted->data = NULL;
-    encrypted->key = NULL;
+/**
+ * 2 * length hex digits as length bytes, false for a character that isn't a hex digit. bin can be hex itself.
+ */
+static bool catcrypt_rsa_hex_decode(char* bin, char* hex, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        int high = catcrypt_rsa_hex_value(hex[i * 2]);
+        int low = catcrypt_rsa_hex_value(hex[(i * 2) + 1]);
+        if ((high < 0) || (low < 0)) {
+            return false;
+        }
+
+        bin[i] = (char) ((high << 4) | low);
+    }
 
-    return encrypted;
+    return true;
 }
 
-void catcrypt_rsa_encrypted_set_key(catcrypt_rsa_encrypted_t* encrypted, catcrypt_rsa_key_t* key) {
-    CATCRYPT_REF_COUNTED_LEAVE(encrypted->key);
-    CATCRYPT_REF_COUNTED_USE(key);
-    encrypted->key = key;
-}
+bool catcrypt_rsa_signature_to_hex__into(char* output, size_t size, char* signature, size_t length) {
+    if (size < (length * 2)) {
+        return false;
+    }
 
-void catcrypt_rsa_encrypted_set_data(catcrypt_rsa_encrypted_t* encrypted, catcrypt_string_t* data) {
-    CATCRYPT_REF_COUNTED_LEAVE(encrypted->data);
-    CATCRYPT_REF_COUNTED_USE(data);
-    encrypted->data = data;
+    // The signature can be in the second half of output
+    catcrypt_rsa_hex_encode(output, signature, length);
+    return true;
 }
 
-void catcrypt_rsa_encrypted_free(catcrypt_rsa_encrypted_t* encrypted) {
-    CATCRYPT_REF_COUNTED_LEAVE(encrypted->data);
-    CATCRYPT_REF_COUNTED_LEAVE(encrypted->key);
-    free(encrypted);
+bool catcrypt_rsa_signature_from_hex__into(char* output, size_t size, char* hex, size_t length) {
+    return (size >= (length / 2)) && catcrypt_rsa_hex_decode(output, hex, length / 2);
 }
 
-catcrypt_rsa_encrypted_t* catcrypt_rsa_encrypt(catcrypt_string_t* data, catcrypt_rsa_key_t* pubkey) {
-    CATCRYPT_REF_COUNTED_USE(data);
-    CATCRYPT_REF_COUNTED_USE(pubkey);
-    
-    catcrypt_rsa_encrypted_t* encrypted = catcrypt_rsa_encrypted_new();
-    catcrypt_rsa_encrypted_set_data(encrypted, catcrypt_string_new());
-    catcrypt_rsa_encrypted_set_key(encrypted, pubkey);
-    
-    mpz_t m;
-    mpz_init(m);
-    mpz_t c;
-    mpz_init(c);
-    
-    int pages = data->length / CATCRYPT_RSA_BLOCK_SIZE;
-    if (data->length % CATCRYPT_RSA_BLOCK_SIZE != 0) {
-        pages++;
-    }
+catcrypt_string_t* catcrypt_rsa_signature_to_hex(catcrypt_string_t* signature_bin) {
+    CATCRYPT_REF_COUNTED_USE(signature_bin);
 
-    int page_size;
-    int page_offset = 0;
-    char* page;
+    size_t size = signature_bin->length * 2;
+    catcrypt_string_t* signature_hex = catcrypt_string_new__n(size);
+    signature_hex->length = size;
+    signature_hex->value[size] = '\0';
+    catcrypt_rsa_signature_to_hex__into(signature_hex->value, size, signature_bin->value, signature_bin->length);
 
-    for (int i = 0; i < pages; i++) {
-        page_size = (i == (pages-1)) ? (data->length % CATCRYPT_RSA_BLOCK_SIZE): CATCRYPT_RSA_BLOCK_SIZE;
-        page = data->value + page_offset;
-        page_offset += page_size;
+    CATCRYPT_REF_COUNTED_LEAVE(signature_bin);
+
+    return signature_hex;
+}
 
-        mpz_import(m, page_size, CATCRYPT_MPZ_ORDER, 1, CATCRYPT_MPZ_ENDIAN, 0, page);
-        mpz_powm(c, m, pubkey->e, pubkey->n);
+catcrypt_string_t* catcrypt_rsa_signature_from_hex(catcrypt_string_t* signature_hex) {
+    CATCRYPT_REF_COUNTED_USE(signature_hex);
 
-        size_t bignum_size = 0;
-        char* c_str = mpz_export(NULL, &bignum_size, CATCRYPT_MPZ_ORDER, 1, CATCRYPT_MPZ_ENDIAN, 0, c);
-        catcrypt_string_append__cstr__n(encrypted->data, (char *) (&bignum_size), sizeof(bignum_size));
-        catcrypt_string_append__cstr__n(encrypted->data, c_str, bignum_size);
-        free(c_str);
+    size_t size = signature_hex->length / 2;
+    catcrypt_string_t* signature_bin = catcrypt_string_new__n(size);
+    signature_bin->length = size;
+    signature_bin->value[size] = '\0';
+
+    if (!catcrypt_rsa_signature_from_hex__into(signature_bin->value, size, signature_hex->value, signature_hex->length)) {
+        catcrypt_string_free(signature_bin);
+        signature_bin = NULL;
     }
 
-    mpz_clear(m);
-    mpz_clear(c);
+    CATCRYPT_REF_COUNTED_LEAVE(signature_hex);
 
-    CATCRYPT_REF_COUNTED_LEAVE(data);
-    CATCRYPT_REF_COUNTED_LEAVE(pubkey);
+    return signature_bin;
+}
 
-    return encrypted; 
+static size_t catcrypt_rsa_mpz_bytes(mpz_t num) {
+    return (mpz_sgn(num) == 0) ? 0: mpz_sizeinbase(num, 256);
 }
 
-catcrypt_string_t* catcrypt_rsa_decrypt(catcrypt_rsa_encrypted_t* encrypted, catcrypt_rsa_key_t* privkey) {
-    CATCRYPT_REF_COUNTED_USE(encrypted);
-    CATCRYPT_REF_COUNTED_USE(privkey);
-    
-    catcrypt_string_t* decrypted = catcrypt_string_new();
-    mpz_t c;
-    mpz_init(c);
-    mpz_t m;
-    mpz_init(m);
+/**
+ * num with its size_t length before it, mpz_export() writes straight into output.
+ */
+static char* catcrypt_rsa_key_write_mpz(char* cursor, mpz_t num) {
+    size_t size = 0;
+    mpz_export(cursor + sizeof(size), &size, CATCRYPT_MPZ_ORDER, 1, CATCRYPT_MPZ_ENDIAN, 0, num);
+    memcpy(cursor, &size, sizeof(size));
+    return cursor + sizeof(size) + size;
+}
+
+/**
+ * NULL if cursor is NULL or num doesn't fit before end, so reads can be chained and checked once.
+ */
+static char* catcrypt_rsa_key_read_mpz(mpz_t num, char* cursor, char* end) {
+    if (!cursor || ((end - cursor) < sizeof(size_t))) {
+        return NULL;
+    }
 
-    for (int index = 0; index < encrypted->data->length;) {
-        size_t to_decrypt = *((size_t *) (encrypted->data->value + index));
+    size_t size;
+    memcpy(&size, cursor, sizeof(size));
+    cursor += sizeof(size);
+    if (size > (end - cursor)) {
+        return NULL;
+    }
 
-        char* block = encrypted->data->value + index + sizeof(size_t);
+    mpz_import(num, size, CATCRYPT_MPZ_ORDER, 1, CATCRYPT_MPZ_ENDIAN, 0, cursor);
+    return cursor + size;
+}
 
-        mpz_import(c, to_decrypt, CATCRYPT_MPZ_ORDER, 1, CATCRYPT_MPZ_ENDIAN, 0, block);
-        mpz_powm(m, c, privkey->e, privkey->n);
+static int catcrypt_rsa_key_bin_extra_primes(catcrypt_rsa_key_t* key) {
+    return (key->is_crt && (key->primes > 2)) ? (key->primes - 2): 0;
+}
 
-        size_t bignum_size = 0;
-        char* c_str = mpz_export(NULL, &bignum_size, CATCRYPT_MPZ_ORDER, 1, CATCRYPT_MPZ_ENDIAN, 0, m);
-        catcrypt_string_append__cstr__n(decrypted, c_str, bignum_size);
-        free(c_str);
+size_t catcrypt_rsa_key_to_bin_itch(catcrypt_rsa_key_t* key) {
+    size_t size = (sizeof(size_t) * 2) + catcrypt_rsa_mpz_bytes(key->e) + catcrypt_rsa_mpz_bytes(key->n);
 
-        index += sizeof(size_t);
-        index += to_decrypt;
+    if (key->is_crt) {
+        size += (sizeof(size_t) * 5) + catcrypt_rsa_mpz_bytes(key->p) + catcrypt_rsa_mpz_bytes(key->q)
+                + catcrypt_rsa_mpz_bytes(key->dp) + catcrypt_rsa_mpz_bytes(key->dq) + catcrypt_rsa_mpz_bytes(key->qinv);
     }
 
-    mpz_clear(c);
-    mpz_clear(m);
+    int extra_primes = catcrypt_rsa_key_bin_extra_primes(key);
+    if (extra_primes) {
+        size += sizeof(size_t);
 
-    CATCRYPT_REF_COUNTED_LEAVE(encrypted);
-    CATCRYPT_REF_COUNTED_LEAVE(privkey);
+        for (int i = 0; i < extra_primes; i++) {
+            size += (sizeof(size_t) * 3) + catcrypt_rsa_mpz_bytes(key->extra_primes[i].r)
+                    + catcrypt_rsa_mpz_bytes(key->extra_primes[i].d) + catcrypt_rsa_mpz_bytes(key->extra_primes[i].t);
+        }
+    }
 
-    return decrypted;
+    return size;
 }
 
-catcrypt_string_t* catcrypt_rsa_sign(catcrypt_string_t* data, catcrypt_rsa_key_t* privkey) {
-    CATCRYPT_REF_COUNTED_USE(data);
-    CATCRYPT_REF_COUNTED_USE(privkey);
+bool catcrypt_rsa_key_to_bin__into(char* output, size_t size, catcrypt_rsa_key_t* key) {
+    if (size < catcrypt_rsa_key_to_bin_itch(key)) {
+        return false;
+    }
 
-    uint32_t hash = catcrypt_rsa_hash_h32__n(data->value, data->length);
-    catcrypt_string_t* hash_str = catcrypt_string_new_from_binary__copy((char *) &hash, sizeof(hash));
-    CATCRYPT_REF_COUNTED_USE(hash_str);
-    catcrypt_rsa_encrypted_t* encrypted = catcrypt_rsa_encrypt(hash_str, privkey);
-    CATCRYPT_REF_COUNTED_USE(encrypted);
+    // The sizes of e and n come first, then their bytes
+    size_t exponent_size = catcrypt_rsa_mpz_bytes(key->e);
+    size_t modulus_size = catcrypt_rsa_mpz_bytes(key->n);
+    memcpy(output, &exponent_size, sizeof(exponent_size));
+    memcpy(output + sizeof(exponent_size), &modulus_size, sizeof(modulus_size));
+
+    char* cursor = output + sizeof(exponent_size) + sizeof(modulus_size);
+    mpz_export(cursor, NULL, CATCRYPT_MPZ_ORDER, 1, CATCRYPT_MPZ_ENDIAN, 0, key->e);
+    cursor += exponent_size;
+    mpz_export(cursor, NULL, CATCRYPT_MPZ_ORDER, 1, CATCRYPT_MPZ_ENDIAN, 0, key->n);
+    cursor += modulus_size;
+
+    if (key->is_crt) {
+        cursor = catcrypt_rsa_key_write_mpz(cursor, key->p);
+        cursor = catcrypt_rsa_key_write_mpz(cursor, key->q);
+        cursor = catcrypt_rsa_key_write_mpz(cursor, key->dp);
+        cursor = catcrypt_rsa_key_write_mpz(cursor, key->dq);
+        cursor = catcrypt_rsa_key_write_mpz(cursor, key->qinv);
+    }
 
-    CATCRYPT_REF_COUNTED_LEAVE(data);
-    CATCRYPT_REF_COUNTED_LEAVE(privkey);
+    size_t extra_primes = catcrypt_rsa_key_bin_extra_primes(key);
+    if (extra_primes) {
+        memcpy(cursor, &extra_primes, sizeof(extra_primes));
+        cursor += sizeof(extra_primes);
 
-    catcrypt_string_t* encrypted_data = encrypted->data;
+        for (int i = 0; i < extra_primes; i++) {
+            cursor = catcrypt_rsa_key_write_mpz(cursor, key->extra_primes[i].r);
+            cursor = catcrypt_rsa_key_write_mpz(cursor, key->extra_primes[i].d);
+            cursor = catcrypt_rsa_key_write_mpz(cursor, key->extra_primes[i].t);
+        }
+    }
 
-    encrypted_data->ref_counted.count++;
-    CATCRYPT_REF_COUNTED_LEAVE(encrypted);
-    encrypted_data->ref_counted.count--;
-    
-    return encrypted_data;
+    return true;
 }
 
-bool catcrypt_rsa_verify(catcrypt_string_t* data, catcrypt_string_t* signature, catcrypt_rsa_key_t* pubkey) {
-    CATCRYPT_REF_COUNTED_USE(data);
-    CATCRYPT_REF_COUNTED_USE(signature);
-    CATCRYPT_REF_COUNTED_USE(pubkey);
-
-    catcrypt_rsa_encrypted_t* encrypted = catcrypt_rsa_encrypted_new();
-    catcrypt_rsa_encrypted_set_data(encrypted, signature);
-    catcrypt_string_t* decrypted = catcrypt_rsa_decrypt(encrypted, pubkey);
-    uint32_t hash = catcrypt_rsa_hash_h32__n(data->value, data->length);
-    catcrypt_string_t* hash_str = catcrypt_string_new_from_binary__copy((char *) &hash, sizeof(hash));
-    CATCRYPT_REF_COUNTED_USE(hash_str);
+catcrypt_string_t* catcrypt_rsa_key_to_bin(catcrypt_rsa_key_t* key) {
+    CATCRYPT_REF_COUNTED_USE(key);
 
-    bool result = catcrypt_string_compare(decrypted, hash_str);
+    size_t size = catcrypt_rsa_key_to_bin_itch(key);
+    catcrypt_string_t* key_bin = catcrypt_string_new__n(size);
+    key_bin->length = size;
+    key_bin->value[size] = '\0';
+    catcrypt_rsa_key_to_bin__into(key_bin->value, size, key);
+    
+    CATCRYPT_REF_COUNTED_LEAVE(key);
 
-    CATCRYPT_REF_COUNTED_LEAVE(data);
-    CATCRYPT_REF_COUNTED_LEAVE(signature);
-    CATCRYPT_REF_COUNTED_LEAVE(pubkey);
+    return key_bin;
+}
 
-    return result;
+static bool catcrypt_rsa_crt_prime_is_valid(mpz_t prime, mpz_t exponent) {
+    return (mpz_cmp_ui(prime, 1) > 0) && mpz_odd_p(prime) && (mpz_cmp(exponent, prime) < 0);
 }
 
+/**
+ * The CRT numbers of a loaded key have to belong to n: a zero prime or a wrong coefficient crashes or
+ * silently breaks the CRT. Exponents and coefficients have to be below their primes for the constant-time path.
+ */
+static bool catcrypt_rsa_key_crt_is_valid(catcrypt_rsa_key_t* key) {
+    mpz_t product;
+    mpz_init(product);
+    mpz_t check;
+    mpz_init(check);
+
+    bool is_valid = catcrypt_rsa_crt_prime_is_valid(key->p, key->dp) && catcrypt_rsa_crt_prime_is_valid(key->q, key->dq)
+                 && (mpz_cmp(key->qinv, key->p) < 0) && (mpz_cmp(key->e, key->n) < 0);
+    if (is_valid) {
+        mpz_mul(check, key->qinv, key->q);
+        mpz_mod(check, check, key->p);
+        is_valid = mpz_cmp_ui(check, 1) == 0;
+    }
+
+    mpz_mul(product, key->p, key->q);
+    for (int i = 0; is_valid && (i < (key->primes - 2)); i++) {
+        catcrypt_rsa_crt_prime_t* prime = &key->extra_primes[i];
 
-catcrypt_string_t* catcrypt_rsa_signature_to_hex(catcrypt_string_t* signature_bin) {
-    CATCRYPT_REF_COUNTED_USE(signature_bin);
+        is_valid = catcrypt_rsa_crt_prime_is_valid(prime->r, prime->d) && (mpz_cmp(prime->t, prime->r) < 0);
+        if (is_valid) {
+            mpz_mul(check, prime->t, product);
+            mpz_mod(check, check, prime->r);
+            is_valid = mpz_cmp_ui(check, 1) == 0;
+        }
 
-    char* hex = malloc(signature_bin->length * 2 + 1);
-    for (size_t i = 0; i < signature_bin->length; i++) {
-        sprintf(hex + i * 2, "%02x", (unsigned char)signature_bin->value[i]);
+        mpz_mul(product, product, prime->r);
     }
-    hex[signature_bin->length * 2] = '\0';
-
-    catcrypt_string_t* signature_hex = catcrypt_string_new_from_cstr__copy(hex, signature_bin->length * 2);
-    free(hex);
+    is_valid = is_valid && (mpz_cmp(product, key->n) == 0);
 
-    CATCRYPT_REF_COUNTED_LEAVE(signature_bin);
+    mpz_clear(product);
+    mpz_clear(check);
 
-    return signature_hex;
+    return is_valid;
 }
 
-catcrypt_string_t* catcrypt_rsa_signature_from_hex(catcrypt_string_t* signature_hex) {
-    CATCRYPT_REF_COUNTED_USE(signature_hex);
-
-    char* signature = malloc(signature_hex->length / 2);
-    for (size_t i = 0; i < signature_hex->length / 2; i++) {
-        unsigned int temp;
-        sscanf(signature_hex->value + i * 2, "%02x", &temp);
-        signature[i] = (char)temp;
+catcrypt_rsa_key_t* catcrypt_rsa_key_from_bin__n(char* data, size_t length) {
+    size_t exponent_size;
+    size_t modulus_size;
+    if (length < (sizeof(exponent_size) + sizeof(modulus_size))) {
+        return NULL;
     }
 
-    catcrypt_string_t* signature_bin = catcrypt_string_new_from_cstr__copy(signature, signature_hex->length / 2);
-    free(signature);
+    memcpy(&exponent_size, data, sizeof(exponent_size));
+    memcpy(&modulus_size, data + sizeof(exponent_size), sizeof(modulus_size));
 
-    CATCRYPT_REF_COUNTED_LEAVE(signature_hex);
+    char* exponent = data + sizeof(exponent_size) + sizeof(modulus_size);
+    char* end = data + length;
+    if ((exponent_size > (end - exponent)) || (modulus_size > (end - exponent - exponent_size))) {
+        return NULL;
+    }
 
-    return signature_bin;
-}
+    char* modulus = exponent + exponent_size;
 
-catcrypt_string_t* catcrypt_rsa_key_to_bin(catcrypt_rsa_key_t* key) {
-    CATCRYPT_REF_COUNTED_USE(key);
+    catcrypt_rsa_key_t* key = catcrypt_rsa_key_new();
+    mpz_import(key->e, exponent_size, CATCRYPT_MPZ_ORDER, 1, CATCRYPT_MPZ_ENDIAN, 0, exponent);
+    mpz_import(key->n, modulus_size, CATCRYPT_MPZ_ORDER, 1, CATCRYPT_MPZ_ENDIAN, 0, modulus);
+    key->bits = mpz_sizeinbase(key->n, 2);
+
+    char* crt = modulus + modulus_size;
+    if (crt < end) {
+        crt = catcrypt_rsa_key_read_mpz(key->p, crt, end);
+        crt = catcrypt_rsa_key_read_mpz(key->q, crt, end);
+        crt = catcrypt_rsa_key_read_mpz(key->dp, crt, end);
+        crt = catcrypt_rsa_key_read_mpz(key->dq, crt, end);
+        crt = catcrypt_rsa_key_read_mpz(key->qinv, crt, end);
+        key->is_crt = true;
+    }
 
-    size_t marshalled_size = 0;
-    
-    size_t exponent_size = 0;
-    char* exponent = mpz_export(NULL, &exponent_size, CATCRYPT_MPZ_ORDER, 1, CATCRYPT_MPZ_ENDIAN, 0, key->e);
-    marshalled_size += exponent_size * 2;
+    if (crt && (crt < end)) {
+        size_t extra_primes = 0;
+        if ((end - crt) >= sizeof(extra_primes)) {
+            memcpy(&extra_primes, crt, sizeof(extra_primes));
+            crt += sizeof(extra_primes);
+        }
+
+        // Only keys with extra primes write the count
+        if ((extra_primes == 0) || (extra_primes > (CATCRYPT_RSA_MAX_PRIMES - 2))) {
+            crt = NULL;
+        }
+
+        for (int i = 0; crt && (i < extra_primes); i++) {
+            crt = catcrypt_rsa_key_read_mpz(key->extra_primes[i].r, crt, end);
+            crt = catcrypt_rsa_key_read_mpz(key->extra_primes[i].d, crt, end);
+            crt = catcrypt_rsa_key_read_mpz(key->extra_primes[i].t, crt, end);
+        }
+        key->primes = 2 + extra_primes;
+    }
 
-    size_t modulus_size = 0;
-    char* modulus = mpz_export(NULL, &modulus_size, CATCRYPT_MPZ_ORDER, 1, CATCRYPT_MPZ_ENDIAN, 0, key->n);
-    marshalled_size += modulus_size * 2;
-    
-    catcrypt_string_t* key_hex = catcrypt_string_new();
-    catcrypt_string_append__cstr__n(key_hex, (char *) &exponent_size, sizeof(exponent_size));
-    catcrypt_string_append__cstr__n(key_hex, (char *) &modulus_size, sizeof(modulus_size));
-    catcrypt_string_append__cstr__n(key_hex, exponent, exponent_size);
-    catcrypt_string_append__cstr__n(key_hex, modulus, modulus_size);
-
-    free(exponent);
-    free(modulus);
-    
-    CATCRYPT_REF_COUNTED_LEAVE(key);
+    // Every field has to be there, with nothing after them, and n can't be 0
+    if ((crt != end) || (mpz_sgn(key->n) == 0) || (key->is_crt && !catcrypt_rsa_key_crt_is_valid(key))) {
+        catcrypt_rsa_key_free(key);
+        return NULL;
+    }
 
-    return key_hex;
+    // Public keys (small e) get their fast path as soon as they are loaded
+    catcrypt_rsa_key_prepare(key);
+
+    return key;
 }
 
 catcrypt_rsa_key_t* catcrypt_rsa_key_from_bin(catcrypt_string_t* hex) {
     CATCRYPT_REF_COUNTED_USE(hex);
 
-    size_t exponent_size = *((size_t *) hex->value);
-    size_t modulus_size = *((size_t *) (hex->value + sizeof(exponent_size)));
-
-    char* exponent = hex->value + sizeof(exponent_size) + sizeof(modulus_size);
-    char* modulus = exponent + exponent_size;
-
-    catcrypt_rsa_key_t* key = catcrypt_rsa_key_new();
-    mpz_import(key->e, exponent_size, CATCRYPT_MPZ_ORDER, 1, CATCRYPT_MPZ_ENDIAN, 0, exponent);
-    mpz_import(key->n, modulus_size, CATCRYPT_MPZ_ORDER, 1, CATCRYPT_MPZ_ENDIAN, 0, modulus);
+    catcrypt_rsa_key_t* key = catcrypt_rsa_key_from_bin__n(hex->value, hex->length);
 
     CATCRYPT_REF_COUNTED_LEAVE(hex);
 
     return key;
 }
 
-catcrypt_string_t* catcrypt_rsa_key_to_hex(catcrypt_rsa_key_t* key) {
-    CATCRYPT_REF_COUNTED_USE(key);
-
-    catcrypt_string_t* key_bin = catcrypt_rsa_key_to_bin(key);
+size_t catcrypt_rsa_key_to_hex_itch(catcrypt_rsa_key_t* key) {
+    return catcrypt_rsa_key_to_bin_itch(key) * 2;
+}
 
-    char* key_hex = malloc(key_bin->length * 2 + 1);
-    for (size_t i = 0; i < key_bin->length; i++) {
-        sprintf(key_hex + i * 2, "%02x", (unsigned char)key_bin->value[i]);
+bool catcrypt_rsa_key_to_hex__into(char* output, size_t size, catcrypt_rsa_key_t* key) {
+    size_t bin_size = catcrypt_rsa_key_to_bin_itch(key);
+    if (size < (bin_size * 2)) {
+        return false;
     }
-    key_hex[key_bin->length * 2] = '\0';
 
-    catcrypt_string_t* key_hex_str = catcrypt_string_new_from_cstr__copy(key_hex, key_bin->length * 2);
+    // The bin goes into the second half of output and is expanded into digits from the front
+    catcrypt_rsa_key_to_bin__into(output + bin_size, bin_size, key);
+    catcrypt_rsa_hex_encode(output, output + bin_size, bin_size);
+
+    return true;
+}
+
+catcrypt_string_t* catcrypt_rsa_key_to_hex(catcrypt_rsa_key_t* key) {
+    CATCRYPT_REF_COUNTED_USE(key);
+
+    size_t size = catcrypt_rsa_key_to_hex_itch(key);
+    catcrypt_string_t* key_hex = catcrypt_string_new__n(size);
+    key_hex->length = size;
+    key_hex->value[size] = '\0';
+    catcrypt_rsa_key_to_hex__into(key_hex->value, size, key);
 
-    free(key_hex);
     CATCRYPT_REF_COUNTED_LEAVE(key);
 
-    return key_hex_str;
+    return key_hex;
 }
 
 catcrypt_rsa_key_t* catcrypt_rsa_key_from_hex(catcrypt_string_t* hex) {
     CATCRYPT_REF_COUNTED_USE(hex);
 
-    char* key_bin = malloc(hex->length / 2);
-    for (size_t i = 0; i < hex->length / 2; i++) {
-        unsigned int temp;
-        sscanf(hex->value + i * 2, "%02x", &temp);
-        key_bin[i] = (char)temp;
-    }
-
-    catcrypt_string_t* key_bin_str = catcrypt_string_new_from_cstr__copy(key_bin, hex->length / 2);
-    key_bin_str->is_alloc_str = true;
-    catcrypt_rsa_key_t* key_hex = catcrypt_rsa_key_from_bin(key_bin_str);
+    size_t size = hex->length / 2;
+    char* key_bin = malloc(size);
+    catcrypt_rsa_key_t* key = catcrypt_rsa_hex_decode(key_bin, hex->value, size) ? catcrypt_rsa_key_from_bin__n(key_bin, size): NULL;
 
     free(key_bin);
     CATCRYPT_REF_COUNTED_LEAVE(hex);
 
-    return key_hex;
+    return key;
 }
\ No newline at end of file
@@ -0,0 +1,194 @@
+/*
+ * Catcrypt, simple RSA/PKE for C
+ * Copyright (C) 2023, Oğuzhan Eroğlu <meowingcate@gmail.com> (https://meowingcat.io)
+ * Licensed under GPLv3 License
+ * See LICENSE for more info
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gmp.h>
+
+#include "../include/seal.h"
+
+#include "../include/ref.h"
+#include "../include/string.h"
+#include "../include/rsa.h"
+#include "../include/rng.h"
+#include "../include/aead.h"
+#include "../include/sha256.h"
+
+static void catcrypt_seal_be_write(char* cursor, uint64_t value, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        cursor[size - 1 - i] = (char) (value >> (8 * i));
+    }
+}
+
+static uint64_t catcrypt_seal_be_read(char* cursor, size_t size) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < size; i++) {
+        value = (value << 8) | (unsigned char) cursor[i];
+    }
+
+    return value;
+}
+
+/**
+ * num as exactly size big-endian bytes, it must fit.
+ */
+static void catcrypt_seal_export(char* out, size_t size, mpz_t num) {
+    size_t num_size = (mpz_sgn(num) == 0) ? 0: mpz_sizeinbase(num, 256);
+    memset(out, 0, size - num_size);
+    if (num_size) {
+        mpz_export(out + (size - num_size), NULL, CATCRYPT_MPZ_ORDER, 1, CATCRYPT_MPZ_ENDIAN, 0, num);
+    }
+}
+
+/**
+ * AEAD key and nonce from the bytes of r.
+ */
+static void catcrypt_seal_derive(unsigned char* key, unsigned char* nonce, char* r_bytes, size_t key_size) {
+    unsigned char okm[CATCRYPT_AEAD_KEY_SIZE + CATCRYPT_AEAD_NONCE_SIZE];
+    catcrypt_sha256_hkdf(okm, sizeof(okm), NULL, 0, r_bytes, key_size, CATCRYPT_SEAL_INFO, strlen(CATCRYPT_SEAL_INFO));
+
+    memcpy(key, okm, CATCRYPT_AEAD_KEY_SIZE);
+    memcpy(nonce, okm + CATCRYPT_AEAD_KEY_SIZE, CATCRYPT_AEAD_NONCE_SIZE);
+    memset(okm, 0, sizeof(okm));
+}
+
+size_t catcrypt_seal_size(catcrypt_rsa_key_t* pubkey, size_t length) {
+    return CATCRYPT_SEAL_HEADER_SIZE + catcrypt_rsa_key_size(pubkey) + length + CATCRYPT_AEAD_TAG_SIZE;
+}
+
+catcrypt_string_t* catcrypt_seal(catcrypt_string_t* data, catcrypt_rsa_key_t* pubkey) {
+    CATCRYPT_REF_COUNTED_USE(data);
+    CATCRYPT_REF_COUNTED_USE(pubkey);
+
+    size_t key_size = catcrypt_rsa_key_size(pubkey);
+    size_t size = catcrypt_seal_size(pubkey, data->length);
+    if (size > CATCRYPT_STRING_MAX_LENGTH) {
+        CATCRYPT_REF_COUNTED_LEAVE(data);
+        CATCRYPT_REF_COUNTED_LEAVE(pubkey);
+        return NULL;
+    }
+
+    catcrypt_string_t* sealed = catcrypt_string_new__n(size);
+    sealed->length = size;
+    sealed->value[size] = '\0';
+
+    char* header = sealed->value;
+    memcpy(header, CATCRYPT_SEAL_MAGIC, 4);
+    catcrypt_seal_be_write(header + 4, CATCRYPT_SEAL_VERSION, 1);
+    catcrypt_seal_be_write(header + 5, 0, 1);
+    catcrypt_seal_be_write(header + 6, 0, 2);
+    catcrypt_seal_be_write(header + 8, key_size, 4);
+    catcrypt_seal_be_write(header + 12, catcrypt_rsa_key_fingerprint(pubkey), 8);
+    catcrypt_seal_be_write(header + 20, data->length, 8);
+
+    char* encapsulated = sealed->value + CATCRYPT_SEAL_HEADER_SIZE;
+    char* r_bytes = malloc(key_size);
+    size_t bits = catcrypt_rsa_key_bits(pubkey);
+
+    mpz_t r;
+    mpz_init(r);
+    mpz_t c;
+    mpz_init(c);
+
+    // Uniform in [1, n): random bits of n's size until one is below n, it takes less than two tries
+    do {
+        if (!catcrypt_rng_fill(r_bytes, key_size)) {
+            fprintf(stderr, "catcrypt_seal(): Failed to generate the random key.\n");
+            exit(1);
+        }
+        r_bytes[0] &= 0xff >> ((key_size * 8) - bits);
+        mpz_import(r, key_size, CATCRYPT_MPZ_ORDER, 1, CATCRYPT_MPZ_ENDIAN, 0, r_bytes);
+    } while ((mpz_sgn(r) == 0) || (mpz_cmp(r, pubkey->n) >= 0));
+
+    catcrypt_rsa_key_powm(c, r, pubkey);
+    catcrypt_seal_export(encapsulated, key_size, c);
+
+    unsigned char key[CATCRYPT_AEAD_KEY_SIZE];
+    unsigned char nonce[CATCRYPT_AEAD_NONCE_SIZE];
+    catcrypt_seal_derive(key, nonce, r_bytes, key_size);
+
+    unsigned char* ciphertext = (unsigned char *) encapsulated + key_size;
+    catcrypt_aead_encrypt(ciphertext, ciphertext + data->length, (unsigned char *) data->value, data->length,
+                          (unsigned char *) sealed->value, CATCRYPT_SEAL_HEADER_SIZE + key_size, key, nonce);
+
+    memset(key, 0, sizeof(key));
+    memset(r_bytes, 0, key_size);
+    free(r_bytes);
+    mpz_clear(r);
+    mpz_clear(c);
+
+    CATCRYPT_REF_COUNTED_LEAVE(data);
+    CATCRYPT_REF_COUNTED_LEAVE(pubkey);
+
+    return sealed;
+}
+
+catcrypt_string_t* catcrypt_open(catcrypt_string_t* sealed, catcrypt_rsa_key_t* privkey) {
+    CATCRYPT_REF_COUNTED_USE(sealed);
+    CATCRYPT_REF_COUNTED_USE(privkey);
+
+    catcrypt_string_t* opened = NULL;
+    size_t key_size = catcrypt_rsa_key_size(privkey);
+    size_t overhead = CATCRYPT_SEAL_HEADER_SIZE + key_size + CATCRYPT_AEAD_TAG_SIZE;
+    char* header = sealed->value;
+
+    // The size, key and length are checked before the exponentiation
+    bool is_valid = (sealed->length >= overhead) && (sealed->length <= CATCRYPT_STRING_MAX_LENGTH)
+                 && (memcmp(header, CATCRYPT_SEAL_MAGIC, 4) == 0)
+                 && (catcrypt_seal_be_read(header + 4, 1) == CATCRYPT_SEAL_VERSION)
+                 && (catcrypt_seal_be_read(header + 5, 3) == 0)
+                 && (catcrypt_seal_be_read(header + 8, 4) == key_size)
+                 && (catcrypt_seal_be_read(header + 12, 8) == catcrypt_rsa_key_fingerprint(privkey))
+                 && (catcrypt_seal_be_read(header + 20, 8) == (sealed->length - overhead));
+
+    mpz_t c;
+    mpz_init(c);
+    if (is_valid) {
+        mpz_import(c, key_size, CATCRYPT_MPZ_ORDER, 1, CATCRYPT_MPZ_ENDIAN, 0, sealed->value + CATCRYPT_SEAL_HEADER_SIZE);
+        is_valid = mpz_cmp(c, privkey->n) < 0;
+    }
+
+    if (is_valid) {
+        size_t length = sealed->length - overhead;
+        unsigned char* ciphertext = (unsigned char *) sealed->value + CATCRYPT_SEAL_HEADER_SIZE + key_size;
+
+        mpz_t r;
+        mpz_init(r);
+        catcrypt_rsa_key_powm(r, c, privkey);
+
+        char* r_bytes = malloc(key_size);
+        catcrypt_seal_export(r_bytes, key_size, r);
+
+        unsigned char key[CATCRYPT_AEAD_KEY_SIZE];
+        unsigned char nonce[CATCRYPT_AEAD_NONCE_SIZE];
+        catcrypt_seal_derive(key, nonce, r_bytes, key_size);
+
+        opened = catcrypt_string_new__n(length);
+
+        if (catcrypt_aead_decrypt((unsigned char *) opened->value, ciphertext + length, ciphertext, length,
+                                  (unsigned char *) sealed->value, CATCRYPT_SEAL_HEADER_SIZE + key_size, key, nonce)) {
+            opened->length = length;
+            opened->value[length] = '\0';
+        } else {
+            catcrypt_string_free(opened);
+            opened = NULL;
+        }
+
+        memset(key, 0, sizeof(key));
+        memset(r_bytes, 0, key_size);
+        free(r_bytes);
+        mpz_clear(r);
+    }
+
+    mpz_clear(c);
+
+    CATCRYPT_REF_COUNTED_LEAVE(sealed);
+    CATCRYPT_REF_COUNTED_LEAVE(privkey);
+
+    return opened;
+}
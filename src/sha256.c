@@ -0,0 +1,204 @@
+/*
+ * Catcrypt, simple RSA/PKE for C
+ * Copyright (C) 2023, Oğuzhan Eroğlu <meowingcate@gmail.com> (https://meowingcat.io)
+ * Licensed under GPLv3 License
+ * See LICENSE for more info
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "../include/sha256.h"
+
+#define CATCRYPT_SHA256_ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static const uint32_t catcrypt_sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static void catcrypt_sha256_compress(catcrypt_sha256_t* state, const unsigned char* block) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = ((uint32_t) block[i * 4] << 24) | ((uint32_t) block[i * 4 + 1] << 16) | ((uint32_t) block[i * 4 + 2] << 8) | block[i * 4 + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = CATCRYPT_SHA256_ROTR(w[i - 15], 7) ^ CATCRYPT_SHA256_ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = CATCRYPT_SHA256_ROTR(w[i - 2], 17) ^ CATCRYPT_SHA256_ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state->h[0], b = state->h[1], c = state->h[2], d = state->h[3];
+    uint32_t e = state->h[4], f = state->h[5], g = state->h[6], h = state->h[7];
+
+    for (int i = 0; i < 64; i++) {
+        uint32_t s1 = CATCRYPT_SHA256_ROTR(e, 6) ^ CATCRYPT_SHA256_ROTR(e, 11) ^ CATCRYPT_SHA256_ROTR(e, 25);
+        uint32_t ch = (e & f) ^ (~e & g);
+        uint32_t t1 = h + s1 + ch + catcrypt_sha256_k[i] + w[i];
+        uint32_t s0 = CATCRYPT_SHA256_ROTR(a, 2) ^ CATCRYPT_SHA256_ROTR(a, 13) ^ CATCRYPT_SHA256_ROTR(a, 22);
+        uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+        uint32_t t2 = s0 + maj;
+
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+
+    state->h[0] += a; state->h[1] += b; state->h[2] += c; state->h[3] += d;
+    state->h[4] += e; state->h[5] += f; state->h[6] += g; state->h[7] += h;
+}
+
+void catcrypt_sha256_init(catcrypt_sha256_t* state) {
+    static const uint32_t h[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    memcpy(state->h, h, sizeof(h));
+    state->block_length = 0;
+    state->length = 0;
+}
+
+void catcrypt_sha256_update(catcrypt_sha256_t* state, const void* data, size_t length) {
+    const unsigned char* bytes = data;
+    state->length += length;
+
+    if (state->block_length > 0) {
+        size_t to_copy = CATCRYPT_SHA256_BLOCK_SIZE - state->block_length;
+        to_copy = (length < to_copy) ? length: to_copy;
+
+        memcpy(state->block + state->block_length, bytes, to_copy);
+        state->block_length += to_copy;
+        bytes += to_copy;
+        length -= to_copy;
+
+        if (state->block_length < CATCRYPT_SHA256_BLOCK_SIZE) {
+            return;
+        }
+
+        catcrypt_sha256_compress(state, state->block);
+        state->block_length = 0;
+    }
+
+    for (; length >= CATCRYPT_SHA256_BLOCK_SIZE; bytes += CATCRYPT_SHA256_BLOCK_SIZE, length -= CATCRYPT_SHA256_BLOCK_SIZE) {
+        catcrypt_sha256_compress(state, bytes);
+    }
+
+    memcpy(state->block, bytes, length);
+    state->block_length = length;
+}
+
+void catcrypt_sha256_final(catcrypt_sha256_t* state, unsigned char* out) {
+    uint64_t bits = state->length * 8;
+
+    state->block[state->block_length++] = 0x80;
+    if (state->block_length > (CATCRYPT_SHA256_BLOCK_SIZE - 8)) {
+        memset(state->block + state->block_length, 0, CATCRYPT_SHA256_BLOCK_SIZE - state->block_length);
+        catcrypt_sha256_compress(state, state->block);
+        state->block_length = 0;
+    }
+
+    memset(state->block + state->block_length, 0, CATCRYPT_SHA256_BLOCK_SIZE - 8 - state->block_length);
+    for (int i = 0; i < 8; i++) {
+        state->block[CATCRYPT_SHA256_BLOCK_SIZE - 1 - i] = bits >> (8 * i);
+    }
+    catcrypt_sha256_compress(state, state->block);
+
+    for (int i = 0; i < 8; i++) {
+        out[i * 4] = state->h[i] >> 24;
+        out[i * 4 + 1] = state->h[i] >> 16;
+        out[i * 4 + 2] = state->h[i] >> 8;
+        out[i * 4 + 3] = state->h[i];
+    }
+}
+
+void catcrypt_sha256_hmac(unsigned char* out, const void* key, size_t key_length, const void* data, size_t length) {
+    unsigned char block_key[CATCRYPT_SHA256_BLOCK_SIZE] = {0};
+    catcrypt_sha256_t state;
+
+    // Keys longer than a block are hashed first
+    if (key_length > CATCRYPT_SHA256_BLOCK_SIZE) {
+        catcrypt_sha256_init(&state);
+        catcrypt_sha256_update(&state, key, key_length);
+        catcrypt_sha256_final(&state, block_key);
+    } else {
+        memcpy(block_key, key, key_length);
+    }
+
+    unsigned char pad[CATCRYPT_SHA256_BLOCK_SIZE];
+    unsigned char inner[CATCRYPT_SHA256_SIZE];
+
+    for (int i = 0; i < CATCRYPT_SHA256_BLOCK_SIZE; i++) {
+        pad[i] = block_key[i] ^ 0x36;
+    }
+    catcrypt_sha256_init(&state);
+    catcrypt_sha256_update(&state, pad, sizeof(pad));
+    catcrypt_sha256_update(&state, data, length);
+    catcrypt_sha256_final(&state, inner);
+
+    for (int i = 0; i < CATCRYPT_SHA256_BLOCK_SIZE; i++) {
+        pad[i] = block_key[i] ^ 0x5c;
+    }
+    catcrypt_sha256_init(&state);
+    catcrypt_sha256_update(&state, pad, sizeof(pad));
+    catcrypt_sha256_update(&state, inner, sizeof(inner));
+    catcrypt_sha256_final(&state, out);
+
+    memset(block_key, 0, sizeof(block_key));
+    memset(pad, 0, sizeof(pad));
+    memset(&state, 0, sizeof(state));
+}
+
+void catcrypt_sha256_hkdf(unsigned char* out, size_t length, const void* salt, size_t salt_length, const void* ikm, size_t ikm_length, const void* info, size_t info_length) {
+    unsigned char zeros[CATCRYPT_SHA256_SIZE] = {0};
+    unsigned char prk[CATCRYPT_SHA256_SIZE];
+
+    if (salt_length == 0) {
+        salt = zeros;
+        salt_length = sizeof(zeros);
+    }
+    catcrypt_sha256_hmac(prk, salt, salt_length, ikm, ikm_length);
+
+    // T(i) = HMAC(PRK, T(i - 1) | info | i), T(0) is empty
+    unsigned char block[CATCRYPT_SHA256_SIZE];
+    size_t block_length = 0;
+    unsigned char counter = 1;
+
+    while (length > 0) {
+        unsigned char pad[CATCRYPT_SHA256_BLOCK_SIZE];
+        unsigned char inner[CATCRYPT_SHA256_SIZE];
+        catcrypt_sha256_t state;
+
+        // HMAC is done here by hand, T(i - 1) | info | i isn't contiguous
+        for (int i = 0; i < CATCRYPT_SHA256_BLOCK_SIZE; i++) {
+            pad[i] = ((i < CATCRYPT_SHA256_SIZE) ? prk[i]: 0) ^ 0x36;
+        }
+        catcrypt_sha256_init(&state);
+        catcrypt_sha256_update(&state, pad, sizeof(pad));
+        catcrypt_sha256_update(&state, block, block_length);
+        catcrypt_sha256_update(&state, info, info_length);
+        catcrypt_sha256_update(&state, &counter, 1);
+        catcrypt_sha256_final(&state, inner);
+
+        for (int i = 0; i < CATCRYPT_SHA256_BLOCK_SIZE; i++) {
+            pad[i] = ((i < CATCRYPT_SHA256_SIZE) ? prk[i]: 0) ^ 0x5c;
+        }
+        catcrypt_sha256_init(&state);
+        catcrypt_sha256_update(&state, pad, sizeof(pad));
+        catcrypt_sha256_update(&state, inner, sizeof(inner));
+        catcrypt_sha256_final(&state, block);
+        block_length = sizeof(block);
+
+        size_t to_copy = (length < sizeof(block)) ? length: sizeof(block);
+        memcpy(out, block, to_copy);
+        out += to_copy;
+        length -= to_copy;
+        counter++;
+
+        memset(pad, 0, sizeof(pad));
+    }
+
+    memset(prk, 0, sizeof(prk));
+    memset(block, 0, sizeof(block));
+}
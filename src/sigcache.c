@@ -0,0 +1,225 @@
+/*
+ * Catcrypt, simple RSA/PKE for C
+ * Copyright (C) 2023, Oğuzhan Eroğlu <meowingcate@gmail.com> (https://meowingcat.io)
+ * Licensed under GPLv3 License
+ * See LICENSE for more info
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <gmp.h>
+
+#include "../include/sigcache.h"
+
+#include "../include/util.h"
+#include "../include/ref.h"
+#include "../include/string.h"
+#include "../include/rsa.h"
+#include "../include/rng.h"
+#include "../include/siphash.h"
+
+static void catcrypt_sigcache_siphash_mpz(catcrypt_siphash_t* state, mpz_t num) {
+    size_t size = mpz_size(num);
+    catcrypt_siphash_update(state, &size, sizeof(size));
+    catcrypt_siphash_update(state, mpz_limbs_read(num), size * sizeof(mp_limb_t));
+}
+
+/**
+ * catcrypt_rsa_verify() only looks at the message through its hash, so that is all the tag needs of it.
+ * Every field is prefixed with its length so two different tuples never feed the same bytes.
+ */
+static void catcrypt_sigcache_tag(catcrypt_sigcache_t* cache, uint64_t tag[2], catcrypt_string_t* data, catcrypt_string_t* signature, catcrypt_rsa_key_t* pubkey) {
+    catcrypt_siphash_t state;
+    catcrypt_siphash_init(&state, cache->key[0], cache->key[1]);
+
+    catcrypt_sigcache_siphash_mpz(&state, pubkey->n);
+    catcrypt_sigcache_siphash_mpz(&state, pubkey->e);
+
+    uint32_t hash = catcrypt_rsa_hash_h32__n(data->value, data->length);
+    catcrypt_siphash_update(&state, &hash, sizeof(hash));
+
+    size_t signature_length = signature->length;
+    catcrypt_siphash_update(&state, &signature_length, sizeof(signature_length));
+    catcrypt_siphash_update(&state, signature->value, signature_length);
+
+    catcrypt_siphash_final(&state, tag);
+}
+
+static catcrypt_sigcache_shard_t* catcrypt_sigcache_get_shard(catcrypt_sigcache_t* cache, uint64_t tag[2]) {
+    return &cache->shards[(tag[1] >> 32) & (cache->shards_count - 1)];
+}
+
+static catcrypt_sigcache_entry_t* catcrypt_sigcache_get_set(catcrypt_sigcache_shard_t* shard, uint64_t tag[2], uint8_t** hand) {
+    size_t set = tag[0] % shard->sets;
+    *hand = &shard->hands[set];
+    return &shard->entries[set * CATCRYPT_SIGCACHE_WAYS];
+}
+
+static catcrypt_sigcache_entry_t* catcrypt_sigcache_find(catcrypt_sigcache_entry_t* set, uint64_t tag[2]) {
+    for (int i = 0; i < CATCRYPT_SIGCACHE_WAYS; i++) {
+        if (set[i].is_used && (set[i].tag[0] == tag[0]) && (set[i].tag[1] == tag[1])) {
+            return &set[i];
+        }
+    }
+
+    return NULL;
+}
+
+static void catcrypt_sigcache_insert(catcrypt_sigcache_shard_t* shard, uint64_t tag[2], bool is_verified) {
+    uint8_t* hand;
+    catcrypt_sigcache_entry_t* set = catcrypt_sigcache_get_set(shard, tag, &hand);
+
+    // Another thread may have verified the same signature in the meantime
+    catcrypt_sigcache_entry_t* entry = catcrypt_sigcache_find(set, tag);
+
+    for (int i = 0; !entry && (i < CATCRYPT_SIGCACHE_WAYS); i++) {
+        if (!set[i].is_used) {
+            entry = &set[i];
+            shard->length++;
+        }
+    }
+
+    // CLOCK: referenced entries get a second chance, the first one that wasn't hit since the last sweep goes
+    while (!entry) {
+        catcrypt_sigcache_entry_t* candidate = &set[*hand];
+        *hand = (*hand + 1) % CATCRYPT_SIGCACHE_WAYS;
+
+        if (candidate->is_referenced) {
+            candidate->is_referenced = false;
+        } else {
+            entry = candidate;
+            shard->evictions++;
+        }
+    }
+
+    entry->tag[0] = tag[0];
+    entry->tag[1] = tag[1];
+    entry->is_used = true;
+    entry->is_referenced = false;
+    entry->is_verified = is_verified;
+}
+
+catcrypt_sigcache_t* catcrypt_sigcache_new(size_t capacity, int shards) {
+    if (shards <= 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        shards = (cores > 0) ? cores: 1;
+    }
+
+    int shards_count = 1;
+    while (shards_count < shards) {
+        shards_count <<= 1;
+    }
+
+    // Every shard needs one full set, fewer shards keep a small capacity
+    while ((shards_count > 1) && (((size_t) shards_count * CATCRYPT_SIGCACHE_WAYS) > capacity)) {
+        shards_count >>= 1;
+    }
+
+    catcrypt_sigcache_t* cache = malloc(sizeof(catcrypt_sigcache_t));
+    CATCRYPT_REF_COUNTED_INIT(cache, catcrypt_sigcache_free);
+
+    if (!catcrypt_rng_fill(cache->key, sizeof(cache->key))) {
+        fprintf(stderr, "catcrypt_sigcache_new(): Failed to generate the cache key.\n");
+        exit(1);
+    }
+
+    size_t sets = capacity / ((size_t) shards_count * CATCRYPT_SIGCACHE_WAYS);
+    if (sets == 0) {
+        sets = 1;
+    }
+
+    cache->shards_count = shards_count;
+    cache->shards = aligned_alloc(_Alignof(catcrypt_sigcache_shard_t), sizeof(catcrypt_sigcache_shard_t) * shards_count);
+
+    for (int i = 0; i < shards_count; i++) {
+        catcrypt_sigcache_shard_t* shard = &cache->shards[i];
+        pthread_mutex_init(&shard->mutex, NULL);
+        shard->sets = sets;
+        shard->entries = calloc(sets * CATCRYPT_SIGCACHE_WAYS, sizeof(catcrypt_sigcache_entry_t));
+        shard->hands = calloc(sets, sizeof(uint8_t));
+        shard->hits = 0;
+        shard->misses = 0;
+        shard->evictions = 0;
+        shard->length = 0;
+    }
+
+    return cache;
+}
+
+void catcrypt_sigcache_free(catcrypt_sigcache_t* cache) {
+    for (int i = 0; i < cache->shards_count; i++) {
+        pthread_mutex_destroy(&cache->shards[i].mutex);
+        free(cache->shards[i].entries);
+        free(cache->shards[i].hands);
+    }
+
+    free(cache->shards);
+    free(cache);
+}
+
+bool catcrypt_sigcache_verify(catcrypt_sigcache_t* cache, catcrypt_string_t* data, catcrypt_string_t* signature, catcrypt_rsa_key_t* pubkey) {
+    CATCRYPT_REF_COUNTED_USE(data);
+    CATCRYPT_REF_COUNTED_USE(signature);
+    CATCRYPT_REF_COUNTED_USE(pubkey);
+
+    uint64_t tag[2];
+    catcrypt_sigcache_tag(cache, tag, data, signature, pubkey);
+
+    catcrypt_sigcache_shard_t* shard = catcrypt_sigcache_get_shard(cache, tag);
+    uint8_t* hand;
+    catcrypt_sigcache_entry_t* set = catcrypt_sigcache_get_set(shard, tag, &hand);
+
+    pthread_mutex_lock(&shard->mutex);
+
+    catcrypt_sigcache_entry_t* entry = catcrypt_sigcache_find(set, tag);
+    bool is_hit = entry != NULL;
+    bool is_verified = false;
+
+    if (is_hit) {
+        entry->is_referenced = true;
+        is_verified = entry->is_verified;
+        shard->hits++;
+    } else {
+        shard->misses++;
+    }
+
+    pthread_mutex_unlock(&shard->mutex);
+
+    // The shard isn't locked while the signature is verified
+    if (!is_hit) {
+        is_verified = catcrypt_rsa_verify(data, signature, pubkey);
+
+        pthread_mutex_lock(&shard->mutex);
+        catcrypt_sigcache_insert(shard, tag, is_verified);
+        pthread_mutex_unlock(&shard->mutex);
+    }
+
+    CATCRYPT_REF_COUNTED_LEAVE(data);
+    CATCRYPT_REF_COUNTED_LEAVE(signature);
+    CATCRYPT_REF_COUNTED_LEAVE(pubkey);
+
+    return is_verified;
+}
+
+void catcrypt_sigcache_get_stats(catcrypt_sigcache_t* cache, catcrypt_sigcache_stats_t* stats) {
+    memset(stats, 0, sizeof(catcrypt_sigcache_stats_t));
+
+    for (int i = 0; i < cache->shards_count; i++) {
+        catcrypt_sigcache_shard_t* shard = &cache->shards[i];
+
+        pthread_mutex_lock(&shard->mutex);
+
+        stats->hits += shard->hits;
+        stats->misses += shard->misses;
+        stats->evictions += shard->evictions;
+        stats->length += shard->length;
+        stats->capacity += (uint64_t) shard->sets * CATCRYPT_SIGCACHE_WAYS;
+
+        pthread_mutex_unlock(&shard->mutex);
+    }
+}
@@ -0,0 +1,65 @@
+/*
+ * Catcrypt, simple RSA/PKE for C
+ * Copyright (C) 2023, Oğuzhan Eroğlu <meowingcate@gmail.com> (https://meowingcat.io)
+ * Licensed under GPLv3 License
+ * See LICENSE for more info
+ */
+
+#include <stdint.h>
+
+#include "../include/siphash.h"
+
+#define CATCRYPT_SIPHASH_ROTL(x, n) (((x) << (n)) | ((x) >> (64 - (n))))
+
+static void catcrypt_siphash_round(uint64_t* v) {
+    v[0] += v[1]; v[1] = CATCRYPT_SIPHASH_ROTL(v[1], 13); v[1] ^= v[0]; v[0] = CATCRYPT_SIPHASH_ROTL(v[0], 32);
+    v[2] += v[3]; v[3] = CATCRYPT_SIPHASH_ROTL(v[3], 16); v[3] ^= v[2];
+    v[0] += v[3]; v[3] = CATCRYPT_SIPHASH_ROTL(v[3], 21); v[3] ^= v[0];
+    v[2] += v[1]; v[1] = CATCRYPT_SIPHASH_ROTL(v[1], 17); v[1] ^= v[2]; v[2] = CATCRYPT_SIPHASH_ROTL(v[2], 32);
+}
+
+static void catcrypt_siphash_compress(catcrypt_siphash_t* state, uint64_t m) {
+    state->v[3] ^= m;
+    catcrypt_siphash_round(state->v);
+    catcrypt_siphash_round(state->v);
+    state->v[0] ^= m;
+}
+
+void catcrypt_siphash_init(catcrypt_siphash_t* state, uint64_t k0, uint64_t k1) {
+    state->v[0] = k0 ^ 0x736f6d6570736575ULL;
+    state->v[1] = k1 ^ 0x646f72616e646f6dULL ^ 0xee;
+    state->v[2] = k0 ^ 0x6c7967656e657261ULL;
+    state->v[3] = k1 ^ 0x7465646279746573ULL;
+    state->tail = 0;
+    state->length = 0;
+}
+
+void catcrypt_siphash_update(catcrypt_siphash_t* state, const void* data, size_t length) {
+    const unsigned char* bytes = data;
+
+    for (size_t i = 0; i < length; i++) {
+        state->tail |= (uint64_t) bytes[i] << (8 * (state->length % 8));
+        state->length++;
+
+        if ((state->length % 8) == 0) {
+            catcrypt_siphash_compress(state, state->tail);
+            state->tail = 0;
+        }
+    }
+}
+
+void catcrypt_siphash_final(catcrypt_siphash_t* state, uint64_t out[2]) {
+    catcrypt_siphash_compress(state, state->tail | ((uint64_t) state->length << 56));
+
+    state->v[2] ^= 0xee;
+    for (int i = 0; i < 4; i++) {
+        catcrypt_siphash_round(state->v);
+    }
+    out[0] = state->v[0] ^ state->v[1] ^ state->v[2] ^ state->v[3];
+
+    state->v[1] ^= 0xdd;
+    for (int i = 0; i < 4; i++) {
+        catcrypt_siphash_round(state->v);
+    }
+    out[1] = state->v[0] ^ state->v[1] ^ state->v[2] ^ state->v[3];
+}
@@ -29,11 +29,11 @@ catcrypt_string_t* catcrypt_string_new__n(int length) {
     catcrypt_string_t* string = malloc(sizeof(catcrypt_string_t));
     CATCRYPT_REF_COUNTED_INIT(string, catcrypt_string_free);
     string->length = 0;
-    string->size = string->length + 1;
+    string->size = length + 1;
 
     string->is_alloc_str = true;
     string->value = malloc(length+1);
-    string->value[length] = '\0';
+    string->value[0] = '\0';
     
     return string;
 }
@@ -55,6 +55,13 @@ uint64_t catcrypt_util_get_time_msec() {
     return current_time.tv_sec * 1000 + current_time.tv_usec / 1000;
 }
 
+uint64_t catcrypt_util_get_time_usec() {
+    struct timespec current_time;
+    clock_gettime(CLOCK_MONOTONIC, &current_time);
+
+    return current_time.tv_sec * 1000000 + current_time.tv_nsec / 1000;
+}
+
 int catcrypt_util_int2str(int number, char* target) {
     int current = number;
     int str_i = 0;